@@ -1,9 +1,15 @@
 #!/bin/bash
 
+# Both objectives at every clearance, with the grids split into shards run by worker
+# processes. Finished shards are appended to the results file: running the script again
+# after an interruption resumes the sweep instead of starting over. Each slice of the
+# grid is integrated once for every clearance, from its closest approaches to the Moon.
+# Lines written with other settings are not reused. The optimum of every objective and
+# clearance is integrated again and logged to output/Optimum_*.trj.
+
 clearances=(0 10 100 1000 5000 10000 50000 100000)
 accuracy=0.5
+results=output/sweep_results_0p5.txt
 
-for clearance in ${clearances[*]}; do
-    ./three_body 1 $clearance $accuracy
-    ./three_body 2 $clearance $accuracy
-done
\ No newline at end of file
+make exe_sweep_driver || exit 1
+./exe_sweep_driver $results $accuracy --clearances $(IFS=,; echo "${clearances[*]}")
@@ -3,6 +3,8 @@ clc; clear all; close all;
 %%
 RE = 6378e3;
 
+% Trajectories are written in binary, convert first with
+% ./exe_trajectory_text output/Optimum_1_100p000_20p000.trj
 data = importdata("Optimum_1_100p000_20p000");
 figure(); hold on;
 
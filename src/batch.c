@@ -0,0 +1,466 @@
+#include "batch.h"
+
+/* Gravitational parameters in double precision */
+static const double muEarth = (double)G*MASS_EARTH;
+static const double muMoon  = (double)G*MASS_MOON;
+static const double muSat   = (double)G*MASS_SAT;
+
+/**
+ * Load the next candidate from the source into a lane, or mark the lane idle
+ */
+static void refill(batch_source_t source, void *context, configuration_t config,
+		batch_t *batch, uint8_t lane);
+
+/**
+ * Acceptance (1 or 0) and step factor of every lane from the sums of its squared scaled
+ * errors, with the controller of stepFactor(). Idle lanes never accept, and keep their
+ * step. Not inlined: inside rk45Batch() the lane loop loses its restrict pointers and
+ * stays scalar.
+ */
+static __attribute__((noinline)) void controlSteps(batch_t *restrict batch,
+		const step_control_t *control, const double *restrict sum, double *restrict accept,
+		double *restrict factor);
+
+/**
+ * Construct stages 2..n of one step on all lanes, the first stage must be in k[0]
+ */
+static void constructStages(batch_t *batch, const tableau_t *tableau, uint8_t restricted);
+
+/**
+ * Right hand side on every lane at time + offset*timeStep: the full equations, or the
+ * restricted ones when the Moon follows an ephemeris
+ */
+static void evaluateBatch(batch_t *batch, uint8_t restricted, double offset,
+		double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]);
+
+#ifdef INTEGRATOR_STATS
+/**
+ * Add count right hand side evaluations to every active lane
+ */
+static void countEvaluations(batch_t *batch, uint8_t count);
+#endif
+
+/**
+ * Flag the accepted lanes whose step crosses an event surface, or turns away from the
+ * Moon between two samples, by checking the event functions and the approach rate on
+ * the dense output of every lane at once (same samples as locateEvent())
+ */
+static void sampleEventsBatch(batch_t *batch, double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double *accept, double clearance, uint8_t *flagged);
+
+/**
+ * Locate the event and the closest Moon approach of one flagged lane, filling its result
+ * and event time
+ */
+static void locateEventLane(batch_t *batch, double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		uint8_t lane);
+
+
+void rk45Batch(batch_source_t source, batch_sink_t sink, void *context,
+		configuration_t config, batch_t *batch) {
+
+	const tableau_t *tableau = config.tableau;
+	const step_control_t *control = &config.control;
+	double clearance = getClearance();
+	uint8_t restricted = config.ephemeris;
+
+	/* Lanes the source never fills stay zeroed and idle */
+	memset(batch, 0, sizeof(batch_t));
+	uint8_t active = 0;
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+		refill(source, context, config, batch, lane);
+		active += batch->active[lane];
+	}
+
+	/* k1 = f(state) survives rejected steps, is known after accepted ones, and refill()
+	 * evaluates it for a new candidate */
+	while (active) {
+
+		constructStages(batch, tableau, restricted);
+		STATS(countEvaluations(batch, tableau->stages - 1));
+
+		/* Candidate solution and scaled error estimate of every lane */
+		double sum[BATCH_LANES] = { 0 };
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			double increment[BATCH_LANES] = { 0 }, error[BATCH_LANES] = { 0 };
+			for (uint8_t stage = 0; stage < tableau->stages; stage++) {
+				double b = tableau->b[stage], e = tableau->e[stage];
+				for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+					increment[lane] += b*batch->k[stage][i][lane];
+					error[lane]     += e*batch->k[stage][i][lane];
+				}
+			}
+			double absolute = control->absolute[i % BODY_STATE_SIZE];
+			double relative = control->relative[i % BODY_STATE_SIZE];
+			for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+				double h = batch->timeStep[lane];
+				batch->next[i][lane] = batch->state[i][lane] + h*increment[lane];
+				double a = fabs(batch->state[i][lane]), b = fabs(batch->next[i][lane]);
+				double scale = absolute + relative*(a > b ? a : b);
+				sum[lane] += (h*error[lane]/scale)*(h*error[lane]/scale);
+			}
+		}
+
+		/* Step acceptance and step update of every lane */
+		double accept[BATCH_LANES], factor[BATCH_LANES];
+		controlSteps(batch, control, sum, accept, factor);
+		STATS(for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+			if (batch->active[lane])
+				statsStep(&batch->stats[lane], batch->timeStep[lane], accept[lane] != 0));
+
+		/* Derivative at the candidate: the last FSAL stage, otherwise evaluated here */
+		double (*derivative)[BATCH_LANES] = batch->k[tableau->stages - 1];
+		if (!tableau->fsal) {
+			derivative = batch->k[1];
+			evaluateBatch(batch, restricted, 1, batch->next, derivative);
+			STATS(countEvaluations(batch, 1));
+		}
+
+		/* Lanes whose step crossed an event surface or passed the Moon, located exactly
+		 * below */
+		uint8_t flagged[BATCH_LANES];
+		sampleEventsBatch(batch, derivative, accept, clearance, flagged);
+
+		for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+			batch->result[lane] = 0;
+			if (flagged[lane])
+				locateEventLane(batch, derivative, lane);
+		}
+
+		/* Accepted lanes advance to the new solution, rejected lanes are unchanged */
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+				batch->state[i][lane] = accept[lane] != 0 ? batch->next[i][lane] : batch->state[i][lane];
+				batch->k[0][i][lane]  = accept[lane] != 0 ? derivative[i][lane] : batch->k[0][i][lane];
+			}
+		}
+		for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+			batch->time[lane] += accept[lane]*batch->timeStep[lane];
+			double step = batch->timeStep[lane]*factor[lane];
+			batch->timeStep[lane] = step < control->maxStep ? step : control->maxStep;
+
+			double dx = batch->state[0][lane] - batch->state[4][lane];
+			double dy = batch->state[1][lane] - batch->state[5][lane];
+			double d2 = dx*dx + dy*dy;
+			batch->closestEarth[lane] = d2 < batch->closestEarth[lane] ? d2 : batch->closestEarth[lane];
+		}
+
+		/* Hand finished lanes to the sink and refill them */
+		double limit = timeLimit(config);
+		active = 0;
+		for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+			if (!batch->active[lane]) continue;
+			if (accept[lane] != 0 && (batch->result[lane] != 0 || batch->time[lane] > limit)) {
+				double stopTime = batch->result[lane] != 0 ? batch->eventTime[lane] : batch->time[lane];
+				STATS(statsEnd(&batch->stats[lane], batch->result[lane]));
+				(sink)(context, batch->index[lane], batch->result[lane], stopTime,
+						sqrt(batch->closestEarth[lane]), batch->closestMoon[lane]);
+				refill(source, context, config, batch, lane);
+			}
+			active += batch->active[lane];
+		}
+	}
+}
+
+
+void refill(batch_source_t source, void *context, configuration_t config,
+		batch_t *batch, uint8_t lane) {
+
+	double initialConditions[THREE_BODY_STATE_SIZE];
+	if (!(source)(context, &batch->index[lane], initialConditions)) {
+		/* Idle lanes are carried along in the lane loops, but never accept a step */
+		batch->active[lane] = FALSE;
+		return;
+	}
+	for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++)
+		batch->state[i][lane] = initialConditions[i];
+
+	/* The integration will always start at time t = 0 */
+	batch->time[lane] = 0;
+	batch->result[lane] = 0;
+	batch->active[lane] = TRUE;
+	STATS(statsBegin(&batch->stats[lane]));
+
+	/* First stage of this lane only, the other lanes keep theirs */
+	uint8_t (*function)(double time, double *stateVector) =
+		config.ephemeris ? &equationsRestricted : &equations;
+	double derivative[THREE_BODY_STATE_SIZE];
+	memcpy(derivative, initialConditions, sizeof(derivative));
+	(function)(0, derivative);
+	for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++)
+		batch->k[0][i][lane] = derivative[i];
+	STATS(batch->stats[lane].evaluations++);
+
+	/* First step like rk45(): the configured one, or chosen from the initial state */
+	batch->timeStep[lane] = config.control.firstStep;
+	if (!(config.control.firstStep > 0)) {
+		batch->timeStep[lane] = initialStep(function, 0, initialConditions, derivative,
+				THREE_BODY_STATE_SIZE, &config.control);
+		STATS(batch->stats[lane].evaluations++);
+	}
+	batch->previousError[lane] = RK45_MIN_ERROR;
+	batch->previousStep[lane] = 0;
+	batch->rejected[lane] = 0;
+
+	double dx = initialConditions[0] - initialConditions[4];
+	double dy = initialConditions[1] - initialConditions[5];
+	batch->closestEarth[lane] = dx*dx + dy*dy;
+	batch->closestMoon[lane] = (approach_t){ INFINITY, 0 };
+	observeApproach(&batch->closestMoon[lane], initialConditions, 0);
+}
+
+
+void controlSteps(batch_t *restrict batch, const step_control_t *control,
+		const double *restrict sum, double *restrict accept, double *restrict factor) {
+
+	/* Lane masks as doubles, so the loop below only holds doubles and vectorizes */
+	double live[BATCH_LANES];
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+		live[lane] = batch->active[lane];
+
+	/* stepFactor() on every lane at once */
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+		double error = sqrt(sum[lane]/THREE_BODY_STATE_SIZE);
+		double h = batch->timeStep[lane];
+		double accepted = live[lane]*(error <= 1);
+		double next = controlFactor(control, error, h, batch->previousError[lane],
+				batch->previousStep[lane], batch->rejected[lane]);
+		factor[lane] = live[lane] != 0 ? next : 1.0;
+		accept[lane] = accepted;
+		double kept = error > RK45_MIN_ERROR ? error : RK45_MIN_ERROR;
+		batch->previousError[lane] = accepted != 0 ? kept : batch->previousError[lane];
+		batch->previousStep[lane] = accepted != 0 ? h : batch->previousStep[lane];
+		batch->rejected[lane] = live[lane] != 0 ? 1 - accepted : batch->rejected[lane];
+	}
+}
+
+
+void constructStages(batch_t *batch, const tableau_t *tableau, uint8_t restricted) {
+
+	for (uint8_t stage = 1; stage < tableau->stages; stage++) {
+
+		/* Stage argument: state plus the weighted sum of previous stages */
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			double sum[BATCH_LANES] = { 0 };
+			for (uint8_t j = 0; j < stage; j++) {
+				double a = tableau->a[stage][j];
+				for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+					sum[lane] += a*batch->k[j][i][lane];
+			}
+			for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+				batch->stage[i][lane] = batch->state[i][lane] + batch->timeStep[lane]*sum[lane];
+		}
+		evaluateBatch(batch, restricted, tableau->c[stage], batch->stage, batch->k[stage]);
+	}
+}
+
+
+void evaluateBatch(batch_t *batch, uint8_t restricted, double offset,
+		double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]) {
+
+	if (!restricted) {
+		equationsBatch(state, derivative);
+		return;
+	}
+	double time[BATCH_LANES];
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+		time[lane] = batch->time[lane] + offset*batch->timeStep[lane];
+	equationsBatchRestricted(time, state, derivative);
+}
+
+
+void equationsBatch(double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]) {
+
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+
+		/* Relative positions of the spacecraft and moon */
+		double dxMoonSat   = state[8][lane] - state[0][lane];
+		double dyMoonSat   = state[9][lane] - state[1][lane];
+		double dxEarthSat  = state[4][lane] - state[0][lane];
+		double dyEarthSat  = state[5][lane] - state[1][lane];
+		double dxEarthMoon = state[4][lane] - state[8][lane];
+		double dyEarthMoon = state[5][lane] - state[9][lane];
+
+		/* Inverse cube distances */
+		double d2MoonSat   = dxMoonSat*dxMoonSat + dyMoonSat*dyMoonSat;
+		double d2EarthSat  = dxEarthSat*dxEarthSat + dyEarthSat*dyEarthSat;
+		double d2EarthMoon = dxEarthMoon*dxEarthMoon + dyEarthMoon*dyEarthMoon;
+		double inv3MoonSat   = 1.0/(d2MoonSat*sqrt(d2MoonSat));
+		double inv3EarthSat  = 1.0/(d2EarthSat*sqrt(d2EarthSat));
+		double inv3EarthMoon = 1.0/(d2EarthMoon*sqrt(d2EarthMoon));
+
+		/* Spacecraft */
+		derivative[0][lane] = state[2][lane];
+		derivative[1][lane] = state[3][lane];
+		derivative[2][lane] = muMoon*dxMoonSat*inv3MoonSat + muEarth*dxEarthSat*inv3EarthSat;
+		derivative[3][lane] = muMoon*dyMoonSat*inv3MoonSat + muEarth*dyEarthSat*inv3EarthSat;
+
+		/* Earth */
+		derivative[4][lane] = 0;
+		derivative[5][lane] = 0;
+		derivative[6][lane] = 0;
+		derivative[7][lane] = 0;
+
+		/* Moon */
+		derivative[8][lane]  = state[10][lane];
+		derivative[9][lane]  = state[11][lane];
+		derivative[10][lane] = muEarth*dxEarthMoon*inv3EarthMoon - muSat*dxMoonSat*inv3MoonSat;
+		derivative[11][lane] = muEarth*dyEarthMoon*inv3EarthMoon - muSat*dyMoonSat*inv3MoonSat;
+	}
+}
+
+
+void equationsBatchRestricted(const double time[BATCH_LANES],
+		double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]) {
+
+	/* Table lookups first, they don't vectorize */
+	const ephemeris_t *ephemeris = getEphemeris();
+	double moon[EPHEMERIS_COLUMNS][BATCH_LANES];
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+		double sample[EPHEMERIS_COLUMNS];
+		moonState(ephemeris, time[lane], sample);
+		for (uint8_t c = 0; c < EPHEMERIS_COLUMNS; c++)
+			moon[c][lane] = sample[c];
+	}
+
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+
+		/* Relative positions of the spacecraft, Earth and tabulated Moon */
+		double dxMoonSat  = moon[0][lane] - state[0][lane];
+		double dyMoonSat  = moon[1][lane] - state[1][lane];
+		double dxEarthSat = state[4][lane] - state[0][lane];
+		double dyEarthSat = state[5][lane] - state[1][lane];
+
+		double d2MoonSat  = dxMoonSat*dxMoonSat + dyMoonSat*dyMoonSat;
+		double d2EarthSat = dxEarthSat*dxEarthSat + dyEarthSat*dyEarthSat;
+		double inv3MoonSat  = 1.0/(d2MoonSat*sqrt(d2MoonSat));
+		double inv3EarthSat = 1.0/(d2EarthSat*sqrt(d2EarthSat));
+
+		/* Spacecraft */
+		derivative[0][lane] = state[2][lane];
+		derivative[1][lane] = state[3][lane];
+		derivative[2][lane] = muMoon*dxMoonSat*inv3MoonSat + muEarth*dxEarthSat*inv3EarthSat;
+		derivative[3][lane] = muMoon*dyMoonSat*inv3MoonSat + muEarth*dyEarthSat*inv3EarthSat;
+
+		/* Earth */
+		derivative[4][lane] = 0;
+		derivative[5][lane] = 0;
+		derivative[6][lane] = 0;
+		derivative[7][lane] = 0;
+
+		/* Moon, from the table */
+		derivative[8][lane]  = moon[2][lane];
+		derivative[9][lane]  = moon[3][lane];
+		derivative[10][lane] = moon[4][lane];
+		derivative[11][lane] = moon[5][lane];
+	}
+}
+
+
+#ifdef INTEGRATOR_STATS
+void countEvaluations(batch_t *batch, uint8_t count) {
+
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+		if (batch->active[lane])
+			batch->stats[lane].evaluations += count;
+}
+#endif
+
+
+void sampleEventsBatch(batch_t *batch, double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double *accept, double clearance, uint8_t *flagged) {
+
+	/* Only positions enter the event functions, the approach rate takes the velocities
+	 * of the spacecraft and the Moon */
+	const uint8_t positions[6] = { 0, 1, 4, 5, 8, 9 };
+	const uint8_t velocities[4] = { 2, 3, 10, 11 };
+	const bodies_t *bodies = getBodies();
+	double moonLimit  = bodies->radius[BODY_MOON] + clearance;
+	double earthLimit = bodies->radius[BODY_EARTH];
+
+	/* Closest Moon sample of the step, kept only by lanes where no event is located */
+	double anyNegative[BATCH_LANES] = { 0 }, turned[BATCH_LANES] = { 0 };
+	double closestMoon[BATCH_LANES], closestTheta[BATCH_LANES] = { 0 };
+	double ratePrevious[BATCH_LANES];
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+		closestMoon[lane] = INFINITY;
+		ratePrevious[lane] = (batch->state[0][lane] - batch->state[8][lane])*
+			(batch->state[2][lane] - batch->state[10][lane]) +
+			(batch->state[1][lane] - batch->state[9][lane])*
+			(batch->state[3][lane] - batch->state[11][lane]);
+	}
+	for (uint8_t sample = 1; sample <= EVENT_SAMPLES; sample++) {
+
+		/* Hermite basis functions at this sample */
+		double theta = (double)sample/EVENT_SAMPLES;
+		double theta2 = theta*theta, theta3 = theta2*theta;
+		double h00 = 2*theta3 - 3*theta2 + 1;
+		double h10 = theta3 - 2*theta2 + theta;
+		double h01 = -2*theta3 + 3*theta2;
+		double h11 = theta3 - theta2;
+
+		double p[6][BATCH_LANES], v[4][BATCH_LANES];
+		for (uint8_t c = 0; c < 6; c++) {
+			uint8_t i = positions[c];
+			for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+				p[c][lane] = h00*batch->state[i][lane] + h01*batch->next[i][lane] +
+					batch->timeStep[lane]*(h10*batch->k[0][i][lane] + h11*derivative[i][lane]);
+		}
+		for (uint8_t c = 0; c < 4; c++) {
+			uint8_t i = velocities[c];
+			for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+				v[c][lane] = h00*batch->state[i][lane] + h01*batch->next[i][lane] +
+					batch->timeStep[lane]*(h10*batch->k[0][i][lane] + h11*derivative[i][lane]);
+		}
+
+		/* Squared distances, compared against squared limits */
+		for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+			double d2EarthMoon = pow(p[2][lane] - p[4][lane], 2) + pow(p[3][lane] - p[5][lane], 2);
+			double d2EarthSat  = pow(p[2][lane] - p[0][lane], 2) + pow(p[3][lane] - p[1][lane], 2);
+			double d2MoonSat   = pow(p[4][lane] - p[0][lane], 2) + pow(p[5][lane] - p[1][lane], 2);
+
+			double fired = (d2EarthMoon*4 < d2EarthSat) + (d2EarthSat < earthLimit*earthLimit) +
+				(d2MoonSat < moonLimit*moonLimit);
+			anyNegative[lane] += fired;
+			closestTheta[lane] = d2MoonSat < closestMoon[lane] ? theta : closestTheta[lane];
+			closestMoon[lane] = d2MoonSat < closestMoon[lane] ? d2MoonSat : closestMoon[lane];
+
+			/* A minimum of the Moon distance between the samples (see locateEvent()) */
+			double rate = (p[0][lane] - p[4][lane])*(v[0][lane] - v[2][lane]) +
+				(p[1][lane] - p[5][lane])*(v[1][lane] - v[3][lane]);
+			turned[lane] += (ratePrevious[lane] < 0) & (rate >= 0);
+			ratePrevious[lane] = rate;
+		}
+	}
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++) {
+		flagged[lane] = batch->active[lane] && accept[lane] != 0 &&
+			(anyNegative[lane] != 0 || turned[lane] != 0);
+		if (accept[lane] != 0 && !flagged[lane] && closestMoon[lane] < batch->closestMoon[lane].distanceSquared) {
+			batch->closestMoon[lane].distanceSquared = closestMoon[lane];
+			batch->closestMoon[lane].time = batch->time[lane] + closestTheta[lane]*batch->timeStep[lane];
+		}
+	}
+}
+
+
+void locateEventLane(batch_t *batch, double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		uint8_t lane) {
+
+	/* Gather the lane into plain state arrays */
+	double y0[THREE_BODY_STATE_SIZE], f0[THREE_BODY_STATE_SIZE];
+	double y1[THREE_BODY_STATE_SIZE], f1[THREE_BODY_STATE_SIZE];
+	for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+		y0[i] = batch->state[i][lane];
+		f0[i] = batch->k[0][i][lane];
+		y1[i] = batch->next[i][lane];
+		f1[i] = derivative[i][lane];
+	}
+	double eventState[THREE_BODY_STATE_SIZE];
+	batch->result[lane] = locateEvent(y0, f0, y1, f1, batch->time[lane], batch->timeStep[lane],
+			THREE_BODY_STATE_SIZE, &batch->eventTime[lane], eventState,
+			&batch->closestMoon[lane]);
+}
@@ -0,0 +1,92 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "rk45_constants.h"
+#include "tableau.h"
+#include "equations.h"
+#include "events.h"
+#include "integrator.h"
+#include "configuration.h"
+
+/* Trajectories integrated in lockstep, one per SIMD lane (8 doubles = one AVX-512 register) */
+#define BATCH_LANES 		(8)
+
+/**
+ * Structure-of-arrays state for BATCH_LANES three body trajectories. Every lane has its
+ * own time, step size and termination code; element [i][lane] is state component i.
+ */
+typedef struct {
+
+	/* Current state, stage derivatives, stage argument and candidate solution */
+	double state[THREE_BODY_STATE_SIZE][BATCH_LANES];
+	double k[TABLEAU_MAX_STAGES][THREE_BODY_STATE_SIZE][BATCH_LANES];
+	double stage[THREE_BODY_STATE_SIZE][BATCH_LANES];
+	double next[THREE_BODY_STATE_SIZE][BATCH_LANES];
+
+	/* Per lane integration progress */
+	double time[BATCH_LANES];
+	double timeStep[BATCH_LANES];
+	double eventTime[BATCH_LANES];
+	uint8_t result[BATCH_LANES];
+
+	/* Per lane state of the step controller, the fields of step_state_t */
+	double previousError[BATCH_LANES];
+	double previousStep[BATCH_LANES];
+	double rejected[BATCH_LANES];
+
+	/* Smallest squared spacecraft to Earth distance seen so far */
+	double closestEarth[BATCH_LANES];
+
+	/* Closest approach to the Moon among the event samples so far */
+	approach_t closestMoon[BATCH_LANES];
+
+#ifdef INTEGRATOR_STATS
+	/* Counters of the trajectory in each lane, final when it reaches the sink */
+	integrator_stats_t stats[BATCH_LANES];
+#endif
+
+	/* Candidate currently held by each lane, and whether the lane holds one */
+	uint32_t index[BATCH_LANES];
+	uint8_t active[BATCH_LANES];
+
+} batch_t;
+
+/**
+ * Supplies the next candidate for an idle lane: its index and the initial conditions
+ * (THREE_BODY_STATE_SIZE values). Returns FALSE when there is no work left.
+ */
+typedef uint8_t (*batch_source_t)(void *context, uint32_t *index, double *initialConditions);
+
+/**
+ * Receives the termination code, stop time, closest approach to the Earth's centre and
+ * closest approach to the Moon of a finished lane
+ */
+typedef void (*batch_sink_t)(void *context, uint32_t index, uint8_t result, double stopTime,
+		double closestEarth, approach_t closestMoon);
+
+/**
+ * Embedded Runge Kutta integration (config.tableau) of many three body trajectories at
+ * once. Lanes are filled from source, and refilled as soon as their trajectory
+ * terminates, until source runs dry. Uses the same step size control and event
+ * location as rk45().
+ */
+void rk45Batch(batch_source_t source, batch_sink_t sink, void *context,
+		configuration_t config, batch_t *batch);
+
+/* Three body equations of motion evaluated on every lane of a batch */
+void equationsBatch(double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]);
+
+/**
+ * Restricted three body equations on every lane of a batch, with the Moon taken from
+ * the ephemeris set with setEphemeris() at each lane's time
+ */
+void equationsBatchRestricted(const double time[BATCH_LANES],
+		double state[THREE_BODY_STATE_SIZE][BATCH_LANES],
+		double derivative[THREE_BODY_STATE_SIZE][BATCH_LANES]);
+
+#endif /* _BATCH_H_ */
@@ -0,0 +1,372 @@
+/* Benchmarks of the equations, the integrators and the sweeps, compared to a baseline */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "integrator.h"
+#include "equations.h"
+#include "util.h"
+#include "optimizer.h"
+#include "swarm.h"
+
+#define BENCH_ARGS 			(3)
+#define RECORD_OPTION 		"--record"
+
+/* Iterations of the micro benchmarks, and repeats of every benchmark (best is kept) */
+#define MICRO_ITERATIONS 	(1000000)
+#define STEP_ITERATIONS 	(100000)
+
+/* Fixed first step of the rk45 step benchmark (s), short enough to be accepted */
+#define STEP_FIRST 			(10.0)
+#define BENCH_REPEATS 		(3)
+
+/* Fixed impulse of the meso benchmark (an Earth return), and its repeats */
+#define MESO_DVX 			(-85.0)
+#define MESO_DVY 			(50.0)
+#define MESO_ITERATIONS 	(2000)
+
+/* Particles of the swarm benchmark, dispersed around the meso impulse */
+#define SWARM_PARTICLES 	(4096)
+
+/* Grid accuracy of the reduced sweeps */
+#define MACRO_ACCURACY_1 	(25.0)
+#define MACRO_ACCURACY_2 	(2.0)
+
+/* A result slower than the baseline by more than this fraction is a regression */
+#define BENCH_TOLERANCE 	(0.25)
+
+#define MAX_RESULTS 		(16)
+#define MAX_NAME_SIZE 		(40)
+
+/* One measured metric; units ending in "/s" are rates (higher is better) */
+typedef struct {
+	char name[MAX_NAME_SIZE];
+	double value;
+	const char *unit;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static uint8_t resultCount = 0;
+
+/* Right hand side evaluations, counted by countedEquations() */
+static uint64_t evaluations = 0;
+
+/**
+ * Seconds elapsed since start
+ */
+static double elapsed(struct timespec start);
+
+/**
+ * Record a result
+ */
+static void addResult(const char *name, double value, const char *unit);
+
+/**
+ * equations(), counting every evaluation
+ */
+static uint8_t countedEquations(double time, double *stateVector);
+
+/**
+ * Micro: single calls of equations(), nbodyEquations() on the three body table,
+ * checkCollision() and rk45 steps
+ */
+static void benchMicro(configuration_t configuration);
+
+/**
+ * Meso: one full trajectory with a fixed impulse
+ */
+static void benchMeso(configuration_t configuration);
+
+/**
+ * Meso: a swarm of massless particles around the same impulse, per particle
+ */
+static void benchSwarm(configuration_t configuration);
+
+/**
+ * Macro: reduced grid sweep of each objective
+ */
+static void benchMacro(configuration_t configuration);
+
+/**
+ * Compare the results to a baseline file, returns the number of regressions
+ */
+static uint8_t compareBaseline(const char *fileName);
+
+/**
+ * Write the results as "name value unit" lines, FALSE on failure
+ */
+static uint8_t writeResults(const char *fileName);
+
+
+int main(int argc, char *argv[]) {
+
+	/* exe_bench <baseline> <output>, or exe_bench --record <baseline> */
+	if (argc != BENCH_ARGS) {
+		printf("Usage: %s <baseline> <output> | %s %s <baseline>\n", argv[0], argv[0],
+				RECORD_OPTION);
+		return EXIT_FAILURE;
+	}
+	uint8_t record = (strcmp(argv[1], RECORD_OPTION) == 0);
+
+	/* Same defaults as the main program, objective 2 without clearance */
+	char *arguments[] = { argv[0], "2", "0", "1" };
+	configuration_t configuration;
+	parseArguments(EXPECTED_ARGS, arguments, &configuration);
+	setClearance(configuration.clearance);
+
+	benchMicro(configuration);
+	benchMeso(configuration);
+	benchSwarm(configuration);
+	benchMacro(configuration);
+
+	printf("\n%-24s %14s  %-10s\n", "benchmark", "value", "unit");
+	for (uint8_t index = 0; index < resultCount; index++)
+		printf("%-24s %14.3f  %-10s\n", results[index].name, results[index].value,
+				results[index].unit);
+
+	if (record) {
+		if (!writeResults(argv[2])) return EXIT_FAILURE;
+		printf("\nBaseline recorded in %s\n", argv[2]);
+		return EXIT_SUCCESS;
+	}
+	if (!writeResults(argv[2])) return EXIT_FAILURE;
+	return compareBaseline(argv[1]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+double elapsed(struct timespec start) {
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + 1E-9*(end.tv_nsec - start.tv_nsec);
+}
+
+
+void addResult(const char *name, double value, const char *unit) {
+
+	if (resultCount == MAX_RESULTS) return;
+	snprintf(results[resultCount].name, MAX_NAME_SIZE, "%s", name);
+	results[resultCount].value = value;
+	results[resultCount].unit = unit;
+	resultCount++;
+}
+
+
+uint8_t countedEquations(double time, double *stateVector) {
+	evaluations++;
+	return equations(time, stateVector);
+}
+
+
+void benchMicro(configuration_t configuration) {
+
+	double nominal[THREE_BODY_STATE_SIZE], buffer[THREE_BODY_STATE_SIZE];
+	fillInitialConditions(nominal, THREE_BODY_STATE_SIZE);
+	state_t state;
+	memcpy(&state, nominal, sizeof(state_t));
+
+	/* Sinks so the calls are not optimized away */
+	volatile double sink = 0;
+	volatile uint8_t codes = 0;
+
+	double bestEquations = INFINITY, bestBodies = INFINITY, bestCollision = INFINITY;
+	double bestStep = INFINITY;
+	uint64_t bestSteps = 1;
+	for (uint8_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t iteration = 0; iteration < MICRO_ITERATIONS; iteration++) {
+			memcpy(buffer, nominal, sizeof(buffer));
+			codes += equations(0, buffer);
+			sink += buffer[2];
+		}
+		bestEquations = fmin(bestEquations, elapsed(start));
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t iteration = 0; iteration < MICRO_ITERATIONS; iteration++) {
+			memcpy(buffer, nominal, sizeof(buffer));
+			codes += nbodyEquations(0, buffer);
+			sink += buffer[2];
+		}
+		bestBodies = fmin(bestBodies, elapsed(start));
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t iteration = 0; iteration < MICRO_ITERATIONS; iteration++) {
+			state.xs += 1E-9;
+			codes += checkCollision(state);
+		}
+		bestCollision = fmin(bestCollision, elapsed(start));
+
+		/* With a fixed first step, rk45() skips initialStep(). An end time of zero then
+		 * makes it stop after its first accepted step, so each call is one accepted
+		 * step and any rejected attempts before it */
+		configuration_t single = configuration;
+		single.endTime = 0;
+		single.control.firstStep = STEP_FIRST;
+		workspace_t *workspace = createWorkspace(configuration.stateSize);
+		double stopTime;
+		uint64_t steps = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t iteration = 0; iteration < STEP_ITERATIONS; iteration++) {
+			codes += rk45(&equations, nominal, single, workspace, &stopTime);
+			steps += (stopTime > 0);
+		}
+		double seconds = elapsed(start);
+		if (steps > 0 && seconds/steps < bestStep/bestSteps) {
+			bestStep = seconds;
+			bestSteps = steps;
+		}
+		destroyWorkspace(workspace);
+	}
+	addResult("micro.equations", 1E9*bestEquations/MICRO_ITERATIONS, "ns/eval");
+	addResult("micro.nbody_equations", 1E9*bestBodies/MICRO_ITERATIONS, "ns/eval");
+	addResult("micro.checkCollision", 1E9*bestCollision/MICRO_ITERATIONS, "ns/eval");
+	addResult("micro.rk45_step", 1E9*bestStep/bestSteps, "ns/step");
+}
+
+
+void benchMeso(configuration_t configuration) {
+
+	double initialConditions[THREE_BODY_STATE_SIZE];
+	fillInitialConditions(initialConditions, THREE_BODY_STATE_SIZE);
+	initialConditions[2] += MESO_DVX;
+	initialConditions[3] += MESO_DVY;
+
+	/* Every attempted step evaluates each stage, plus the new state unless FSAL */
+	const tableau_t *tableau = configuration.tableau;
+	double evaluationsPerStep = tableau->stages + (tableau->fsal ? 0 : 1);
+
+	workspace_t *workspace = createWorkspace(configuration.stateSize);
+	double best = INFINITY;
+	uint64_t counted = 0;
+	for (uint8_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+		struct timespec start;
+		double stopTime;
+		evaluations = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (uint32_t iteration = 0; iteration < MESO_ITERATIONS; iteration++)
+			rk45(&countedEquations, initialConditions, configuration, workspace, &stopTime);
+		double seconds = elapsed(start);
+		if (seconds < best) {
+			best = seconds;
+			counted = evaluations;
+		}
+	}
+	destroyWorkspace(workspace);
+
+	addResult("meso.trajectory", MESO_ITERATIONS/best, "traj/s");
+	addResult("meso.steps", counted/evaluationsPerStep/best, "steps/s");
+	addResult("meso.evaluations", counted/best, "evals/s");
+}
+
+
+void benchSwarm(configuration_t configuration) {
+
+	double nominal[THREE_BODY_STATE_SIZE];
+	fillInitialConditions(nominal, THREE_BODY_STATE_SIZE);
+	ephemeris_t *ephemeris = createEphemeris(nominal, configuration.endTime);
+
+	double best = INFINITY;
+	for (uint8_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+		swarm_t *swarm = createSwarm(SWARM_PARTICLES, nominal);
+		uint64_t rng = SWARM_SEED;
+		for (uint32_t p = 0; p < SWARM_PARTICLES; p++) {
+			swarm->state[2][p] += MESO_DVX + SWARM_DISPERSION*gaussian(&rng);
+			swarm->state[3][p] += MESO_DVY + SWARM_DISPERSION*gaussian(&rng);
+		}
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		propagateSwarm(swarm, ephemeris, configuration);
+		best = fmin(best, elapsed(start));
+		destroySwarm(swarm);
+	}
+	destroyEphemeris(ephemeris);
+
+	addResult("meso.swarm_particles", SWARM_PARTICLES/best, "traj/s");
+}
+
+
+void benchMacro(configuration_t configuration) {
+
+	double dvx, dvy;
+	struct timespec start;
+	candidate_t *grid;
+
+	/* Objective 1, euler over the inclusive grid */
+	configuration_t first = configuration;
+	first.objective = OBJECTIVE_1;
+	first.accuracy = MACRO_ACCURACY_1;
+	uint32_t count = buildGrid(GRID_LIMIT, first.accuracy, TRUE, &grid);
+	free(grid);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	optimizeDeltaV(first, &dvx, &dvy);
+	addResult("macro.sweep_objective_1", count/elapsed(start), "traj/s");
+
+	/* Objective 2, rk45 over the exclusive grid */
+	configuration_t second = configuration;
+	second.objective = OBJECTIVE_2;
+	second.accuracy = MACRO_ACCURACY_2;
+	count = buildGrid(GRID_LIMIT, second.accuracy, FALSE, &grid);
+	free(grid);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	optimizeReturnTime(second, &dvx, &dvy);
+	addResult("macro.sweep_objective_2", count/elapsed(start), "traj/s");
+
+	/* The same, screened in single precision first */
+	second.screen = SCREEN_ON;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	optimizeReturnTime(second, &dvx, &dvy);
+	addResult("macro.screened_objective_2", count/elapsed(start), "traj/s");
+}
+
+
+uint8_t compareBaseline(const char *fileName) {
+
+	FILE *file = fopen(fileName, "r");
+	if (file == NULL) {
+		printf("\nNo baseline in %s (record one with make bench-baseline)\n", fileName);
+		return 0;
+	}
+
+	printf("\n%-24s %14s %14s %8s\n", "benchmark", "baseline", "current", "change");
+	uint8_t regressions = 0;
+	char name[MAX_NAME_SIZE], unit[MAX_NAME_SIZE];
+	double baseline;
+	while (fscanf(file, "%39s %lf %39s", name, &baseline, unit) == 3) {
+		for (uint8_t index = 0; index < resultCount; index++) {
+			if (strcmp(results[index].name, name) != 0) continue;
+
+			/* Positive change is always an improvement */
+			size_t length = strlen(unit);
+			uint8_t rate = (length > 2 && strcmp(unit + length - 2, "/s") == 0);
+			double change = rate ? results[index].value/baseline - 1 :
+				baseline/results[index].value - 1;
+			uint8_t regressed = (change < -BENCH_TOLERANCE);
+			regressions += regressed;
+			printf("%-24s %14.3f %14.3f %+7.1f%%%s\n", name, baseline, results[index].value,
+					100*change, regressed ? "  REGRESSION" : "");
+		}
+	}
+	fclose(file);
+
+	if (regressions > 0)
+		printf("\n%d benchmark(s) regressed by more than %.0f%%\n", regressions,
+				100*BENCH_TOLERANCE);
+	return regressions;
+}
+
+
+uint8_t writeResults(const char *fileName) {
+
+	FILE *file = fopen(fileName, "w");
+	if (file == NULL) {
+		printf("Could not write %s\n", fileName);
+		return FALSE;
+	}
+	for (uint8_t index = 0; index < resultCount; index++)
+		fprintf(file, "%s %.6g %s\n", results[index].name, results[index].value,
+				results[index].unit);
+	fclose(file);
+	return TRUE;
+}
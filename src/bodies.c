@@ -0,0 +1,43 @@
+#include "equations.h"
+
+const bodies_t THREE_BODY_BODIES = {
+	.name = "threebody",
+	.count = 3,
+	.mu = { (double)G*MASS_SAT, (double)G*MASS_EARTH, (double)G*MASS_MOON },
+	.radius = { 0, RADIUS_EARTH, RADIUS_MOON },
+	.indirect = FALSE
+};
+
+const bodies_t SUN_BODIES = {
+	.name = "sun",
+	.count = 4,
+	.mu = { (double)G*MASS_SAT, (double)G*MASS_EARTH, (double)G*MASS_MOON, (double)G*MASS_SUN },
+	.radius = { 0, RADIUS_EARTH, RADIUS_MOON, RADIUS_SUN },
+	.distance = { 0, 0, 0, DIST_EARTH_SUN },
+	.angle = { 0, 0, 0, THETA_SUN0_RAD },
+	.indirect = TRUE
+};
+
+
+const bodies_t *findBodies(const char *name) {
+
+	const bodies_t *tables[] = { &THREE_BODY_BODIES, &SUN_BODIES };
+	for (uint8_t index = 0; index < sizeof(tables)/sizeof(tables[0]); index++)
+		if (strcmp(tables[index]->name, name) == 0)
+			return tables[index];
+	return NULL;
+}
+
+
+void placePerturber(const bodies_t *bodies, uint8_t body, double *state) {
+
+	/* Circular about the Earth: the indirect term makes the pair's parameter the sum */
+	double distance = bodies->distance[body], angle = bodies->angle[body];
+	double mu = bodies->mu[BODY_EARTH] + (bodies->indirect ? bodies->mu[body] : 0);
+	double velocity = sqrt(mu/distance);
+
+	state[0] = distance*cos(angle);
+	state[1] = distance*sin(angle);
+	state[2] = -velocity*sin(angle);
+	state[3] = velocity*cos(angle);
+}
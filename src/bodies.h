@@ -0,0 +1,73 @@
+#ifndef _BODIES_H_
+#define _BODIES_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "definitions.h"
+
+/* Most bodies in a table, and state entries per body (x, y, vx, vy) */
+#define MAX_BODIES 			(8)
+#define BODY_STATE_SIZE 	(4)
+#define MAX_STATE_SIZE 		(MAX_BODIES*BODY_STATE_SIZE)
+
+/**
+ * Bodies with a fixed place in every table, so the state array of a table starts with
+ * the three body state. The Earth is held at the origin; bodies past the Moon are
+ * perturbers.
+ */
+#define BODY_SPACECRAFT 	(0)
+#define BODY_EARTH 			(1)
+#define BODY_MOON 			(2)
+#define BODY_FIRST_PERTURBER 	(3)
+
+/**
+ * Bodies of a general N-body problem, as a structure of arrays. The state array holds
+ * x, y, vx, vy of each body in table order; nbodyEquations() gathers the positions
+ * into arrays of the same layout.
+ *
+ * A collision of the spacecraft with a perturber ends the trajectory like an escape.
+ * Perturbers have no event function, so rk45() stops at the end of the step where
+ * nbodyEquations() reports it. Perturbers start on circular orbits about the Earth, at
+ * the given distance and angle.
+ *
+ * The three body problem itself stays the hand-written equations(), which every sweep
+ * uses unless --bodies is given. THREE_BODY_BODIES runs it through nbodyEquations()
+ * instead: bit for bit the same trajectories, up to about 6% slower per evaluation in
+ * micro.nbody_equations (gathering the table into arrays), and no slower over a sweep.
+ */
+typedef struct {
+	const char *name;
+	uint8_t count;
+
+	/* Gravitational parameter G*m (m^3/s^2) and collision radius (m) */
+	double mu[MAX_BODIES];
+	double radius[MAX_BODIES];
+
+	/* Initial orbit of perturbers about the Earth: radius (m) and angle (rad) */
+	double distance[MAX_BODIES];
+	double angle[MAX_BODIES];
+
+	/**
+	 * Earth-centred frame: subtract the Earth's acceleration from every body. Without
+	 * it the Earth is simply pinned, like in equations(); a perturber as heavy as the
+	 * Sun needs the indirect term, or its direct pull alone would carry the spacecraft
+	 * away from the Earth.
+	 */
+	uint8_t indirect;
+} bodies_t;
+
+/* Spacecraft, Earth and Moon: the hand-written three body problem of equations() */
+extern const bodies_t THREE_BODY_BODIES;
+
+/* Three bodies and the Sun, in the Earth-centred frame */
+extern const bodies_t SUN_BODIES;
+
+/* Look up a body table by name ("threebody", "sun"), NULL if unknown */
+const bodies_t *findBodies(const char *name);
+
+/* Initial position and velocity of a perturber, written to state[0..3] */
+void placePerturber(const bodies_t *bodies, uint8_t body, double *state);
+
+#endif /* _BODIES_H_ */
@@ -2,14 +2,77 @@
 #define _CONFIGURATION_H_
 
 #include <stdint.h>
+#include <stdatomic.h>
+
+#include "tableau.h"
+#include "bodies.h"
 
 #define MAX_FILE_NAME_SIZE      (40)
 #define START_TIME              (0)
 #define END_TIME                (1E8)
 #define TIME_STEP               (5)
-#define RK45_TOL                (2E3)
 #define RK45_MIN_STEP           (1)
 
+/* Default error and step size control of rk45 (see step_control_t). With the events
+ * located on the dense output, looser tolerances still give the same outcomes, but
+ * move the return times by tens of seconds */
+#define RK45_ATOL_POSITION      (3E1)
+#define RK45_ATOL_VELOCITY      (1E-2)
+#define RK45_RTOL               (1E-9)
+#define RK45_SAFETY             (0.9)
+#define RK45_PI_ALPHA           (0.17)
+#define RK45_PI_BETA            (0.04)
+#define RK45_SHRINK             (0.2)
+#define RK45_GROWTH             (10.0)
+#define RK45_MAX_STEP           (1E5)
+#define RK45_CONTROL_DEFAULTS   { \
+    .absolute = { RK45_ATOL_POSITION, RK45_ATOL_POSITION, RK45_ATOL_VELOCITY, RK45_ATOL_VELOCITY }, \
+    .relative = { RK45_RTOL, RK45_RTOL, RK45_RTOL, RK45_RTOL }, \
+    .safety = RK45_SAFETY, .alpha = RK45_PI_ALPHA, .beta = RK45_PI_BETA, \
+    .shrink = RK45_SHRINK, .growth = RK45_GROWTH, \
+    .maxStep = RK45_MAX_STEP, .firstStep = 0 }
+
+/* Impulse search strategies */
+#define SEARCH_GRID             (0)
+#define SEARCH_ADAPTIVE         (1)
+#define SEARCH_CMAES            (2)
+#define SEARCH_RING             (3)
+#define SEARCH_SHOOTING         (4)
+
+/* Fixed step integrators of objective 1 */
+#define INTEGRATOR_EULER        (0)
+#define INTEGRATOR_LEAPFROG     (1)
+#define INTEGRATOR_FOREST_RUTH  (2)
+
+/* Screening of the grid search (see screen.h) */
+#define SCREEN_OFF              (0)
+#define SCREEN_ON               (1)
+#define SCREEN_VERIFY           (2)
+
+/**
+ * Error and step size control of rk45. The local error of a state component is scaled
+ * by absolute + relative*|value| (the larger value of the step), with the tolerances of
+ * its place in a body (x, y, vx, vy): every body, and the entries past the bodies, cycle
+ * through them. A step is accepted when the RMS of the scaled errors is at most 1.
+ */
+typedef struct {
+	double absolute[BODY_STATE_SIZE];
+	double relative[BODY_STATE_SIZE];
+
+    /* Proportional integral controller: the step is multiplied by
+     * safety*error^-alpha*previousError^beta, at most the predictive controller's
+     * factor (see stepFactor()), and kept within [shrink, growth] */
+	double safety;
+	double alpha;
+	double beta;
+	double shrink;
+	double growth;
+
+    /* Longest step, and the first one, 0 to choose it from the initial state (s) */
+	double maxStep;
+	double firstStep;
+} step_control_t;
+
 /**
  * Parameters for integration
  */
@@ -19,6 +82,22 @@ typedef struct {
 	double startTime;  
 	double endTime;    
 	double timeStep;   
+
+    /* Optional bound shared between threads, integration also stops past it */
+	_Atomic double *timeBound;
+
+    /* Fixed step integrator of objective 1 (INTEGRATOR_EULER, INTEGRATOR_LEAPFROG
+     * or INTEGRATOR_FOREST_RUTH), which steps by timeStep */
+	uint8_t integrator;
+
+    /* Embedded pair used by rk45, and its error and step size control */
+	const tableau_t *tableau;
+	step_control_t control;
+
+    /* Radii about the Earth and the Moon (m) inside which rk45 regularizes close
+     * approaches (see regularization.h), 0 to never regularize */
+	double regularizeEarth;
+	double regularizeMoon;
     
     /* Arguments */
 	uint8_t stateSize;
@@ -28,6 +107,33 @@ typedef struct {
 	double clearance;
 	double accuracy;
 
+    /* Parallelism */
+	uint16_t threads;
+	uint8_t batched;
+
+    /* Restricted problem: the Moon follows a precomputed ephemeris (see ephemeris.h) */
+	uint8_t ephemeris;
+
+    /* General N-body equations of these bodies (see bodies.h), NULL for the
+     * hand-written three body equations */
+	const bodies_t *bodies;
+
+    /* Particles of the dispersion swarm propagated around the optimum, 0 for none */
+	uint32_t swarm;
+
+    /* Impulse search strategy (SEARCH_GRID, SEARCH_ADAPTIVE, SEARCH_CMAES,
+     * SEARCH_RING or SEARCH_SHOOTING) */
+	uint8_t search;
+
+    /* Two tier grid search, first in single then in double precision (SCREEN_OFF,
+     * SCREEN_ON or SCREEN_VERIFY) */
+	uint8_t screen;
+
+    /* The grid search only covers shard of shards contiguous slices of the grid in
+     * raster order (see sweep_driver.c); shards = 1 for the whole grid */
+	uint32_t shard;
+	uint32_t shards;
+
     /* File output */
     uint8_t loggingEnabled;
 	char fileName[MAX_FILE_NAME_SIZE];
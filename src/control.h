@@ -0,0 +1,104 @@
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "configuration.h"
+
+/* Order of the local error estimate of the built-in pairs, plus one: error ~ h^5 */
+#define RK45_ERROR_ORDER 	(5)
+
+/* Smallest previous error kept by the step controller, so a step that happened to be
+ * nearly exact does not hold back the growth of the next ones */
+#define RK45_MIN_ERROR 		(1E-2)
+
+/* Added to the error before its logarithm is taken, so an exact step grows by growth */
+#define RK45_TINY_ERROR 	(1E-300)
+
+/* State of the step controller across the steps of one integration */
+typedef struct {
+	double previousError;	/* Scaled error of the last accepted step */
+	double previousStep;	/* Last accepted step, 0 before the first */
+	uint8_t rejected;		/* TRUE if the last step was rejected */
+} step_state_t;
+
+#define STEP_STATE_INIT { RK45_MIN_ERROR, 0, FALSE }
+
+/**
+ * Natural logarithm of a positive normal number, to about 1E-14. Plain arithmetic on
+ * the bits of x and comparisons instead of libm calls (log(), floor(), fmin() and fmax()
+ * keep a lane loop from vectorizing without -ffast-math).
+ */
+static inline __attribute__((always_inline)) double controlLog(double x) {
+
+	/* x = 2^exponent*m with m in [sqrt(1/2), sqrt(2)) */
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	double exponent = (double)((int64_t)(bits >> 52) - 1023);
+	bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+	double m;
+	memcpy(&m, &bits, sizeof(m));
+	exponent = (m > M_SQRT2) ? exponent + 1 : exponent;
+	m = (m > M_SQRT2) ? 0.5*m : m;
+
+	/* log m = 2 atanh(s) with s = (m - 1)/(m + 1), |s| < 0.172 */
+	double s = (m - 1)/(m + 1), s2 = s*s;
+	double series = 1 + s2*(1.0/3 + s2*(1.0/5 + s2*(1.0/7 + s2*(1.0/9 + s2*(1.0/11 +
+			s2*(1.0/13 + s2*(1.0/15)))))));
+	return exponent*M_LN2 + 2*s*series;
+}
+
+/* Exponential of x in [-700, 700] (clamped), to about 1E-13, vectorizable like controlLog() */
+static inline __attribute__((always_inline)) double controlExp(double x) {
+
+	/* x = k ln2 + r with |r| <= ln2/2, k rounded by adding 1.5*2^52: its low bits are
+	 * then those of k */
+	x = (x < -700) ? -700 : x;
+	x = (x > 700) ? 700 : x;
+	double shifted = x/M_LN2 + 0x1.8p52;
+	double k = shifted - 0x1.8p52;
+	double r = x - k*M_LN2;
+	double series = 1 + r*(1 + r*(1.0/2 + r*(1.0/6 + r*(1.0/24 + r*(1.0/120 + r*(1.0/720 +
+			r*(1.0/5040 + r*(1.0/40320 + r*(1.0/362880 + r*(1.0/3628800 +
+			r*(1.0/39916800 + r*(1.0/479001600))))))))))));
+
+	/* 2^k from its exponent bits */
+	uint64_t bits;
+	memcpy(&bits, &shifted, sizeof(bits));
+	bits = (bits + 1023) << 52;
+	double scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return series*scale;
+}
+
+/**
+ * Factor of the next step after a step h with the scaled error error (see stepFactor()),
+ * from the controller's state before that step. Branch free, so the batched integrators
+ * evaluate it for every lane at once.
+ */
+static inline __attribute__((always_inline)) double controlFactor(const step_control_t *control,
+		double error, double h, double previousError, double previousStep, double rejected) {
+
+	/* Proportional integral controller, safety*error^-alpha*previousError^beta */
+	double logError = controlLog(error + RK45_TINY_ERROR);
+	double logPrevious = controlLog(previousError);
+	double exponent = control->beta*logPrevious - control->alpha*logError;
+
+	/* Gustafsson's predictive controller on accepted steps: the error grew by
+	 * previousError/error over the last step ratio, expect it to keep growing so */
+	double ratio = h/((previousStep > 0) ? previousStep : h);
+	double predictive = controlLog(ratio) + (logPrevious - 2*logError)/RK45_ERROR_ORDER;
+	exponent = ((error <= 1) & (previousStep > 0) & (predictive < exponent)) ?
+		predictive : exponent;
+
+	double factor = control->safety*controlExp(exponent);
+	factor = (factor > control->growth) ? control->growth : factor;
+	factor = (factor < control->shrink) ? control->shrink : factor;
+
+	/* No growth on a rejected step, nor right after one: it was already too long */
+	return (((error > 1) | (rejected != 0)) & (factor > 1)) ? 1 : factor;
+}
+
+#endif /* _CONTROL_H_ */
@@ -6,9 +6,11 @@
 #define MASS_MOON 			(7.34767309E22f)
 #define MASS_EARTH  		(5.97219E24f)
 #define MASS_SAT 			(28833.0f)	
+#define MASS_SUN 			(1.98847E30f)
 
 #define RADIUS_EARTH 		(6371000.0f)
 #define RADIUS_MOON 		(1737100.0f)
+#define RADIUS_SUN 			(6.957E8f)
 
 #define RAD_TO_DEG 			(57.2957795f)
 #define DEG_TO_RAD 			(0.0174532925f)
@@ -19,13 +21,20 @@
 #define THETA_M0_DEG 		(42.5f)
 #define THETA_M0_RAD 		(THETA_M0_DEG*DEG_TO_RAD)
 
+#define THETA_SUN0_DEG 		(180.0f)
+#define THETA_SUN0_RAD 		(THETA_SUN0_DEG*DEG_TO_RAD)
+
 #define DIST_EARTH_SAT 		(340.0E6f)
 #define DIST_EARTH_MOON 	(384403.0E3f)
+#define DIST_EARTH_SUN 		(1.495978707E11f)
 
 #define VEL_SAT 			(1000.0f)
 
 #define OBJECTIVE_1         (1)
 #define OBJECTIVE_2         (2)
 
+/* Both objectives at once: the trade-off between delta V and return time */
+#define OBJECTIVE_PARETO    (3)
+
 
 #endif /* _DEFINITIONS_H_ */
@@ -0,0 +1,222 @@
+#include "ephemeris.h"
+#include "equations.h"
+
+/* Gravitational parameter of the Earth in double precision */
+static const double muEarth = (double)G*MASS_EARTH;
+
+/**
+ * Moon acceleration about the Earth at (xe, ye): writes ax, ay into moon[4], moon[5]
+ */
+static void accelerate(double xe, double ye, double moon[EPHEMERIS_COLUMNS]);
+
+/**
+ * One classical Runge Kutta step of length h on the Moon's position and velocity
+ */
+static void stepMoon(double xe, double ye, double h, double moon[EPHEMERIS_COLUMNS]);
+
+/**
+ * Integrate initialConditions, with the reference impulse, using equations() and
+ * equationsRestricted() on the table, and record their largest differences in the
+ * table (see ephemeris_t)
+ */
+static void checkEphemeris(ephemeris_t *ephemeris, const double *initialConditions,
+		double endTime);
+
+/**
+ * One classical Runge Kutta step of length h on a three body state. Returns the first
+ * nonzero code of the derivative evaluations.
+ */
+static uint8_t stepState(uint8_t (*function)(double time, double *state), double time,
+		double h, double state[THREE_BODY_STATE_SIZE]);
+
+
+ephemeris_t *createEphemeris(const double *initialConditions, double endTime) {
+
+	ephemeris_t *ephemeris = (ephemeris_t *)malloc(sizeof(ephemeris_t));
+	if (ephemeris == NULL) return NULL;
+
+	ephemeris->spacing = EPHEMERIS_SPACING;
+	ephemeris->count = (uint32_t)ceil((endTime + EPHEMERIS_MARGIN)/EPHEMERIS_SPACING) + 1;
+	ephemeris->samples = malloc((size_t)ephemeris->count*sizeof(*ephemeris->samples));
+	ephemeris->maxError = 0;
+	if (ephemeris->samples == NULL) {
+		free(ephemeris);
+		return NULL;
+	}
+
+	/* The Earth stays where it starts, like in equations() */
+	double xe = initialConditions[4], ye = initialConditions[5];
+	double moon[EPHEMERIS_COLUMNS] = { initialConditions[8], initialConditions[9],
+		initialConditions[10], initialConditions[11], 0, 0 };
+	accelerate(xe, ye, moon);
+
+	double h = EPHEMERIS_SPACING/EPHEMERIS_SUBSTEPS;
+	for (uint32_t index = 0; index < ephemeris->count; index++) {
+		for (uint8_t c = 0; c < EPHEMERIS_COLUMNS; c++)
+			ephemeris->samples[index][c] = moon[c];
+		if (index + 1 == ephemeris->count) break;
+
+		/* Integrate to the next sample, checking the previous interval at its middle */
+		double middle[EPHEMERIS_COLUMNS];
+		for (uint8_t substep = 0; substep < EPHEMERIS_SUBSTEPS; substep++) {
+			stepMoon(xe, ye, h, moon);
+			if (substep + 1 == EPHEMERIS_SUBSTEPS/2)
+				for (uint8_t c = 0; c < EPHEMERIS_COLUMNS; c++)
+					middle[c] = moon[c];
+		}
+		for (uint8_t c = 0; c < EPHEMERIS_COLUMNS; c++)
+			ephemeris->samples[index + 1][c] = moon[c];
+
+		double interpolated[EPHEMERIS_COLUMNS];
+		moonState(ephemeris, (index + 0.5)*EPHEMERIS_SPACING, interpolated);
+		double error = hypot(interpolated[0] - middle[0], interpolated[1] - middle[1]);
+		if (error > ephemeris->maxError) ephemeris->maxError = error;
+	}
+	checkEphemeris(ephemeris, initialConditions, endTime);
+	return ephemeris;
+}
+
+
+void destroyEphemeris(ephemeris_t *ephemeris) {
+
+	if (ephemeris == NULL) return;
+	free(ephemeris->samples);
+	free(ephemeris);
+}
+
+
+void moonState(const ephemeris_t *ephemeris, double time, double moon[EPHEMERIS_COLUMNS]) {
+
+	/* Interval holding time, clamped to the table */
+	double position = time/ephemeris->spacing;
+	uint32_t index = position > 0 ? (uint32_t)position : 0;
+	if (index > ephemeris->count - 2) index = ephemeris->count - 2;
+	double theta = position - index;
+	double h = ephemeris->spacing;
+
+	const double *s0 = ephemeris->samples[index];
+	const double *s1 = ephemeris->samples[index + 1];
+
+	/* Quintic Hermite basis matching position, velocity and acceleration at both ends */
+	double t2 = theta*theta, t3 = t2*theta, t4 = t3*theta, t5 = t4*theta;
+	double H[6] = {
+		1 - 10*t3 + 15*t4 - 6*t5,
+		theta - 6*t3 + 8*t4 - 3*t5,
+		0.5*(t2 - 3*t3 + 3*t4 - t5),
+		0.5*(t3 - 2*t4 + t5),
+		-4*t3 + 7*t4 - 3*t5,
+		10*t3 - 15*t4 + 6*t5
+	};
+	double dH[6] = {
+		-30*t2 + 60*t3 - 30*t4,
+		1 - 18*t2 + 32*t3 - 15*t4,
+		0.5*(2*theta - 9*t2 + 12*t3 - 5*t4),
+		0.5*(3*t2 - 8*t3 + 5*t4),
+		-12*t2 + 28*t3 - 15*t4,
+		30*t2 - 60*t3 + 30*t4
+	};
+	double ddH[6] = {
+		-60*theta + 180*t2 - 120*t3,
+		-36*theta + 96*t2 - 60*t3,
+		0.5*(2 - 18*theta + 36*t2 - 20*t3),
+		0.5*(6*theta - 24*t2 + 20*t3),
+		-24*theta + 84*t2 - 60*t3,
+		60*theta - 180*t2 + 120*t3
+	};
+
+	for (uint8_t axis = 0; axis < 2; axis++) {
+		double p0 = s0[axis], v0 = h*s0[2 + axis], a0 = h*h*s0[4 + axis];
+		double p1 = s1[axis], v1 = h*s1[2 + axis], a1 = h*h*s1[4 + axis];
+
+		moon[axis]     = H[0]*p0 + H[1]*v0 + H[2]*a0 + H[3]*a1 + H[4]*v1 + H[5]*p1;
+		moon[2 + axis] = (dH[0]*p0 + dH[1]*v0 + dH[2]*a0 + dH[3]*a1 + dH[4]*v1 + dH[5]*p1)/h;
+		moon[4 + axis] = (ddH[0]*p0 + ddH[1]*v0 + ddH[2]*a0 + ddH[3]*a1 + ddH[4]*v1 +
+				ddH[5]*p1)/(h*h);
+	}
+}
+
+
+void accelerate(double xe, double ye, double moon[EPHEMERIS_COLUMNS]) {
+
+	double dx = xe - moon[0], dy = ye - moon[1];
+	double d2 = dx*dx + dy*dy;
+	double inv3 = 1.0/(d2*sqrt(d2));
+	moon[4] = muEarth*dx*inv3;
+	moon[5] = muEarth*dy*inv3;
+}
+
+
+void stepMoon(double xe, double ye, double h, double moon[EPHEMERIS_COLUMNS]) {
+
+	/* Stages hold (x, y, vx, vy) and their derivatives (vx, vy, ax, ay) */
+	double k[4][4], stage[EPHEMERIS_COLUMNS];
+	const double weights[4] = { 0, 0.5, 0.5, 1 };
+
+	for (uint8_t s = 0; s < 4; s++) {
+		for (uint8_t c = 0; c < 4; c++)
+			stage[c] = moon[c] + (s > 0 ? weights[s]*h*k[s - 1][c] : 0);
+		accelerate(xe, ye, stage);
+		k[s][0] = stage[2];
+		k[s][1] = stage[3];
+		k[s][2] = stage[4];
+		k[s][3] = stage[5];
+	}
+	for (uint8_t c = 0; c < 4; c++)
+		moon[c] += h*(k[0][c] + 2*k[1][c] + 2*k[2][c] + k[3][c])/6;
+	accelerate(xe, ye, moon);
+}
+
+
+void checkEphemeris(ephemeris_t *ephemeris, const double *initialConditions,
+		double endTime) {
+
+	ephemeris->moonError = 0;
+	ephemeris->positionError = 0;
+	ephemeris->velocityError = 0;
+
+	/* equationsRestricted() reads the table that is set, restore the caller's after */
+	const ephemeris_t *previous = getEphemeris();
+	setEphemeris(ephemeris);
+
+	double full[THREE_BODY_STATE_SIZE], restricted[THREE_BODY_STATE_SIZE];
+	memcpy(full, initialConditions, sizeof(full));
+	full[2] += EPHEMERIS_CHECK_DVX;
+	full[3] += EPHEMERIS_CHECK_DVY;
+	memcpy(restricted, full, sizeof(restricted));
+	for (double time = 0; time < endTime; time += EPHEMERIS_CHECK_STEP) {
+		uint8_t ended = (stepState(&equations, time, EPHEMERIS_CHECK_STEP, full) != 0);
+		ended |= (stepState(&equationsRestricted, time, EPHEMERIS_CHECK_STEP, restricted) != 0);
+
+		double moon[EPHEMERIS_COLUMNS];
+		moonState(ephemeris, time + EPHEMERIS_CHECK_STEP, moon);
+		double moonError = hypot(full[8] - moon[0], full[9] - moon[1]);
+		double positionError = hypot(full[0] - restricted[0], full[1] - restricted[1]);
+		double velocityError = hypot(full[2] - restricted[2], full[3] - restricted[3]);
+		ephemeris->moonError = fmax(ephemeris->moonError, moonError);
+		ephemeris->positionError = fmax(ephemeris->positionError, positionError);
+		ephemeris->velocityError = fmax(ephemeris->velocityError, velocityError);
+
+		/* Past a collision or an escape the two no longer describe the same flight */
+		if (ended) break;
+	}
+	setEphemeris(previous);
+}
+
+
+uint8_t stepState(uint8_t (*function)(double time, double *state), double time,
+		double h, double state[THREE_BODY_STATE_SIZE]) {
+
+	double k[4][THREE_BODY_STATE_SIZE];
+	const double weights[4] = { 0, 0.5, 0.5, 1 };
+	uint8_t status = 0;
+
+	for (uint8_t s = 0; s < 4; s++) {
+		for (uint8_t c = 0; c < THREE_BODY_STATE_SIZE; c++)
+			k[s][c] = state[c] + (s > 0 ? weights[s]*h*k[s - 1][c] : 0);
+		uint8_t code = (function)(time + weights[s]*h, k[s]);
+		if (status == 0) status = code;
+	}
+	for (uint8_t c = 0; c < THREE_BODY_STATE_SIZE; c++)
+		state[c] += h*(k[0][c] + 2*k[1][c] + 2*k[2][c] + k[3][c])/6;
+	return status;
+}
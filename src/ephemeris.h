@@ -0,0 +1,78 @@
+#ifndef _EPHEMERIS_H_
+#define _EPHEMERIS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "definitions.h"
+
+/* Seconds between samples, and RK4 substeps per sample when building the table */
+#define EPHEMERIS_SPACING 		(1E4)
+#define EPHEMERIS_SUBSTEPS 		(10)
+
+/* The table extends this far past the end time, for steps that overshoot it */
+#define EPHEMERIS_MARGIN 		(1E7)
+
+/* Step of the RK4 reference trajectory that checks the table against equations() (s) */
+#define EPHEMERIS_CHECK_STEP 	(1E2)
+
+/* Impulse of that reference trajectory (m/s): an Earth return passing the Moon */
+#define EPHEMERIS_CHECK_DVX 	(-85.0)
+#define EPHEMERIS_CHECK_DVY 	(50.0)
+
+/* Moon position, velocity and acceleration (x, y, vx, vy, ax, ay) */
+#define EPHEMERIS_COLUMNS 		(6)
+
+/**
+ * Moon trajectory of the restricted three body problem, sampled every
+ * EPHEMERIS_SPACING seconds and interpolated with quintic Hermite polynomials.
+ *
+ * Error bound: the table ignores the spacecraft's pull on the Moon. Even grazing
+ * the lunar surface, that acceleration is below G*MASS_SAT/RADIUS_MOON^2 ~ 6.4E-19
+ * m/s^2, which moves the Moon by less than 4 mm over END_TIME (1E8 s). The
+ * interpolation error is measured while the table is built, by comparing the
+ * interpolant against the integrated orbit at the middle of every interval; it is
+ * stored in maxError (about 1E-5 m at the default spacing). Both are negligible
+ * next to the rk45() local error tolerance.
+ *
+ * Both are also checked together. The given initial conditions, with the impulse
+ * (EPHEMERIS_CHECK_DVX, EPHEMERIS_CHECK_DVY), are integrated with the full equations()
+ * and with equationsRestricted() on the table, in lockstep with RK4 steps of
+ * EPHEMERIS_CHECK_STEP, until the trajectory terminates or reaches the end time. The
+ * largest differences are stored in moonError, positionError and velocityError: about
+ * 1E-4 m for the Moon, and 0.1 m and 1E-4 m/s for the spacecraft after its lunar
+ * flyby and 3 days of flight.
+ */
+typedef struct {
+	double spacing;
+	uint32_t count;
+	double (*samples)[EPHEMERIS_COLUMNS];
+
+	/* Largest interpolation error found while building (m) */
+	double maxError;
+
+	/* Largest differences from equations() along the reference trajectory: Moon and
+	 * spacecraft position (m), spacecraft velocity (m/s) */
+	double moonError;
+	double positionError;
+	double velocityError;
+} ephemeris_t;
+
+/**
+ * Integrate the Moon about the fixed Earth of the given three body state from t = 0
+ * to endTime (plus margin), sample it into a table, and check the table against the
+ * full equations along the trajectory of that state. NULL on failure.
+ */
+ephemeris_t *createEphemeris(const double *initialConditions, double endTime);
+
+/* Release a table */
+void destroyEphemeris(ephemeris_t *ephemeris);
+
+/**
+ * Interpolated Moon position, velocity and acceleration at time. Times past the end
+ * of the table are extrapolated from its last interval.
+ */
+void moonState(const ephemeris_t *ephemeris, double time, double moon[EPHEMERIS_COLUMNS]);
+
+#endif /* _EPHEMERIS_H_ */
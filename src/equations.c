@@ -2,63 +2,239 @@
 #include <stdio.h>
 
 static double clearance;
+static const ephemeris_t *ephemeris;
+static const bodies_t *bodies = &THREE_BODY_BODIES;
+
+/* Gravitational parameters in double precision */
+static const double muEarth = (double)G*MASS_EARTH;
+static const double muMoon  = (double)G*MASS_MOON;
+static const double muSat   = (double)G*MASS_SAT;
+
+/**
+ * N-body derivative of a state of count bodies, in place. Inlined with a constant count
+ * for the three body table, so its loops unroll like the hand-written equations().
+ */
+static inline __attribute__((always_inline)) uint8_t nbodyDerivative(const bodies_t *table,
+		uint8_t count, double *state);
+
 
 uint8_t equations(double time, double *stateBuffer) {
 
-	/* Copy the state into a struct (more readable) */
-	state_t state;
-	memcpy(&state, stateBuffer, sizeof(state_t));
+	/* Accelerations and squared distances, each pair evaluated once */
+	double accelSat[2], accelMoon[2];
+	distances_t distances;
+	gravity(stateBuffer, accelSat, accelMoon, &distances);
 
-	/* Check for a collision */	
-	uint8_t status = checkCollision(state);
+	/* Differentiate the state in place: velocities first, they are overwritten */
+	stateBuffer[0]  = stateBuffer[2];
+	stateBuffer[1]  = stateBuffer[3];
+	stateBuffer[2]  = accelSat[0];
+	stateBuffer[3]  = accelSat[1];
+	stateBuffer[4]  = 0;
+	stateBuffer[5]  = 0;
+	stateBuffer[6]  = 0;
+	stateBuffer[7]  = 0;
+	stateBuffer[8]  = stateBuffer[10];
+	stateBuffer[9]  = stateBuffer[11];
+	stateBuffer[10] = accelMoon[0];
+	stateBuffer[11] = accelMoon[1];
 
-	/* Forces acting on the spacecraft */
-	double fxMoonOnSat  = force(MASS_MOON, MASS_SAT, state.xs,  state.xm, state.ys, state.ym, 1);
-	double fyMoonOnSat  = force(MASS_MOON, MASS_SAT, state.xs,  state.xm, state.ys, state.ym, 2);
-	double fxEarthOnSat = force(MASS_EARTH, MASS_SAT, state.xs, state.xe, state.ys, state.ye, 1);
-	double fyEarthOnSat = force(MASS_EARTH, MASS_SAT, state.xs,  state.xe, state.ys, state.ye, 2);
-
-	/* Forces acting on the moon */
-	double fxEarthOnMoon = force(MASS_EARTH, MASS_MOON, state.xm, state.xe, state.ym, state.ye, 1);
-	double fyEarthOnMoon = force(MASS_EARTH, MASS_MOON, state.xm, state.xe, state.ym, state.ye, 2);
-	double fxSatOnMoon   = -fxMoonOnSat;
-	double fySatOnMoon   = -fyMoonOnSat;
-
-	/* Accelerations */
-	double axSat  = (fxEarthOnSat + fxMoonOnSat)/MASS_SAT;
-	double aySat  = (fyEarthOnSat + fyMoonOnSat)/MASS_SAT;
-	double axMoon = (fxSatOnMoon + fxEarthOnMoon)/MASS_MOON;
-	double ayMoon = (fySatOnMoon + fyEarthOnMoon)/MASS_MOON;
-
-	/* Differentiate the state and copy to the buffer */
-	differentiate(&state, axSat, aySat, axMoon, ayMoon);
-	memcpy(stateBuffer, &state, sizeof(state));
+	return checkCollisionSquared(&distances);
+}
+
+
+uint8_t variationalEquations(double time, double *stateBuffer) {
+
+	/* Gravity gradient at the spacecraft, mu*(3*r*r^T/r^5 - I/r^3) summed over the
+	 * Earth and the Moon, from the positions before they are overwritten */
+	const double *bodyState[2] = { stateBuffer + 4, stateBuffer + 8 };
+	const double mu[2] = { muEarth, muMoon };
+	double gradient[2][2] = { { 0, 0 }, { 0, 0 } };
+	for (uint8_t body = 0; body < 2; body++) {
+		double dx = stateBuffer[0] - bodyState[body][0];
+		double dy = stateBuffer[1] - bodyState[body][1];
+		double d2 = dx*dx + dy*dy;
+		double inv3 = 1.0/(d2*sqrt(d2)), inv5 = inv3/d2;
+		gradient[0][0] += mu[body]*(3*dx*dx*inv5 - inv3);
+		gradient[0][1] += mu[body]*3*dx*dy*inv5;
+		gradient[1][1] += mu[body]*(3*dy*dy*inv5 - inv3);
+	}
+	gradient[1][0] = gradient[0][1];
+
+	/* dPhi/dt = A*Phi, with A = [0 I; gradient 0] */
+	double *phi = stateBuffer + THREE_BODY_STATE_SIZE;
+	for (uint8_t column = 0; column < BODY_STATE_SIZE; column++) {
+		double x = phi[column], y = phi[BODY_STATE_SIZE + column];
+		phi[column] = phi[2*BODY_STATE_SIZE + column];
+		phi[BODY_STATE_SIZE + column] = phi[3*BODY_STATE_SIZE + column];
+		phi[2*BODY_STATE_SIZE + column] = gradient[0][0]*x + gradient[0][1]*y;
+		phi[3*BODY_STATE_SIZE + column] = gradient[1][0]*x + gradient[1][1]*y;
+	}
+
+	return equations(time, stateBuffer);
+}
+
+
+void gravity(const double *state, double accelSat[2], double accelMoon[2],
+		distances_t *distances) {
+
+	/* Relative positions, toward the attracting body */
+	double dxMoonSat   = state[8] - state[0];
+	double dyMoonSat   = state[9] - state[1];
+	double dxEarthSat  = state[4] - state[0];
+	double dyEarthSat  = state[5] - state[1];
+	double dxEarthMoon = state[4] - state[8];
+	double dyEarthMoon = state[5] - state[9];
+
+	/* Inverse cube distances */
+	double d2MoonSat   = dxMoonSat*dxMoonSat + dyMoonSat*dyMoonSat;
+	double d2EarthSat  = dxEarthSat*dxEarthSat + dyEarthSat*dyEarthSat;
+	double d2EarthMoon = dxEarthMoon*dxEarthMoon + dyEarthMoon*dyEarthMoon;
+	double inv3MoonSat   = 1.0/(d2MoonSat*sqrt(d2MoonSat));
+	double inv3EarthSat  = 1.0/(d2EarthSat*sqrt(d2EarthSat));
+	double inv3EarthMoon = 1.0/(d2EarthMoon*sqrt(d2EarthMoon));
+
+	accelSat[0]  = muMoon*dxMoonSat*inv3MoonSat + muEarth*dxEarthSat*inv3EarthSat;
+	accelSat[1]  = muMoon*dyMoonSat*inv3MoonSat + muEarth*dyEarthSat*inv3EarthSat;
+	accelMoon[0] = muEarth*dxEarthMoon*inv3EarthMoon - muSat*dxMoonSat*inv3MoonSat;
+	accelMoon[1] = muEarth*dyEarthMoon*inv3EarthMoon - muSat*dyMoonSat*inv3MoonSat;
+
+	if (distances != NULL) {
+		distances->earthMoon = d2EarthMoon;
+		distances->earthSat  = d2EarthSat;
+		distances->moonSat   = d2MoonSat;
+	}
+}
+
+uint8_t nbodyEquations(double time, double *stateBuffer) {
+
+	if (bodies->count == 3) return nbodyDerivative(bodies, 3, stateBuffer);
+	return nbodyDerivative(bodies, bodies->count, stateBuffer);
+}
+
+
+uint8_t nbodyDerivative(const bodies_t *table, uint8_t count, double *state) {
+
+	/* Parameters and positions as a structure of arrays, read before the state is written */
+	double mu[MAX_BODIES], x[MAX_BODIES], y[MAX_BODIES], ax[MAX_BODIES], ay[MAX_BODIES];
+	for (uint8_t i = 0; i < count; i++) {
+		mu[i] = table->mu[i];
+		x[i] = state[BODY_STATE_SIZE*i];
+		y[i] = state[BODY_STATE_SIZE*i + 1];
+		ax[i] = 0;
+		ay[i] = 0;
+	}
+
+	/* Pairwise accelerations, one inverse cube per pair. The inner loop has no
+	 * dependence between iterations, so it vectorizes across j */
+	double d2[MAX_BODIES][MAX_BODIES];
+	for (uint8_t i = 0; i < count; i++) {
+		double axi = 0, ayi = 0;
+		for (uint8_t j = i + 1; j < count; j++) {
+			double dx = x[j] - x[i], dy = y[j] - y[i];
+			double r2 = dx*dx + dy*dy;
+			double inv3 = 1.0/(r2*sqrt(r2));
+			axi += mu[j]*dx*inv3;
+			ayi += mu[j]*dy*inv3;
+			ax[j] -= mu[i]*dx*inv3;
+			ay[j] -= mu[i]*dy*inv3;
+			d2[i][j] = r2;
+		}
+		ax[i] += axi;
+		ay[i] += ayi;
+	}
+
+	/* Earth-centred frame, or the Earth pinned at the origin */
+	double frameX = table->indirect ? ax[BODY_EARTH] : 0;
+	double frameY = table->indirect ? ay[BODY_EARTH] : 0;
+
+	/* Differentiate in place: positions take the velocities, velocities the accelerations */
+	for (uint8_t i = 0; i < count; i++) {
+		double *body = state + BODY_STATE_SIZE*i;
+		uint8_t moving = (i != BODY_EARTH);
+		body[0] = moving ? body[2] : 0;
+		body[1] = moving ? body[3] : 0;
+		body[2] = moving ? ax[i] - frameX : 0;
+		body[3] = moving ? ay[i] - frameY : 0;
+	}
 
+	distances_t distances = {
+		.earthMoon = d2[BODY_EARTH][BODY_MOON],
+		.earthSat  = d2[BODY_SPACECRAFT][BODY_EARTH],
+		.moonSat   = d2[BODY_SPACECRAFT][BODY_MOON]
+	};
+	uint8_t status = checkCollisionSquared(&distances);
 	if (status) return status;
 
-	/* If we are here, then a collision has not occurred */
+	/* Perturbers */
+	for (uint8_t j = BODY_FIRST_PERTURBER; j < count; j++)
+		if (d2[BODY_SPACECRAFT][j] < table->radius[j]*table->radius[j])
+			return RESULT_ESCAPE;
 	return 0;
 }
 
+
+uint8_t equationsRestricted(double time, double *stateBuffer) {
+
+	state_t state;
+	memcpy(&state, stateBuffer, sizeof(state_t));
+	uint8_t status = checkCollision(state);
+
+	/* The Moon comes from the table */
+	double moon[EPHEMERIS_COLUMNS];
+	moonState(ephemeris, time, moon);
+
+	/* Spacecraft acceleration from the Earth and the tabulated Moon */
+	double dxEarth = state.xe - state.xs, dyEarth = state.ye - state.ys;
+	double dxMoon  = moon[0] - state.xs,  dyMoon  = moon[1] - state.ys;
+	double d2Earth = dxEarth*dxEarth + dyEarth*dyEarth;
+	double d2Moon  = dxMoon*dxMoon + dyMoon*dyMoon;
+	double earthTerm = (double)G*MASS_EARTH/(d2Earth*sqrt(d2Earth));
+	double moonTerm  = (double)G*MASS_MOON/(d2Moon*sqrt(d2Moon));
+
+	double axSat = earthTerm*dxEarth + moonTerm*dxMoon;
+	double aySat = earthTerm*dyEarth + moonTerm*dyMoon;
+
+	/* differentiate() copies the Moon velocity from the state, use the table's */
+	state.vxm = moon[2];
+	state.vym = moon[3];
+	differentiate(&state, axSat, aySat, moon[4], moon[5]);
+	memcpy(stateBuffer, &state, sizeof(state));
+	return status;
+}
+
+
 uint8_t checkCollisionArray(double *stateIn) {
 
-    state_t state;
-    memcpy(&state, stateIn, sizeof(state_t));
-    return checkCollision(state);
+	distances_t distances = {
+		.earthMoon = pow(stateIn[8] - stateIn[4], 2) + pow(stateIn[9] - stateIn[5], 2),
+		.earthSat  = pow(stateIn[0] - stateIn[4], 2) + pow(stateIn[1] - stateIn[5], 2),
+		.moonSat   = pow(stateIn[0] - stateIn[8], 2) + pow(stateIn[1] - stateIn[9], 2)
+	};
+	return checkCollisionSquared(&distances);
 }
 
 
 uint8_t checkCollision(state_t state) {
-	
-	/* Compute distances */
-	double distanceEarthMoon = distance(state.xe, state.ye, state.xm, state.ym);
-	double distanceEarthSat  = distance(state.xe, state.ye, state.xs, state.ys);
-	double distanceMoonSat 	 = distance(state.xm, state.ym, state.xs, state.ys);
+
+	/* Squared distances, compared to squared limits: no square roots */
+	distances_t distances = {
+		.earthMoon = pow(state.xm - state.xe, 2) + pow(state.ym - state.ye, 2),
+		.earthSat  = pow(state.xs - state.xe, 2) + pow(state.ys - state.ye, 2),
+		.moonSat   = pow(state.xs - state.xm, 2) + pow(state.ys - state.ym, 2)
+	};
+	return checkCollisionSquared(&distances);
+}
+
+
+uint8_t checkCollisionSquared(const distances_t *distances) {
 
 	/* Check if a collision occurred with the moon, earth, or spacecraft has escaped */
-	uint8_t collidedWithMoon  = (distanceMoonSat < RADIUS_MOON + clearance);
-	uint8_t collidedWithEarth = (distanceEarthSat < RADIUS_EARTH);
-	uint8_t escapedOrbit      = (distanceEarthSat > 2*distanceEarthMoon);
+	double moonLimit  = bodies->radius[BODY_MOON] + clearance;
+	double earthLimit = bodies->radius[BODY_EARTH];
+	uint8_t collidedWithMoon  = (distances->moonSat < moonLimit*moonLimit);
+	uint8_t collidedWithEarth = (distances->earthSat < earthLimit*earthLimit);
+	uint8_t escapedOrbit      = (distances->earthSat > 4*distances->earthMoon);
 
 	/* Integration should terminate if any of these conditions occur */
 	if (collidedWithMoon)
@@ -71,30 +247,31 @@ uint8_t checkCollision(state_t state) {
 }
 
 
-double distance(double x1, double y1, double x2, double y2) {
+void eventFunctions(const double *stateIn, double g[EVENT_COUNT]) {
 
-	/* Return the scalar distance */
-	return sqrt( powf((x2-x1), 2) + powf((y2-y1), 2) );
+	state_t state;
+	memcpy(&state, stateIn, sizeof(state_t));
+
+	/* Squared distances, so the functions are smooth and need no square roots */
+	double d2EarthMoon = pow(state.xm - state.xe, 2) + pow(state.ym - state.ye, 2);
+	double d2EarthSat  = pow(state.xs - state.xe, 2) + pow(state.ys - state.ye, 2);
+	double d2MoonSat   = pow(state.xs - state.xm, 2) + pow(state.ys - state.ym, 2);
+	double moonLimit   = bodies->radius[BODY_MOON] + clearance;
+	double earthLimit  = bodies->radius[BODY_EARTH];
+
+	g[EVENT_COLLISION_EARTH] = d2EarthSat - earthLimit*earthLimit;
+	g[EVENT_COLLISION_MOON]  = d2MoonSat - moonLimit*moonLimit;
+	g[EVENT_ESCAPE]          = 4*d2EarthMoon - d2EarthSat;
 }
 
 
-double force(double mass1, double mass2, double X1, double X2, double Y1, double Y2, double dir) {
+double distance(double x1, double y1, double x2, double y2) {
 
-	double d = sqrt( powf(X2-X1, 2) + powf(Y2-Y1, 2) );
-	if (dir == 1){
-		double result = G*mass1*mass2*(X2 - X1)/(powf(d, 3));
-        return result;
-	}
-	else{
-		double result = G*mass1*mass2*(Y2 - Y1)/(powf(d, 3));
-        return result;
-		
-	}
-	/* Return the scalar force acting between the two bodies */
+	/* Return the scalar distance */
+	return sqrt((x2 - x1)*(x2 - x1) + (y2 - y1)*(y2 - y1));
 }
 
 
-
 void differentiate(state_t *state, double axSat, double aySat, 
 				   			      double axMoon, double ayMoon) {
 	/* Spacecraft */
@@ -121,3 +298,22 @@ void setClearance(double clearanceIn) {
 	clearance = clearanceIn;
 }
 
+double getClearance(void) {
+	return clearance;
+}
+
+void setEphemeris(const ephemeris_t *ephemerisIn) {
+	ephemeris = ephemerisIn;
+}
+
+const ephemeris_t *getEphemeris(void) {
+	return ephemeris;
+}
+
+void setBodies(const bodies_t *bodiesIn) {
+	bodies = bodiesIn;
+}
+
+const bodies_t *getBodies(void) {
+	return bodies;
+}
@@ -6,15 +6,27 @@
 
 #include <math.h>
 #include "definitions.h"
+#include "ephemeris.h"
+#include "bodies.h"
 
 #define TRUE 	(1)
 #define FALSE 	(0)
 #define THREE_BODY_STATE_SIZE 	(12)
 
+/* Three body state followed by the 4x4 state transition matrix of the spacecraft */
+#define STM_SIZE 				(BODY_STATE_SIZE*BODY_STATE_SIZE)
+#define VARIATIONAL_STATE_SIZE 	(THREE_BODY_STATE_SIZE + STM_SIZE)
+
 #define RESULT_COLLISION_EARTH 	(1)
 #define RESULT_COLLISION_MOON   (2)
 #define RESULT_ESCAPE 			(3)
 
+/* Terminal events, indexed so that event + 1 is the matching RESULT_ code */
+#define EVENT_COLLISION_EARTH 	(0)
+#define EVENT_COLLISION_MOON 	(1)
+#define EVENT_ESCAPE 			(2)
+#define EVENT_COUNT 			(3)
+
 /* A struct to represent a state */
 typedef struct {
 
@@ -38,6 +50,13 @@ typedef struct {
 
 } state_t;
 
+/* Squared distances between the bodies of a state */
+typedef struct {
+	double earthMoon;
+	double earthSat;
+	double moonSat;
+} distances_t;
+
 /**
  * Takes a 12x1 array representing the state of the system and fills that array
  * with the derivative of the state at the specified time. Return value indicates
@@ -45,8 +64,51 @@ typedef struct {
  */
 uint8_t equations(double time, double *stateIn);
 
-/* Compute the force between two bodies */
-double force(double mass1, double mass2, double X1, double X2, double Y1, double Y2, double dir);
+/**
+ * Three body equations() with the variational equations of the spacecraft, on a state
+ * of VARIATIONAL_STATE_SIZE entries: the three body state, then the state transition
+ * matrix of the spacecraft (x, y, vx, vy) with respect to its initial state, row major.
+ * The Earth and Moon are taken as unaffected by the spacecraft (through its mass only,
+ * a relative 1E-19), which reduces the 12x12 matrix to the spacecraft's 4x4 block.
+ */
+uint8_t variationalEquations(double time, double *stateIn);
+
+/**
+ * Restricted three body equations: same interface as equations(), but the Moon
+ * follows the table set with setEphemeris() instead of being integrated, so only the
+ * spacecraft's acceleration is computed. The Moon entries of the derivative are the
+ * table's velocity and acceleration, so the Moon in the state tracks the table.
+ */
+uint8_t equationsRestricted(double time, double *stateIn);
+
+/**
+ * General N-body equations of the table set with setBodies(): same interface as
+ * equations(), on a state of BODY_STATE_SIZE entries per body. Each pair's inverse cube
+ * distance is computed once; the three body table runs a copy specialized for three
+ * bodies. Terminates like equations(), with the table's collision radii, and returns
+ * RESULT_ESCAPE when the spacecraft is inside a perturber.
+ */
+uint8_t nbodyEquations(double time, double *stateIn);
+
+/* Set the bodies of nbodyEquations(), and the collision radii of every check */
+void setBodies(const bodies_t *bodiesIn);
+
+/* Get the bodies */
+const bodies_t *getBodies(void);
+
+/* Set the Moon ephemeris used by equationsRestricted() */
+void setEphemeris(const ephemeris_t *ephemerisIn);
+
+/* Get the Moon ephemeris */
+const ephemeris_t *getEphemeris(void);
+
+/**
+ * Gravitational accelerations of the spacecraft and the Moon (x, y) in a 12x1 state
+ * array, with each pair's inverse cube distance computed once. When distances is not
+ * NULL it receives the squared pair distances, for a collision check without roots.
+ */
+void gravity(const double *state, double accelSat[2], double accelMoon[2],
+		distances_t *distances);
 
 /* Compute 2D distance between two objects */
 double distance(double x1, double y1, double x2, double y2);
@@ -60,8 +122,20 @@ void differentiate(state_t *state, double axSat, double aySat, double axMoon, do
 /* Set the clearance variable */
 void setClearance(double clearanceIn); 
 
+/* Get the clearance variable */
+double getClearance(void);
+
+/* Check if a collision has occurred from the squared pair distances */
+uint8_t checkCollisionSquared(const distances_t *distances);
+
 /* Check if a collision has occurred from a state array */
 uint8_t checkCollisionArray(double *stateIn);
 
+/**
+ * Continuous event functions of a state array, one per terminal event. An event has
+ * occurred when its function is negative; the zero crossing is the exact event surface.
+ */
+void eventFunctions(const double *stateIn, double g[EVENT_COUNT]);
+
 #endif /* _EQUATIONS_H_ */
 
@@ -0,0 +1,212 @@
+#include "events.h"
+
+/* Pseudo event of findCrossing(): the spacecraft stops approaching the Moon */
+#define EVENT_APPROACH 			(EVENT_COUNT)
+
+/**
+ * Three body state of a state: state itself with a NULL map, otherwise physical filled
+ * by map. time receives the physical time of the state, t unless it is mapped.
+ */
+static const double *threeBodyState(const double *state, event_map_t map, double t,
+		double physical[THREE_BODY_STATE_SIZE], double *time);
+
+/**
+ * Half the rate of change of the squared spacecraft-Moon distance of a three body state,
+ * negative while the spacecraft approaches the Moon
+ */
+static double approachRate(const double *state);
+
+/**
+ * Value of one event function at the fraction theta of the step, or of -approachRate()
+ * for EVENT_APPROACH
+ */
+static double eventAt(const double *y0, const double *f0, const double *y1, const double *f1,
+		double h, double theta, uint8_t size, uint8_t event, event_map_t map);
+
+/**
+ * Find the crossing of one event inside the bracket [a, b] of the step, where the event
+ * function is non-negative at a and negative at b (Illinois method). duration is the
+ * physical time the step spans, for EVENT_TIME_TOL.
+ */
+static double findCrossing(const double *y0, const double *f0, const double *y1,
+		const double *f1, double h, uint8_t size, uint8_t event, double a, double ga,
+		double b, double gb, double duration, event_map_t map);
+
+
+void interpolateHermite(const double *y0, const double *f0, const double *y1,
+		const double *f1, double h, double theta, uint8_t size, double *out) {
+
+	/* Hermite basis functions */
+	double theta2 = theta*theta, theta3 = theta2*theta;
+	double h00 = 2*theta3 - 3*theta2 + 1;
+	double h10 = theta3 - 2*theta2 + theta;
+	double h01 = -2*theta3 + 3*theta2;
+	double h11 = theta3 - theta2;
+
+	for (uint8_t i = 0; i < size; i++)
+		out[i] = h00*y0[i] + h*(h10*f0[i] + h11*f1[i]) + h01*y1[i];
+}
+
+
+void observeApproach(approach_t *approach, const double *state, double time) {
+
+	const double *moon = state + BODY_MOON*BODY_STATE_SIZE;
+	double d2 = (state[0] - moon[0])*(state[0] - moon[0]) + (state[1] - moon[1])*(state[1] - moon[1]);
+	if (d2 < approach->distanceSquared) {
+		approach->distanceSquared = d2;
+		approach->time = time;
+	}
+}
+
+
+uint8_t locateEvent(const double *y0, const double *f0, const double *y1, const double *f1,
+		double t0, double h, uint8_t size, double *eventTime, double *eventState,
+		approach_t *approach) {
+
+	return locateEventMapped(y0, f0, y1, f1, t0, h, size, eventTime, eventState, approach,
+			NULL);
+}
+
+
+uint8_t locateEventMapped(const double *y0, const double *f0, const double *y1,
+		const double *f1, double t0, double h, uint8_t size, double *eventTime,
+		double *eventState, approach_t *approach, event_map_t map) {
+
+	const uint8_t priority[EVENT_COUNT] = EVENT_PRIORITY;
+	double state[size], gPrevious[EVENT_COUNT], g[EVENT_COUNT];
+	double physical[THREE_BODY_STATE_SIZE], time, duration = h;
+	const double *threeBody = threeBodyState(y0, map, t0, physical, &time);
+	eventFunctions(threeBody, gPrevious);
+	double ratePrevious = approachRate(threeBody);
+	if (map != NULL) {
+		double end;
+		map(y1, physical, &end);
+		duration = end - time;
+	}
+
+	/* Walk the interpolant to bracket the first crossing, so grazing passes are caught */
+	for (uint8_t sample = 1; sample <= EVENT_SAMPLES; sample++) {
+		double theta = (double)sample/EVENT_SAMPLES;
+		if (sample == EVENT_SAMPLES)
+			memcpy(state, y1, size*sizeof(double));
+		else
+			interpolateHermite(y0, f0, y1, f1, h, theta, size, state);
+		threeBody = threeBodyState(state, map, t0 + theta*h, physical, &time);
+		eventFunctions(threeBody, g);
+		double rate = approachRate(threeBody);
+		double previous = (double)(sample - 1)/EVENT_SAMPLES;
+
+		/* Closest point to the Moon in this bracket: the minimum of the distance where
+		 * the spacecraft turns away from the Moon between the samples, else the sample */
+		double closest = theta, gClosest = g[EVENT_COLLISION_MOON];
+		if (ratePrevious < 0 && rate >= 0) {
+			closest = findCrossing(y0, f0, y1, f1, h, size, EVENT_APPROACH, previous,
+					-ratePrevious, theta, -rate, duration, map);
+			gClosest = eventAt(y0, f0, y1, f1, h, closest, size, EVENT_COLLISION_MOON, map);
+		}
+
+		/* Earliest crossing among the events that fired in this bracket, the Moon's up
+		 * to the closest point */
+		double first = INFINITY;
+		uint8_t result = 0;
+		for (uint8_t index = 0; index < EVENT_COUNT; index++) {
+			uint8_t event = priority[index];
+			double end = theta, gEnd = g[event];
+			if (event == EVENT_COLLISION_MOON && gClosest < gEnd) {
+				end = closest;
+				gEnd = gClosest;
+			}
+			if (gEnd >= 0) continue;
+
+			double crossing = end;
+			if (gPrevious[event] >= 0)
+				crossing = findCrossing(y0, f0, y1, f1, h, size, event, previous,
+						gPrevious[event], end, gEnd, duration, map);
+			if (crossing < first) {
+				first = crossing;
+				result = event + 1;
+			}
+		}
+
+		/* The distance decreases up to the closest point, so an event before it is the
+		 * closest point of the step */
+		if (approach != NULL) {
+			double end = (result && first < closest) ? first : closest;
+			if (end != theta) {
+				interpolateHermite(y0, f0, y1, f1, h, end, size, state);
+				threeBody = threeBodyState(state, map, t0 + end*h, physical, &time);
+			}
+			observeApproach(approach, threeBody, time);
+		}
+		if (result) {
+			*eventTime = t0 + first*h;
+			interpolateHermite(y0, f0, y1, f1, h, first, size, eventState);
+			if (map != NULL) {
+				memcpy(state, eventState, size*sizeof(double));
+				map(state, eventState, eventTime);
+			}
+			return result;
+		}
+		memcpy(gPrevious, g, sizeof(g));
+		ratePrevious = rate;
+	}
+	return 0;
+}
+
+
+const double *threeBodyState(const double *state, event_map_t map, double t,
+		double physical[THREE_BODY_STATE_SIZE], double *time) {
+
+	*time = t;
+	if (map == NULL) return state;
+	map(state, physical, time);
+	return physical;
+}
+
+
+double eventAt(const double *y0, const double *f0, const double *y1, const double *f1,
+		double h, double theta, uint8_t size, uint8_t event, event_map_t map) {
+
+	double state[size], physical[THREE_BODY_STATE_SIZE], g[EVENT_COUNT], time;
+	interpolateHermite(y0, f0, y1, f1, h, theta, size, state);
+	const double *threeBody = threeBodyState(state, map, 0, physical, &time);
+	if (event == EVENT_APPROACH) return -approachRate(threeBody);
+	eventFunctions(threeBody, g);
+	return g[event];
+}
+
+
+double approachRate(const double *state) {
+
+	const double *moon = state + BODY_MOON*BODY_STATE_SIZE;
+	return (state[0] - moon[0])*(state[2] - moon[2]) + (state[1] - moon[1])*(state[3] - moon[3]);
+}
+
+
+double findCrossing(const double *y0, const double *f0, const double *y1,
+		const double *f1, double h, uint8_t size, uint8_t event, double a, double ga,
+		double b, double gb, double duration, event_map_t map) {
+
+	/* The returned point is always on the negative side, so the event has occurred there */
+	int8_t side = 0;
+	for (uint8_t iteration = 0; iteration < EVENT_MAX_ITERATIONS; iteration++) {
+		if ((b - a)*fabs(duration) < EVENT_TIME_TOL) break;
+
+		double c = (a*gb - b*ga)/(gb - ga);
+		if (!(c > a && c < b)) c = 0.5*(a + b);
+		double gc = eventAt(y0, f0, y1, f1, h, c, size, event, map);
+
+		if (gc < 0) {
+			b = c;
+			gb = gc;
+			if (side == -1) ga *= 0.5;
+			side = -1;
+		} else {
+			a = c;
+			ga = gc;
+			if (side == 1) gb *= 0.5;
+			side = 1;
+		}
+	}
+	return b;
+}
@@ -0,0 +1,68 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "equations.h"
+
+/* Interior points of the interpolant checked for a crossing, per step */
+#define EVENT_SAMPLES 			(4)
+
+/* Event times are located to within this many seconds */
+#define EVENT_TIME_TOL 			(1E-3)
+#define EVENT_MAX_ITERATIONS 	(60)
+
+/* Order in which simultaneous events are reported, matching checkCollision() */
+#define EVENT_PRIORITY 			{ EVENT_COLLISION_MOON, EVENT_COLLISION_EARTH, EVENT_ESCAPE }
+
+/**
+ * Closest approach of the spacecraft to the Moon on the dense output of the accepted
+ * steps: the squared distance, and when it occurred
+ */
+typedef struct {
+	double distanceSquared;
+	double time;
+} approach_t;
+
+/**
+ * Three body state and physical time of a state integrated in other variables, for
+ * locateEventMapped() (see regularization.h)
+ */
+typedef void (*event_map_t)(const double *state, double *physical, double *time);
+
+/* Lower approach to the spacecraft-Moon distance of state at time, if it is closer */
+void observeApproach(approach_t *approach, const double *state, double time);
+
+/**
+ * Cubic Hermite interpolant of a step of length h from (y0, f0) to (y1, f1), evaluated
+ * at the fraction theta of the step
+ */
+void interpolateHermite(const double *y0, const double *f0, const double *y1,
+		const double *f1, double h, double theta, uint8_t size, double *out);
+
+/**
+ * Locate the first terminal event in the accepted step [t0, t0 + h] on the dense output.
+ * Returns the RESULT_ code of the event (0 if none occurred), and fills the event time
+ * and the interpolated state at the event. Minima of the spacecraft-Moon distance
+ * between the samples are located like events, so a pass that grazes the Moon between
+ * two samples is caught too. approach, unless NULL, is lowered to the closest point of
+ * the step up to the event.
+ */
+uint8_t locateEvent(const double *y0, const double *f0, const double *y1, const double *f1,
+		double t0, double h, uint8_t size, double *eventTime, double *eventState,
+		approach_t *approach);
+
+/**
+ * locateEvent() on a step of a state integrated in other variables, of size entries,
+ * over [t0, t0 + h] of its independent variable: the event functions and the approach
+ * are evaluated on the three body states that map gives for the samples. eventTime and
+ * eventState receive the physical time and the three body state at the event. With a
+ * NULL map this is locateEvent().
+ */
+uint8_t locateEventMapped(const double *y0, const double *f0, const double *y1,
+		const double *f1, double t0, double h, uint8_t size, double *eventTime,
+		double *eventState, approach_t *approach, event_map_t map);
+
+#endif /* _EVENTS_H_ */
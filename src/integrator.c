@@ -1,9 +1,10 @@
 #include "integrator.h"
+#include "kernels.h"
 
-/**
- * Log a single state to the file in the format: "time, state[0], state[1], ...state[n] \n"
- */
-static void write(FILE *file, double *state, uint8_t stateSize, double time);
+/* Fixed-size kernels of the three body state, one pair per built-in tableau */
+DEFINE_STEP_KERNELS(Rkf45, THREE_BODY_STATE_SIZE, RKF45_COEFFICIENTS)
+DEFINE_STEP_KERNELS(CashKarp, THREE_BODY_STATE_SIZE, CASH_KARP_COEFFICIENTS)
+DEFINE_STEP_KERNELS(DormandPrince, THREE_BODY_STATE_SIZE, DORMAND_PRINCE_COEFFICIENTS)
 
 /**
  * Scalar multiplication
@@ -21,320 +22,515 @@ static void printState(double *state);
 static void incrementState(double *state, double *increment, uint8_t length);
 
 /**
- * Allocate memory for all buffers used in integration
+ * Generic step kernels (see kernels.h): any state size and any tableau, read at runtime
  */
-static void allocate(configuration_t config, double **a, double **b, double **c, 
-                                             double **d, double **e, double **f);
-/**
- * Free all memory previously allocated for integration
- */
-static void freeAll();
+static uint8_t constructStages(uint8_t (*function)(double time, double *stateVector),
+        double time, const double *state, double h, uint8_t size, const tableau_t *tableau,
+        double **k);
+static double constructSolution(const double *state, double h, uint8_t size,
+        const tableau_t *tableau, const step_control_t *control, double **k, double *next);
 
 /**
- * Construct the k1 state
+ * RMS of the errors of size state components, each scaled by the tolerances of control
+ * with the larger magnitude of the component in a and b
  */
-static void constructK1(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static double scaledNorm(const double *error, const double *a, const double *b,
+        uint8_t size, const step_control_t *control);
+
 /**
- * Construct the k2 state
+ * Pick the step kernels of a state size and tableau: a fixed-size kernel when one is
+ * compiled for them, the generic ones otherwise
  */
-static void constructK2(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static void selectKernels(uint8_t size, const tableau_t *tableau, stages_kernel_t *stages,
+        solution_kernel_t *solution);
+
 /**
- * Construct the k3 state
+ * Symplectic composition of leapfrog substeps of weight*timeStep each
  */
-static void constructK3(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static uint8_t symplectic(uint8_t (*function)(double time, double *stateVector),
+        double *initialConditions, configuration_t config, workspace_t *workspace,
+        double *stopTime, const double *weights, uint8_t substeps);
+
 /**
- * Construct the k4 state
+ * Velocities of every body advanced by h times the accelerations in derivative
  */
-static void constructK4(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static void kick(double *state, const double *derivative, double h, uint8_t size);
+
 /**
- * Construct the k5 state
+ * Positions of every body advanced by h times its velocity
  */
-static void constructK5(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static void drift(double *state, double h, uint8_t size);
+
 /**
- * Construct the k6 state
+ * Primary (BODY_EARTH or BODY_MOON) whose regularization sphere of config holds the
+ * spacecraft of a three body state, 0 if neither does
  */
-static void constructK6(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config);
+static uint8_t regularizationPrimary(configuration_t config, const double *state);
+
 /**
- * Construct the 4th order state 'A'
+ * Integrate a three body state at time in Levi-Civita variables about primary, from the
+ * physical time step timeStep, until the spacecraft leaves the sphere of the primary
+ * (with REGULARIZATION_HYSTERESIS), a terminal event or the time limit. state, time and
+ * timeStep are updated at the end of the segment; closest, closestMoon (squared
+ * distances), approach and the closest states of workspace along it, like the accepted
+ * steps of rk45(). Returns the RESULT_ code of the segment.
  */
-static void constructA(double *A, double *state, configuration_t config);
+static uint8_t regularizedSegment(uint8_t primary, double *state, double *time,
+        double *timeStep, configuration_t config, workspace_t *workspace,
+        trajectory_writer_t *writer, double *closest, double *closestMoon,
+        approach_t *approach);
 
 /**
- * Construct the 5th order state 'B'
+ * Solution of a regularized step, like constructSolution(). The local error estimate is
+ * taken on the three body states of both solutions of the pair, so the tolerances keep
+ * their units, with the error of the physical time as a displacement along the relative
+ * velocity. duration receives the physical time the step spans.
  */
-static void constructB(double *B, double *state, configuration_t config);
+static double regularizedSolution(event_map_t map, const double *state, double h,
+        const tableau_t *tableau, const step_control_t *control, double **k, double *next,
+        double *duration);
 
 /**
- * Global buffers private to this file (true values)
+ * Squared distance between the spacecraft and the Earth in a state
  */
-static double *k1,  *k2,  *k3,  *k4,  *k5, *k6;
+static double distanceEarthSquared(const double *state);
 
 /**
- * Global buffers private to this file (copies of true values)
+ * Squared distance between the spacecraft and the Moon in a state
  */
-static double *k1c, *k2c, *k3c, *k4c, *k5c, *k6c;
+static double distanceMoonSquared(const double *state);
 
 
-uint8_t rk45(uint8_t (*function)(double time, double *stateVector),
-			   double *initialConditions, configuration_t config, double *stopTime) {
+workspace_t *createWorkspace(uint8_t stateSize) {
+
+    /* One block holds the workspace header followed by all buffers */
+    uint8_t stride = stateSize > REGULARIZED_STATE_SIZE ? stateSize : REGULARIZED_STATE_SIZE;
+    size_t bytes = sizeof(workspace_t) + WORKSPACE_BUFFERS*stride*sizeof(double);
+    workspace_t *workspace = (workspace_t *)calloc(1, bytes);
+    if (workspace == NULL) return NULL;
+
+    double *buffer = (double *)(workspace + 1);
+    for (uint8_t index = 0; index < TABLEAU_MAX_STAGES; index++)
+        workspace->k[index] = buffer + index*stride;
+    workspace->next = buffer + TABLEAU_MAX_STAGES*stride;
+
+    workspace->stateSize = stateSize;
+    return workspace;
+}
+
+void destroyWorkspace(workspace_t *workspace) {
+    free(workspace);
+}
+
+double timeLimit(configuration_t config) {
+
+    /* The bound only ever decreases, a stale read just stops a little later */
+    if (config.timeBound == NULL) return config.endTime;
+    double bound = atomic_load_explicit(config.timeBound, memory_order_relaxed);
+    return bound < config.endTime ? bound : config.endTime;
+}
 
-    /* Initialize k buffers and their copies */
-    allocate(config, &k1, &k2, &k3, &k4, &k5, &k6);
-    allocate(config, &k1c, &k2c, &k3c, &k4c, &k5c, &k6c);
+uint8_t rk45(uint8_t (*function)(double time, double *stateVector),
+			   double *initialConditions, configuration_t config, workspace_t *workspace,
+			   double *stopTime) {
 
     /* Initialize the current state from the initial conditions */
     double currentState[config.stateSize];
     memcpy(currentState, initialConditions, config.stateSize*sizeof(double));
 	
-    /* Other buffers, and return code for integration termination */
-	double stateA[config.stateSize], stateB[config.stateSize], difference[config.stateSize];
-	
     /* If logging is enabled, open the output file  */
-    FILE *file;
+    trajectory_writer_t *writer = NULL;
 	if (config.loggingEnabled) 
-        file = fopen(config.fileName, "w");
+        writer = openTrajectory(config.fileName, config.stateSize);
 	
     /* The integration will always start at time t = 0 */	
 	double time = 0;
 	uint8_t returnCode = 0;
 
+    /* k1 = f(state) survives a rejected step, and is known after an accepted one */
+    const tableau_t *tableau = config.tableau;
+    uint8_t firstStageReady = FALSE;
+    stages_kernel_t stages;
+    solution_kernel_t solution;
+    selectKernels(config.stateSize, tableau, &stages, &solution);
+    double closest = distanceEarthSquared(currentState);
+    approach_t approach = { INFINITY, 0 };
+    observeApproach(&approach, currentState, time);
+    double closestMoon = distanceMoonSquared(currentState);
+    if (workspace->closestEarthState != NULL)
+        memcpy(workspace->closestEarthState, currentState, config.stateSize*sizeof(double));
+    if (workspace->closestMoonState != NULL)
+        memcpy(workspace->closestMoonState, currentState, config.stateSize*sizeof(double));
+    uint8_t regularized = (function == &equations && config.stateSize == THREE_BODY_STATE_SIZE &&
+            (config.regularizeEarth > 0 || config.regularizeMoon > 0));
+    STATS(statsBegin(&workspace->stats));
+
+    /* First step: the configured one, or one chosen from the derivative at the start */
+    const step_control_t *control = &config.control;
+    step_state_t controller = STEP_STATE_INIT;
+    if (control->firstStep > 0) {
+        config.timeStep = control->firstStep;
+    } else {
+        memcpy(workspace->k[0], currentState, config.stateSize*sizeof(double));
+        (function)(time, workspace->k[0]);
+        firstStageReady = TRUE;
+        config.timeStep = initialStep(function, time, currentState, workspace->k[0],
+                config.stateSize, control);
+        STATS(workspace->stats.evaluations += 2);
+    }
+
 	/* While the absolute return code does not indicate a collision */	
-	while (returnCode == 0 && time <= config.endTime) {
-
-        /* Construct states k1 through k6 */
-        constructK1(function, time, currentState, config);
-        constructK2(function, time, currentState, config);
-        constructK3(function, time, currentState, config);
-        constructK4(function, time, currentState, config);
-        constructK5(function, time, currentState, config);
-        constructK6(function, time, currentState, config);
-		
-	    /* Construct fourth and fifth order states */	
-        constructA(stateA, currentState, config);    
-        constructB(stateB, currentState, config);    
-
-		/* Copy the 4th order solution, and initialize the difference buffer */
-		double possibleSolution[config.stateSize];
-		memcpy(possibleSolution, stateA, config.stateSize*sizeof(double));
-		memcpy(difference, stateB, config.stateSize*sizeof(double));
-
-        /* Compute the difference between the 4th and 5th order solution */
-		multiplyState(stateA, -1.0f, config.stateSize);	
-		incrementState(difference, stateA, config.stateSize);
-
-		/* Get the magnitude of the difference */
-		double sum = 0;
-		for (uint8_t i = 0; i < config.stateSize; i++) 
-			sum += powf(difference[i], 2.0f);
-		double norm = sqrtf(sum);
-
-		/* Compute delta */
-		double delta = DELTA_COEF*powf((RK45_TOL/norm), 1.0f/4.0f);
+	while (returnCode == 0 && time <= timeLimit(config)) {
+
+        /* Close to a primary, continue in regularized variables until the spacecraft
+         * leaves its sphere; the first stage is then evaluated again */
+        uint8_t primary = regularized ? regularizationPrimary(config, currentState) : 0;
+        if (primary) {
+            returnCode = regularizedSegment(primary, currentState, &time, &config.timeStep,
+                    config, workspace, writer, &closest, &closestMoon, &approach);
+            firstStageReady = FALSE;
+            continue;
+        }
+
+        /* Construct the stages */
+        if (!firstStageReady) {
+            memcpy(workspace->k[0], currentState, config.stateSize*sizeof(double));
+            (function)(time, workspace->k[0]);
+            firstStageReady = TRUE;
+            STATS(workspace->stats.evaluations++);
+        }
+        uint8_t status = stages(function, time, currentState, config.timeStep,
+                config.stateSize, tableau, workspace->k);
+        STATS(workspace->stats.evaluations += tableau->stages - 1);
+
+        /* Construct the solution and its scaled local error estimate */
+        double error = solution(currentState, config.timeStep, config.stateSize, tableau,
+                control, workspace->k, workspace->next);
+        uint8_t accepted = (error <= 1);
+        double factor = stepFactor(control, error, config.timeStep, &controller);
+
+        STATS(statsStep(&workspace->stats, config.timeStep, accepted));
 
 		/* If the accuracy is acceptable, */
-		if (norm/config.timeStep <= RK45_TOL) {
-
-			/* Increment the current time, and copy the new state */
-			time += config.timeStep;
-			memcpy(currentState, possibleSolution, config.stateSize*sizeof(double));
+		if (accepted) {
+
+            /* Derivative at the new state: the last stage of an FSAL tableau, otherwise
+             * evaluated here and reused as the next step's first stage */
+            uint8_t last = tableau->fsal ? tableau->stages - 1 : 1;
+            if (!tableau->fsal) {
+                memcpy(workspace->k[last], workspace->next, config.stateSize*sizeof(double));
+                status = (function)(time + config.timeStep, workspace->k[last]);
+                STATS(workspace->stats.evaluations++);
+            }
+
+            /* Locate a terminal event on the dense output of the step */
+            double eventTime, eventState[config.stateSize];
+            returnCode = locateEvent(currentState, workspace->k[0], workspace->next,
+                    workspace->k[last], time, config.timeStep, config.stateSize,
+                    &eventTime, eventState, &approach);
+
+			/* Increment the current time, and copy the new state (or the event state) */
+            if (returnCode != 0) {
+                time = eventTime;
+                memcpy(currentState, eventState, config.stateSize*sizeof(double));
+            } else {
+			    time += config.timeStep;
+			    memcpy(currentState, workspace->next, config.stateSize*sizeof(double));
+
+                /* Terminations without an event function (a perturber collision) end
+                 * the trajectory at the end of the step */
+                returnCode = status;
+            }
+            double distance = distanceEarthSquared(currentState);
+            if (distance < closest) {
+                closest = distance;
+                if (workspace->closestEarthState != NULL)
+                    memcpy(workspace->closestEarthState, currentState, config.stateSize*sizeof(double));
+            }
+            if (workspace->closestMoonState != NULL && distanceMoonSquared(currentState) < closestMoon) {
+                closestMoon = distanceMoonSquared(currentState);
+                memcpy(workspace->closestMoonState, currentState, config.stateSize*sizeof(double));
+            }
+
+            /* The derivative at the new state is the next step's first stage */
+            double *first = workspace->k[0];
+            workspace->k[0] = workspace->k[last];
+            workspace->k[last] = first;
 		    
             /* Write the resulting state to the output file */
-		    if (config.loggingEnabled) 
-                write(file, currentState, config.stateSize, time);
+		    if (writer != NULL) 
+                writeTrajectory(writer, time, currentState);
         
-            /* Check for a collision */ // TODO: This function should be a parameter to rk45
-            returnCode = checkCollisionArray(currentState);
             if (returnCode != 0) break;
 		} 
-		/* Increment time step */
-		config.timeStep *= delta;
+		/* Next step, within the longest one */
+		config.timeStep = fmin(config.timeStep*factor, control->maxStep);
 	}
-    /* Close file, free memory, etc. */
-	if (config.loggingEnabled) fclose(file);
+    /* Close file, etc. */
+	if (writer != NULL) closeTrajectory(writer);
 	(*stopTime) = time;
-    freeAll();
+    workspace->closestEarth = sqrt(closest);
+    workspace->closestMoon = approach;
+    STATS(statsEnd(&workspace->stats, returnCode));
 	return returnCode;
 }
 
-void constructK1(uint8_t (*func)(double t, double *s), double t, double *s, 
-                 configuration_t config) {
+uint8_t regularizationPrimary(configuration_t config, const double *state) {
 
-	/* Initialize first true buffer with the state */
-	memcpy(k1, s, config.stateSize*sizeof(double));
-	(func)(t, k1);	
-
-	multiplyState(k1, config.timeStep, config.stateSize);
-
-	/* Reset copies, initialize next buffer with k1 */
-	memcpy(k1c, k1, config.stateSize*sizeof(double));
-	memcpy(k2,  k1, config.stateSize*sizeof(double));
+    if (distanceEarthSquared(state) < config.regularizeEarth*config.regularizeEarth)
+        return BODY_EARTH;
+    if (distanceMoonSquared(state) < config.regularizeMoon*config.regularizeMoon)
+        return BODY_MOON;
+    return 0;
 }
 
-
-void constructK2(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config) {
-
-	multiplyState(k2, K2_K1_COEF, config.stateSize);
-	incrementState(k2, s, config.stateSize);
-
-	(func)(t + config.timeStep*K2_H_COEF, k2);
-	multiplyState(k2, config.timeStep, config.stateSize);
-	
-	/* Reset copies, initialize next buffer with k2 */
-	memcpy(k2c, k2, config.stateSize*sizeof(double));
-	memcpy(k3,  k2, config.stateSize*sizeof(double));
+uint8_t regularizedSegment(uint8_t primary, double *state, double *time,
+        double *timeStep, configuration_t config, workspace_t *workspace,
+        trajectory_writer_t *writer, double *closest, double *closestMoon,
+        approach_t *approach) {
+
+    uint8_t (*function)(double s, double *stateVector) =
+        (primary == BODY_EARTH) ? &regularizedEarth : &regularizedMoon;
+    event_map_t map = (primary == BODY_EARTH) ? &physicalEarth : &physicalMoon;
+    double radius = REGULARIZATION_HYSTERESIS*
+        (primary == BODY_EARTH ? config.regularizeEarth : config.regularizeMoon);
+    const tableau_t *tableau = config.tableau;
+
+    /* Fictitious time step from the physical one, dt = r ds */
+    double current[REGULARIZED_STATE_SIZE];
+    regularize(primary, state, *time, current);
+    double r = current[0]*current[0] + current[1]*current[1];
+    double s = 0, h = *timeStep/r;
+    step_state_t controller = STEP_STATE_INIT;
+    uint8_t returnCode = 0;
+
+    memcpy(workspace->k[0], current, sizeof(current));
+    (function)(s, workspace->k[0]);
+    STATS(workspace->stats.evaluations++);
+
+    while (*time <= timeLimit(config)) {
+
+        constructStages(function, s, current, h, REGULARIZED_STATE_SIZE, tableau, workspace->k);
+        STATS(workspace->stats.evaluations += tableau->stages - 1);
+        double duration;
+        double error = regularizedSolution(map, current, h, tableau, &config.control,
+                workspace->k, workspace->next, &duration);
+        uint8_t accepted = (error <= 1);
+        double factor = stepFactor(&config.control, error, h, &controller);
+        STATS(statsStep(&workspace->stats, duration, accepted));
+
+        if (accepted) {
+            uint8_t last = tableau->fsal ? tableau->stages - 1 : 1;
+            if (!tableau->fsal) {
+                memcpy(workspace->k[last], workspace->next, sizeof(current));
+                (function)(s + h, workspace->k[last]);
+                STATS(workspace->stats.evaluations++);
+            }
+
+            /* Events on the dense output in the fictitious time, at physical states */
+            double eventTime, eventState[REGULARIZED_STATE_SIZE];
+            returnCode = locateEventMapped(current, workspace->k[0], workspace->next,
+                    workspace->k[last], s, h, REGULARIZED_STATE_SIZE, &eventTime, eventState,
+                    approach, map);
+            s += h;
+            memcpy(current, workspace->next, sizeof(current));
+            if (returnCode != 0) {
+                *time = eventTime;
+                memcpy(state, eventState, THREE_BODY_STATE_SIZE*sizeof(double));
+            } else
+                map(current, state, time);
+
+            double distance = distanceEarthSquared(state);
+            if (distance < *closest) {
+                *closest = distance;
+                if (workspace->closestEarthState != NULL)
+                    memcpy(workspace->closestEarthState, state, THREE_BODY_STATE_SIZE*sizeof(double));
+            }
+            if (workspace->closestMoonState != NULL && distanceMoonSquared(state) < *closestMoon) {
+                *closestMoon = distanceMoonSquared(state);
+                memcpy(workspace->closestMoonState, state, THREE_BODY_STATE_SIZE*sizeof(double));
+            }
+
+            double *first = workspace->k[0];
+            workspace->k[0] = workspace->k[last];
+            workspace->k[last] = first;
+
+            if (writer != NULL)
+                writeTrajectory(writer, *time, state);
+
+            r = current[0]*current[0] + current[1]*current[1];
+            if (returnCode != 0 || r > radius) break;
+        }
+        /* The longest step is a physical duration, dt = r ds */
+        h = fmin(h*factor, config.control.maxStep/r);
+    }
+    *timeStep = h*r;
+    return returnCode;
 }
 
-void constructK3(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config) {
-
-	multiplyState(k1c, K3_K1_COEF, config.stateSize);
-	multiplyState(k3,  K3_K2_COEF, config.stateSize);
-
-	incrementState(k3, s, config.stateSize);
-	incrementState(k3, k1c, config.stateSize);
-
-	(func)(t + config.timeStep*K3_H_COEF, k3);
-	multiplyState(k3, config.timeStep, config.stateSize);
-
-	/* Reset copies, initialize next buffer with k3 */
-	memcpy(k3c, k3, config.stateSize*sizeof(double));
-	memcpy(k1c, k1, config.stateSize*sizeof(double));
-	memcpy(k4,  k3, config.stateSize*sizeof(double));
+double regularizedSolution(event_map_t map, const double *state, double h,
+        const tableau_t *tableau, const step_control_t *control, double **k, double *next,
+        double *duration) {
+
+    /* Both solutions of the pair */
+    double embedded[REGULARIZED_STATE_SIZE];
+    for (uint8_t i = 0; i < REGULARIZED_STATE_SIZE; i++) {
+        double increment = 0, error = 0;
+        for (uint8_t j = 0; j < tableau->stages; j++) {
+            increment += tableau->b[j]*k[j][i];
+            error     += tableau->e[j]*k[j][i];
+        }
+        next[i] = state[i] + h*increment;
+        embedded[i] = next[i] - h*error;
+    }
 
+    /* Their difference in the three body state */
+    double physical[THREE_BODY_STATE_SIZE], other[THREE_BODY_STATE_SIZE], time, otherTime;
+    double error[THREE_BODY_STATE_SIZE];
+    map(next, physical, &time);
+    map(embedded, other, &otherTime);
+    for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++)
+        error[i] = physical[i] - other[i];
+
+    /* A time error displaces the spacecraft along its velocity relative to the primary,
+     * dz/dt = 2u'u/r */
+    double r = next[0]*next[0] + next[1]*next[1], lag = time - otherTime;
+    error[0] += 2*(next[2]*next[0] - next[3]*next[1])/r*lag;
+    error[1] += 2*(next[2]*next[1] + next[3]*next[0])/r*lag;
+    *duration = time - state[REGULARIZED_TIME];
+    return scaledNorm(error, physical, other, THREE_BODY_STATE_SIZE, control);
 }
 
-void constructK4(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config) {
-
-	multiplyState(k1c, K4_K1_COEF, config.stateSize);	
-	multiplyState(k2c, K4_K2_COEF, config.stateSize);
-	multiplyState(k4,  K4_K3_COEF, config.stateSize);
-
-	incrementState(k4, s, config.stateSize);
-	incrementState(k4, k1c, config.stateSize);
-	incrementState(k4, k2c, config.stateSize);
-
-	(func)(t + config.timeStep*K4_H_COEF, k4);
-	multiplyState(k4, config.timeStep, config.stateSize);
+double scaledNorm(const double *error, const double *a, const double *b,
+        uint8_t size, const step_control_t *control) {
 
-	/* Reset copies, initialize next buffer with k4 */
-	memcpy(k4c, k4, config.stateSize*sizeof(double));
-	memcpy(k1c, k1, config.stateSize*sizeof(double));
-	memcpy(k2c, k2, config.stateSize*sizeof(double));
-	memcpy(k5,  k4, config.stateSize*sizeof(double));
+    double sum = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        double scale = control->absolute[i % BODY_STATE_SIZE] +
+            control->relative[i % BODY_STATE_SIZE]*fmax(fabs(a[i]), fabs(b[i]));
+        sum += (error[i]/scale)*(error[i]/scale);
+    }
+    return sqrt(sum/size);
 }
 
-void constructK5(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config) {
-
-	multiplyState(k1c, K5_K1_COEF, config.stateSize);
-	multiplyState(k2c, K5_K2_COEF, config.stateSize);
-	multiplyState(k3c, K5_K3_COEF, config.stateSize);
-	multiplyState(k5,  K5_K4_COEF, config.stateSize);
-
-	incrementState(k5, s, config.stateSize);
-	incrementState(k5, k1c, config.stateSize);
-	incrementState(k5, k2c, config.stateSize);
-	incrementState(k5, k3c, config.stateSize);
+double stepFactor(const step_control_t *control, double error, double h,
+        step_state_t *state) {
 
-	(func)(t + config.timeStep*K5_H_COEF, k5);
-	multiplyState(k5, config.timeStep, config.stateSize);
-	
-	/* Reset copies, initialize next buffer with k5 */	
-	memcpy(k5c, k5, config.stateSize*sizeof(double));
-	memcpy(k1c, k1, config.stateSize*sizeof(double));
-	memcpy(k2c, k2, config.stateSize*sizeof(double));
-	memcpy(k3c, k3, config.stateSize*sizeof(double));
-	memcpy(k6,  k5, config.stateSize*sizeof(double));
+    double factor = controlFactor(control, error, h, state->previousError,
+            state->previousStep, state->rejected);
+    if (error > 1) {
+        state->rejected = TRUE;
+        return factor;
+    }
+    state->previousError = fmax(error, RK45_MIN_ERROR);
+    state->previousStep = h;
+    state->rejected = FALSE;
+    return factor;
 }
 
-void constructK6(uint8_t (*func)(double t, double *s), double t, double *s, 
-                        configuration_t config) {
-	multiplyState(k1c, K5_K1_COEF, config.stateSize);
-	multiplyState(k2c, K5_K1_COEF, config.stateSize);
-	multiplyState(k3c, K5_K1_COEF, config.stateSize);
-	multiplyState(k4c, K5_K1_COEF, config.stateSize);
-	multiplyState(k6,  K5_K1_COEF, config.stateSize);
-
-	incrementState(k6, s, config.stateSize);
-	incrementState(k6, k1c, config.stateSize);
-	incrementState(k6, k2c, config.stateSize);
-	incrementState(k6, k3c, config.stateSize);
-	incrementState(k6, k4c, config.stateSize);
-
-	(func)(t + config.timeStep*K6_H_COEF, k6);
-	multiplyState(k6, config.timeStep, config.stateSize);
-
-	/* Reset copies */
-	memcpy(k6c, k6, config.stateSize*sizeof(double));
-	memcpy(k1c, k1, config.stateSize*sizeof(double));
-	memcpy(k2c, k2, config.stateSize*sizeof(double));
-	memcpy(k3c, k3, config.stateSize*sizeof(double));
-	memcpy(k4c, k4, config.stateSize*sizeof(double));
+double initialStep(uint8_t (*function)(double time, double *stateVector), double time,
+        const double *state, const double *derivative, uint8_t size,
+        const step_control_t *control) {
+
+    /* Step over which the state moves by about 1% of its scale, limited to 100 times */
+    double scaledState = scaledNorm(state, state, state, size, control);
+    double scaledDerivative = scaledNorm(derivative, state, state, size, control);
+    double h0 = (scaledState < 1E-5 || scaledDerivative < 1E-5) ? 1E-6 :
+        0.01*scaledState/scaledDerivative;
+    h0 = fmin(h0, control->maxStep);
+
+    /* Second derivative from an explicit Euler step, and the step over which the Euler
+     * error h^2/2 |y''| reaches the tolerance: the higher order pair is well within it */
+    double probe[size], change[size];
+    for (uint8_t i = 0; i < size; i++)
+        probe[i] = state[i] + h0*derivative[i];
+    (function)(time + h0, probe);
+    for (uint8_t i = 0; i < size; i++)
+        change[i] = (probe[i] - derivative[i])/h0;
+    double scaledChange = scaledNorm(change, state, state, size, control);
+    double h1 = (scaledChange <= 1E-15) ? 100*h0 : sqrt(2/scaledChange);
+    return fmin(fmin(100*h0, h1), control->maxStep);
 }
 
-void constructB(double *B, double *state, configuration_t config) {
-
-	memcpy(B, state, config.stateSize*sizeof(double));
-
-    multiplyState(k1c, STATE_B_K1_COEF, config.stateSize);
-    multiplyState(k3c, STATE_B_K3_COEF, config.stateSize);
-    multiplyState(k4c, STATE_B_K4_COEF, config.stateSize);
-    multiplyState(k5c, STATE_B_K5_COEF, config.stateSize);
-    multiplyState(k6c, STATE_B_K6_COEF, config.stateSize);
-
-    incrementState(B, k1c, config.stateSize);
-    incrementState(B, k3c, config.stateSize);
-    incrementState(B, k4c, config.stateSize);
-    incrementState(B, k5c, config.stateSize);
-    incrementState(B, k6c, config.stateSize);
+uint8_t constructStages(uint8_t (*function)(double time, double *stateVector),
+        double time, const double *state, double h, uint8_t size, const tableau_t *tableau,
+        double **k) {
+
+    uint8_t status = 0;
+    for (uint8_t stage = 1; stage < tableau->stages; stage++) {
+
+        /* Stage argument: state plus the weighted sum of the previous stages */
+        double *argument = k[stage];
+        for (uint8_t i = 0; i < size; i++) {
+            double sum = 0;
+            for (uint8_t j = 0; j < stage; j++)
+                sum += tableau->a[stage][j]*k[j][i];
+            argument[i] = state[i] + h*sum;
+        }
+        status = (function)(time + h*tableau->c[stage], argument);
+    }
+    return status;
 }
 
-void constructA(double *A, double *state, configuration_t config) {
+double constructSolution(const double *state, double h, uint8_t size,
+        const tableau_t *tableau, const step_control_t *control, double **k, double *next) {
+
+    /* Solution and error estimate in the same pass */
+    double error[size];
+    for (uint8_t i = 0; i < size; i++) {
+        double increment = 0, sum = 0;
+        for (uint8_t j = 0; j < tableau->stages; j++) {
+            increment += tableau->b[j]*k[j][i];
+            sum       += tableau->e[j]*k[j][i];
+        }
+        next[i] = state[i] + h*increment;
+        error[i] = h*sum;
+    }
+    return scaledNorm(error, state, next, size, control);
+}
 
-    memcpy(A, state, config.stateSize*sizeof(double));
-	
-    multiplyState(k1c, STATE_A_K1_COEF, config.stateSize);
-    multiplyState(k3c, STATE_A_K3_COEF, config.stateSize);
-    multiplyState(k4c, STATE_A_K4_COEF, config.stateSize);
-    multiplyState(k5c, STATE_A_K5_COEF, config.stateSize);
-
-    incrementState(A, k1c, config.stateSize);
-    incrementState(A, k3c, config.stateSize);
-    incrementState(A, k4c, config.stateSize);
-    incrementState(A, k5c, config.stateSize);
-
-    /* Reset copies */
-    memcpy(k1c, k1, config.stateSize*sizeof(double));
-    memcpy(k2c, k2, config.stateSize*sizeof(double));
-    memcpy(k3c, k3, config.stateSize*sizeof(double));
-    memcpy(k3c, k4, config.stateSize*sizeof(double));
+void selectKernels(uint8_t size, const tableau_t *tableau, stages_kernel_t *stages,
+        solution_kernel_t *solution) {
+
+    *stages = &constructStages;
+    *solution = &constructSolution;
+    if (size != THREE_BODY_STATE_SIZE) return;
+
+    /* The built-in tableaus are recognized by address */
+    if (tableau == &RKF45_TABLEAU) {
+        *stages = &constructStagesRkf45;
+        *solution = &constructSolutionRkf45;
+    } else if (tableau == &CASH_KARP_TABLEAU) {
+        *stages = &constructStagesCashKarp;
+        *solution = &constructSolutionCashKarp;
+    } else if (tableau == &DORMAND_PRINCE_TABLEAU) {
+        *stages = &constructStagesDormandPrince;
+        *solution = &constructSolutionDormandPrince;
+    }
 }
 
 uint8_t euler(uint8_t (*function)(double time, double *stateVector),
-			   double *initialConditions, configuration_t config, double *stopTime) {
+			   double *initialConditions, configuration_t config, workspace_t *workspace,
+			   double *stopTime) {
 
-	/* Declare buffers for state & state derivative */
+	/* Declare buffers for state & state derivative (derivative lives in the workspace) */
 	double currentState[config.stateSize];
-	double stateDerivative[config.stateSize];
+	double *stateDerivative = workspace->k[0];
 
 	/* Fill the buffers with the initial conditions */	
 	memcpy(currentState, initialConditions, config.stateSize*sizeof(double));
 	memcpy(stateDerivative, initialConditions, config.stateSize*sizeof(double));
 
 	/* Open the output file and write the initial state */
-    FILE *file;
-	if (config.loggingEnabled) {
-        file = fopen(config.fileName, "w");
-	    write(file, initialConditions, config.stateSize, (double)0);
-    }
+    trajectory_writer_t *writer = NULL;
+	if (config.loggingEnabled) 
+        writer = openTrajectory(config.fileName, config.stateSize);
+	if (writer != NULL)
+	    writeTrajectory(writer, (double)0, initialConditions);
+    double closest = distanceEarthSquared(currentState);
+    approach_t approach = { INFINITY, 0 };
+    STATS(statsBegin(&workspace->stats));
+
 	/* For every time step */
 	for (double currentTime = config.startTime; currentTime < config.endTime; 
 					currentTime += config.timeStep) {
@@ -344,9 +540,14 @@ uint8_t euler(uint8_t (*function)(double time, double *stateVector),
 
 		/* Get the state, and check if a terminal condition occurred */
 		uint8_t returnCode = (function)(currentTime, stateDerivative);
+        observeApproach(&approach, currentState, currentTime);
+        STATS(workspace->stats.evaluations++);
 		if (returnCode != 0) {
-			if (config.loggingEnabled)  fclose(file);
+			if (writer != NULL) closeTrajectory(writer);
             *stopTime = currentTime;
+            workspace->closestEarth = sqrt(closest);
+            workspace->closestMoon = approach;
+            STATS(statsEnd(&workspace->stats, returnCode));
 			return returnCode;
 		}
 		/* Compute the derivative, multiply by time */
@@ -354,25 +555,142 @@ uint8_t euler(uint8_t (*function)(double time, double *stateVector),
 
 		/* Increment the current state by the derivative multiplied by time */
 		incrementState(currentState, stateDerivative, config.stateSize);
+        closest = fmin(closest, distanceEarthSquared(currentState));
+        STATS(statsStep(&workspace->stats, config.timeStep, TRUE));
 
 		/* Write the resulting state to the ouptut file */
-		if (config.loggingEnabled) write(file, currentState, config.stateSize, currentTime);
+		if (writer != NULL) writeTrajectory(writer, currentTime, currentState);
 	}
     /* Close file and return success */
-	if (config.loggingEnabled) fclose(file);
+	if (writer != NULL) closeTrajectory(writer);
     *stopTime = config.endTime;
+    workspace->closestEarth = sqrt(closest);
+    workspace->closestMoon = approach;
+    STATS(statsEnd(&workspace->stats, 0));
 	return 0;
 }
 
-void write(FILE *file, double *state, uint8_t stateSize, double time) {
+uint8_t leapfrog(uint8_t (*function)(double time, double *stateVector),
+			   double *initialConditions, configuration_t config, workspace_t *workspace,
+			   double *stopTime) {
+
+    const double weights[] = { 1.0 };
+    return symplectic(function, initialConditions, config, workspace, stopTime, weights, 1);
+}
+
+uint8_t forestRuth(uint8_t (*function)(double time, double *stateVector),
+			   double *initialConditions, configuration_t config, workspace_t *workspace,
+			   double *stopTime) {
+
+    const double weights[] = { FOREST_RUTH_W1, FOREST_RUTH_W0, FOREST_RUTH_W1 };
+    return symplectic(function, initialConditions, config, workspace, stopTime, weights, 3);
+}
+
+uint8_t symplectic(uint8_t (*function)(double time, double *stateVector),
+        double *initialConditions, configuration_t config, workspace_t *workspace,
+        double *stopTime, const double *weights, uint8_t substeps) {
+
+    double currentState[config.stateSize];
+    memcpy(currentState, initialConditions, config.stateSize*sizeof(double));
+    double h = config.timeStep;
+
+    trajectory_writer_t *writer = NULL;
+    if (config.loggingEnabled)
+        writer = openTrajectory(config.fileName, config.stateSize);
+    if (writer != NULL)
+        writeTrajectory(writer, (double)0, initialConditions);
+
+    /* Derivative at the current state (k[0]) and at the new one (k[1]); the last
+     * evaluation of a step is the first kick of the next */
+    double *current = workspace->k[0], *next = workspace->k[1], *substep = workspace->k[2];
+    memcpy(current, currentState, config.stateSize*sizeof(double));
+    (function)(0, current);
+
+    double time = 0;
+    uint8_t returnCode = 0;
+    double closest = distanceEarthSquared(currentState);
+    approach_t approach = { INFINITY, 0 };
+    observeApproach(&approach, currentState, time);
+    STATS(statsBegin(&workspace->stats));
+    STATS(workspace->stats.evaluations++);
+
+    while (returnCode == 0 && time <= timeLimit(config)) {
+
+        /* Kick, drift, kick for every substep, from the current state into next */
+        double *candidate = workspace->next, elapsed = 0;
+        const double *acceleration = current;
+        memcpy(candidate, currentState, config.stateSize*sizeof(double));
+        for (uint8_t index = 0; index < substeps; index++) {
+            double hw = weights[index]*h;
+            double *derivative = (index + 1 == substeps) ? next : substep;
+            kick(candidate, acceleration, 0.5*hw, config.stateSize);
+            drift(candidate, hw, config.stateSize);
+            elapsed += hw;
+            memcpy(derivative, candidate, config.stateSize*sizeof(double));
+            (function)(time + elapsed, derivative);
+            kick(candidate, derivative, 0.5*hw, config.stateSize);
+            acceleration = derivative;
+        }
+        STATS(workspace->stats.evaluations += substeps);
+        STATS(statsStep(&workspace->stats, h, TRUE));
+
+        /* The derivative at the new state was evaluated before the last kick, so only
+         * its velocity entries (the position derivatives) need the kicked velocities */
+        for (uint8_t body = 0; body < config.stateSize/BODY_STATE_SIZE; body++) {
+            next[BODY_STATE_SIZE*body]     = candidate[BODY_STATE_SIZE*body + 2];
+            next[BODY_STATE_SIZE*body + 1] = candidate[BODY_STATE_SIZE*body + 3];
+        }
+
+        /* Locate a terminal event on the dense output of the step */
+        double eventTime, eventState[config.stateSize];
+        returnCode = locateEvent(currentState, current, candidate, next, time, h,
+                config.stateSize, &eventTime, eventState, &approach);
+        if (returnCode != 0) {
+            time = eventTime;
+            memcpy(currentState, eventState, config.stateSize*sizeof(double));
+        } else {
+            time += h;
+            memcpy(currentState, candidate, config.stateSize*sizeof(double));
+        }
+        closest = fmin(closest, distanceEarthSquared(currentState));
+
+        double *swap = current;
+        current = next;
+        next = swap;
+
+        if (writer != NULL)
+            writeTrajectory(writer, time, currentState);
+    }
+    if (writer != NULL) closeTrajectory(writer);
+    *stopTime = time;
+    workspace->closestEarth = sqrt(closest);
+    workspace->closestMoon = approach;
+    STATS(statsEnd(&workspace->stats, returnCode));
+    return returnCode;
+}
+
+void kick(double *state, const double *derivative, double h, uint8_t size) {
+
+    for (uint8_t body = 0; body < size/BODY_STATE_SIZE; body++) {
+        state[BODY_STATE_SIZE*body + 2] += h*derivative[BODY_STATE_SIZE*body + 2];
+        state[BODY_STATE_SIZE*body + 3] += h*derivative[BODY_STATE_SIZE*body + 3];
+    }
+}
+
+void drift(double *state, double h, uint8_t size) {
+
+    for (uint8_t body = 0; body < size/BODY_STATE_SIZE; body++) {
+        state[BODY_STATE_SIZE*body]     += h*state[BODY_STATE_SIZE*body + 2];
+        state[BODY_STATE_SIZE*body + 1] += h*state[BODY_STATE_SIZE*body + 3];
+    }
+}
 
-	/* First column is time */
-	fprintf(file, "%f ", time);
+double distanceEarthSquared(const double *state) {
+    return (state[0] - state[4])*(state[0] - state[4]) + (state[1] - state[5])*(state[1] - state[5]);
+}
 
-	/* Write each element of the state to the file, followed by new line */	
-	for (uint8_t index = 0; index < stateSize; index++) 
-		fprintf(file, "%f ", state[index]);
-	fprintf(file, "\n");	
+double distanceMoonSquared(const double *state) {
+    return (state[0] - state[8])*(state[0] - state[8]) + (state[1] - state[9])*(state[1] - state[9]);
 }
 
 void multiplyState(double *state, double coeff, uint8_t length) {
@@ -389,34 +707,6 @@ void incrementState(double *state, double *increment, uint8_t length) {
 		state[index] += increment[index];	
 }	
 
-void allocate(configuration_t config, double **a, double **b, double **c, 
-                                             double **d, double **e, double **f) {
-    /* Allocate memory for each pointer (a-f) */
-    (*a) = (double *)calloc(config.stateSize, sizeof(double));
-    (*b) = (double *)calloc(config.stateSize, sizeof(double));
-    (*c) = (double *)calloc(config.stateSize, sizeof(double));
-    (*d) = (double *)calloc(config.stateSize, sizeof(double));
-    (*e) = (double *)calloc(config.stateSize, sizeof(double));
-    (*f) = (double *)calloc(config.stateSize, sizeof(double));
-}
-
-void freeAll() {
-
-    /* Free the memory of all static arrays */
-    free(k1);
-    free(k2);
-    free(k3);
-    free(k4);
-    free(k5);
-    free(k6);
-    free(k1c);
-    free(k2c);
-    free(k3c);
-    free(k4c);
-    free(k5c);
-    free(k6c);
-}
-
 void printState(double *state) {
 	printf("\tSPACECRAFT POSITION X:\t\t%.6f\n", state[0]);
 	printf("\tSPACECRAFT POSITION Y:\t\t%.6f\n", state[1]);
@@ -8,15 +8,112 @@
 #include <math.h>
 
 #include "rk45_constants.h"
+#include "tableau.h"
 #include "equations.h"
+#include "events.h"
+#include "regularization.h"
+#include "trajectory.h"
 #include "configuration.h"
+#include "control.h"
+#include "stats.h"
+
+#define WORKSPACE_BUFFERS 	(TABLEAU_MAX_STAGES + 1)
+
+/* Forest Ruth (fourth order Yoshida) composition of three leapfrog steps: w1, w0, w1 */
+#define FOREST_RUTH_W1 		(1.35120719195965763405)
+#define FOREST_RUTH_W0 		(-1.70241438391931526810)
+
+/**
+ * Scratch buffers for a single integration. Created once by the caller and reused
+ * across integrations; each thread must own its own workspace.
+ */
+typedef struct {
+	uint8_t stateSize;
+
+	/* Stage derivatives */
+	double *k[TABLEAU_MAX_STAGES];
+
+	/* Candidate solution of the current step */
+	double *next;
+
+	/* Closest approach of the spacecraft to the Earth's centre in the last integration */
+	double closestEarth;
+
+	/* Optional, stateSize entries each, set by the caller: receive the states of the
+	 * closest approaches to the Earth and to the Moon, among the ends of the accepted
+	 * steps (rk45() only) */
+	double *closestEarthState;
+	double *closestMoonState;
+
+	/* Closest approach to the Moon in the last integration, among the states where
+	 * events were checked */
+	approach_t closestMoon;
+
+#ifdef INTEGRATOR_STATS
+	/* Counters of the last integration */
+	integrator_stats_t stats;
+#endif
+} workspace_t;
+
+/**
+ * Allocate a workspace for states of the given size, NULL on failure. The buffers hold
+ * at least REGULARIZED_STATE_SIZE entries, for the regularized segments of rk45().
+ */
+workspace_t *createWorkspace(uint8_t stateSize);
+
+/* Release a workspace */
+void destroyWorkspace(workspace_t *workspace);
+
+/* Time at which integration stops: endTime, or the shared time bound if earlier */
+double timeLimit(configuration_t config);
+
+/**
+ * Factor of the next step of rk45() after a step h with the scaled error error (see
+ * step_control_t), from the proportional integral controller of control, limited by
+ * Gustafsson's predictive controller so a step growing into a harder region does not
+ * overshoot and get rejected. The step was accepted if error <= 1.
+ */
+double stepFactor(const step_control_t *control, double error, double h,
+		step_state_t *state);
+
+/**
+ * First step of rk45() from a state and its derivative at time, within control->maxStep:
+ * the step whose explicit Euler error is about the tolerance, the second derivative taken
+ * from an Euler probe. Costs one evaluation of function.
+ */
+double initialStep(uint8_t (*function)(double time, double *stateVector), double time,
+		const double *state, const double *derivative, uint8_t size,
+		const step_control_t *control);
 
 /* Main integration function */
 uint8_t euler(uint8_t (*function)(double time, double *stateVector),
-    double *initialConditions, configuration_t configIn, double *stopTime);
+    double *initialConditions, configuration_t configIn, workspace_t *workspace,
+    double *stopTime);
+
+/**
+ * Symplectic fixed step integration (kick, drift, kick): one evaluation per step. The
+ * state is split per body into positions and velocities (BODY_STATE_SIZE entries), so
+ * the energy error stays bounded at steps far longer than euler() needs. Terminal
+ * events are located on the dense output of every step, like in rk45().
+ */
+uint8_t leapfrog(uint8_t (*function)(double time, double *stateVector),
+		double *initialConditions, configuration_t config, workspace_t *workspace,
+		double *stopTime);
+
+/* Fourth order symplectic integration: three leapfrog substeps per step */
+uint8_t forestRuth(uint8_t (*function)(double time, double *stateVector),
+		double *initialConditions, configuration_t config, workspace_t *workspace,
+		double *stopTime);
 
-/* Runge Kutta 45 integration */
+/**
+ * Embedded Runge Kutta integration with the tableau in config.tableau. With equations()
+ * on the three body state, the spacecraft is integrated in Levi-Civita variables about
+ * the Earth or the Moon (see regularization.h) from the end of a step inside
+ * config.regularizeEarth or config.regularizeMoon of its centre until it leaves that
+ * sphere, with the same tableau and tolerance.
+ */
 uint8_t rk45(uint8_t (*function)(double time, double *stateVector),
-		double *initialConditions, configuration_t config, double *stopTime);
+		double *initialConditions, configuration_t config, workspace_t *workspace,
+		double *stopTime);
 
 #endif /* _INTEGRATOR_H_ */
@@ -0,0 +1,82 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include <stdint.h>
+#include <math.h>
+
+#include "tableau.h"
+#include "configuration.h"
+
+/**
+ * Step kernels of rk45(). The stage kernel builds stages 2..n into k[1..n-1] (the
+ * first stage must already be in k[0]) and returns the code of the last evaluation,
+ * which for an FSAL tableau is the derivative at the new state; the solution kernel builds the propagated
+ * solution in next and returns the RMS of the local error estimate scaled by the
+ * tolerances of control (see step_control_t). Fixed-size kernels ignore the size and
+ * tableau arguments.
+ */
+typedef uint8_t (*stages_kernel_t)(uint8_t (*function)(double time, double *stateVector),
+		double time, const double *state, double h, uint8_t size, const tableau_t *tableau,
+		double **k);
+
+typedef double (*solution_kernel_t)(const double *state, double h, uint8_t size,
+		const tableau_t *tableau, const step_control_t *control, double **k, double *next);
+
+/**
+ * Define the kernels constructStages##NAME and constructSolution##NAME for a state of
+ * SIZE elements and the tableau initializer COEFFICIENTS (see tableau.h), both known at
+ * compile time. Every loop then has a constant trip count and constant coefficients,
+ * so the compiler unrolls them fully, drops the zero coefficients and keeps the
+ * partial sums in registers.
+ */
+#define DEFINE_STEP_KERNELS(NAME, SIZE, COEFFICIENTS) \
+\
+static uint8_t constructStages##NAME(uint8_t (*function)(double time, double *stateVector), \
+		double time, const double *restrict state, double h, uint8_t size, \
+		const tableau_t *unused, double **k) { \
+\
+	static const tableau_t tableau = COEFFICIENTS; \
+	(void)size; (void)unused; \
+\
+	uint8_t status = 0; \
+	_Pragma("GCC unroll 8") \
+	for (uint8_t stage = 1; stage < tableau.stages; stage++) { \
+		double *restrict argument = k[stage]; \
+		_Pragma("GCC unroll 16") \
+		for (uint8_t i = 0; i < (SIZE); i++) { \
+			double sum = 0; \
+			_Pragma("GCC unroll 8") \
+			for (uint8_t j = 0; j < stage; j++) \
+				sum += tableau.a[stage][j]*k[j][i]; \
+			argument[i] = state[i] + h*sum; \
+		} \
+		status = (function)(time + h*tableau.c[stage], argument); \
+	} \
+	return status; \
+} \
+\
+static double constructSolution##NAME(const double *restrict state, double h, uint8_t size, \
+		const tableau_t *unused, const step_control_t *control, double **k, \
+		double *restrict next) { \
+\
+	static const tableau_t tableau = COEFFICIENTS; \
+	(void)size; (void)unused; \
+\
+	double sum = 0; \
+	_Pragma("GCC unroll 16") \
+	for (uint8_t i = 0; i < (SIZE); i++) { \
+		double increment = 0, error = 0; \
+		_Pragma("GCC unroll 8") \
+		for (uint8_t j = 0; j < tableau.stages; j++) { \
+			increment += tableau.b[j]*k[j][i]; \
+			error     += tableau.e[j]*k[j][i]; \
+		} \
+		next[i] = state[i] + h*increment; \
+		double scale = control->absolute[i % BODY_STATE_SIZE] + \
+			control->relative[i % BODY_STATE_SIZE]*fmax(fabs(state[i]), fabs(next[i])); \
+		sum += (h*error/scale)*(h*error/scale); \
+	} \
+	return sqrt(sum/(SIZE)); \
+}
+
+#endif /* _KERNELS_H_ */
@@ -7,6 +7,7 @@
 #include "equations.h"
 #include "util.h"
 #include "optimizer.h"
+#include "swarm.h"
 
 //#define _DEBUG
 #define DEBUG_DVX (-1)
@@ -14,7 +15,9 @@
 
 int main(int argc, char *argv[]) {
 
-    clock_t start = clock();
+    /* Wall time, since sweeps run on several threads */
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     /* Parse command line arguments */
 	configuration_t configuration;
@@ -23,6 +26,7 @@ int main(int argc, char *argv[]) {
 
     /* Set the clearance of the spacecraft and moon */
 	setClearance((double)configuration.clearance);
+	if (configuration.bodies != NULL) setBodies(configuration.bodies);
 
     /* Initialize impulses and return time */
     double optdvx, optdvy, bestTime;
@@ -35,13 +39,18 @@ int main(int argc, char *argv[]) {
         case OBJECTIVE_2:
             bestTime = optimizeReturnTime(configuration, &optdvx, &optdvy);
             break;
+        case OBJECTIVE_PARETO:
+            optimizePareto(configuration, &optdvx, &optdvy);
+            break;
     }
 #else 
         optdvx = DEBUG_DVX;
         optdvy = DEBUG_DVY;
 #endif 
-    /* Create function pointer, initial conditions buffer */
-	uint8_t (*diffEquation)(double time, double *stateVector) = &equations;
+    /* Create function pointer, initial conditions buffer. The Moon ephemeris only lives
+     * during the search, the logged run integrates the full equations */
+    configuration.ephemeris = 0;
+	uint8_t (*diffEquation)(double time, double *stateVector) = selectEquations(configuration);
     double initialConditions[configuration.stateSize];  
     
     /* Get initial conditions for optimal configuration */
@@ -52,13 +61,22 @@ int main(int argc, char *argv[]) {
     /* Integrate optimal initial conditions with logging enabled */   
     double time;
     configuration.loggingEnabled = 1;
-	rk45(diffEquation, initialConditions, configuration, &time);
+    workspace_t *workspace = createWorkspace(configuration.stateSize);
+	rk45(diffEquation, initialConditions, configuration, workspace, &time);
+    destroyWorkspace(workspace);
 
     printf("\n\tSolution: (dvx, dvy) = (%.2f, %.2f)\n", optdvx, optdvy);
-    printf("\n\t* Output written to: %s\n\n", configuration.fileName);
+    printf("\n\t* Output written to: %s\n", configuration.fileName);
+    printf("\t  (convert to text with ./exe_trajectory_text %s)\n\n", configuration.fileName);
+
+    /* Massless particles dispersed around the solution */
+    if (configuration.swarm > 0) {
+        reportDispersion(configuration, configuration.swarm, optdvx, optdvy);
+        printf("\n");
+    }
 
-    clock_t end = clock();
-    double runTime = (double)(end - start)/CLOCKS_PER_SEC;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double runTime = (end.tv_sec - start.tv_sec) + 1E-9*(end.tv_nsec - start.tv_nsec);
     printf("Run time: %.3f seconds\n\n", runTime);
 
 	return EXIT_SUCCESS;
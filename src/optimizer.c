@@ -1,78 +1,370 @@
 #include "optimizer.h"
 
+/**
+ * Objective 1 cost: magnitude of the impulse for Earth-impacting candidates
+ */
+static uint8_t deltaVCost(candidate_t candidate, outcome_t outcome, double *cost);
+
+/**
+ * Objective 2 cost: return time for Earth-impacting candidates
+ */
+static uint8_t returnTimeCost(candidate_t candidate, outcome_t outcome, double *cost);
+
+/**
+ * Integrator and cost of an objective, in a new sweep. Returns whether the grid
+ * includes its upper limit.
+ */
+static uint8_t objectiveSweep(uint8_t objective, configuration_t configuration,
+		sweep_t *sweep);
+
+/**
+ * Fixed step integrator selected in the configuration
+ */
+static integrator_t fixedStepIntegrator(configuration_t configuration);
+
+/**
+ * Search the impulses in [-GRID_LIMIT, GRID_LIMIT]^2 with the strategy selected in the
+ * configuration. Returns FALSE if no candidate was feasible.
+ */
+static uint8_t searchImpulse(sweep_t *sweep, configuration_t configuration, uint8_t inclusive,
+		candidate_t *best, double *bestCost);
+
+/**
+ * Run the search strategy selected in the configuration
+ */
+static uint8_t runStrategy(sweep_t *sweep, configuration_t configuration, uint8_t inclusive,
+		candidate_t *best, double *bestCost);
 
-void optimizeDeltaV(configuration_t configuration, double *optdvx, double *optdvy) {
 
-	uint8_t (*diffEquation)(double time, double *stateVector) = &equations;
-	double initialConditions[configuration.stateSize];
-	fillInitialConditions(initialConditions, configuration.stateSize);
+void optimizeDeltaV(configuration_t configuration, double *optdvx, double *optdvy) {
 
-	double dv = 100000;
 	*optdvx = 0;
 	*optdvy = 0;
-    double stopTime;
-
-    printf("\nPerforming grid search for minimal delta V...\n");
-
-	for (double dvx = -100; dvx<= 100; dvx+=configuration.accuracy){
-		for (double dvy = -100; dvy<= 100; dvy+=configuration.accuracy){
-            if (dvx == 0 || dvy == 0) continue;
-
-            printf("\tTesting %.1f, %.1f\n", dvx, dvy); 
-			initialConditions[2]+=dvx;
-			initialConditions[3]+=dvy;
-
-            //uint8_t result = rk45(diffEquation, initialConditions, configuration, &stopTime);
-            uint8_t result = euler(diffEquation, initialConditions, configuration, &stopTime);
-            if (RESULT_COLLISION_EARTH == result) {
-				if (sqrt( powf(dvx, 2) + powf(dvy, 2) ) < dv){
-					dv = sqrt( powf(dvx, 2) + powf(dvy, 2));
-					*optdvx = dvx;
-					*optdvy = dvy;
-				}
-            }
-			initialConditions[2]-=dvx;
-			initialConditions[3]-=dvy;
-		}
+
+    printf("\nPerforming grid search for minimal delta V on %d threads...\n",
+            configuration.threads);
+
+	sweep_t sweep;
+	uint8_t inclusive = objectiveSweep(OBJECTIVE_1, configuration, &sweep);
+
+	candidate_t best;
+	double dv;
+	if (searchImpulse(&sweep, configuration, inclusive, &best, &dv)) {
+		*optdvx = best.dvx;
+		*optdvy = best.dvy;
 	}
+	STATS(printSummary(&sweep.stats));
 }
 
 
-double optimizeReturnTime(configuration_t configuration, double *optdvx, double *optdvy) {
+uint8_t optimizeObjective(configuration_t configuration, candidate_t *best, double *cost) {
 
-    /* Setup the function pointer to be integrated, fill the initial state */
-	uint8_t (*diffEquation)(double time, double *stateVector) = &equations;
-	double initialConditions[configuration.stateSize];
-	fillInitialConditions(initialConditions, configuration.stateSize);
+	sweep_t sweep;
+	uint8_t inclusive = objectiveSweep(configuration.objective, configuration, &sweep);
+	return searchImpulse(&sweep, configuration, inclusive, best, cost);
+}
+
+
+uint8_t optimizeClearances(configuration_t configuration, clearance_answer_t *answers,
+		uint8_t count) {
+
+	/* The grid alone integrates every candidate, and the first screening tier does not
+	 * keep the closest approaches of the second */
+	configuration.search = SEARCH_GRID;
+	configuration.screen = SCREEN_OFF;
+
+	sweep_t sweep;
+	uint8_t inclusive = objectiveSweep(configuration.objective, configuration, &sweep);
+	sweep.answers = answers;
+	sweep.answerCount = count;
+
+	double clearance = getClearance();
+	setClearance(0);
+	candidate_t best;
+	double cost;
+	searchImpulse(&sweep, configuration, inclusive, &best, &cost);
+	setClearance(clearance);
 
-    /* Initialize values for the delta V, and stop/start time */
+	uint8_t found = FALSE;
+	for (uint8_t k = 0; k < count; k++)
+		found |= answers[k].found;
+	return found;
+}
+
+
+uint8_t objectiveSweep(uint8_t objective, configuration_t configuration, sweep_t *sweep) {
+
+	memset(sweep, 0, sizeof(sweep_t));
+	if (objective == OBJECTIVE_1) {
+		/* Grid over [-100, 100] (inclusive), integrated with a fixed step */
+		sweep->integrator = fixedStepIntegrator(configuration);
+		sweep->cost = &deltaVCost;
+		return TRUE;
+	}
+	if (objective == OBJECTIVE_PARETO) {
+		/* Grid over [-100, 100], integrated with rk45 since the return times are kept.
+		 * Unbounded: slow returns still belong on the front */
+		sweep->integrator = &rk45;
+		sweep->cost = &deltaVCost;
+		sweep->batched = configuration.batched;
+		sweep->pareto = TRUE;
+		return TRUE;
+	}
+
+	/* Grid over [-100, 100), integrated with rk45. Candidates stop as soon as they are
+	 * slower than the best return time found so far */
+	sweep->integrator = &rk45;
+	sweep->cost = &returnTimeCost;
+	sweep->batched = configuration.batched;
+	sweep->bounded = TRUE;
+	atomic_init(&sweep->bound, configuration.endTime);
+	return FALSE;
+}
+
+
+integrator_t fixedStepIntegrator(configuration_t configuration) {
+
+	switch (configuration.integrator) {
+		case INTEGRATOR_LEAPFROG:
+			return &leapfrog;
+		case INTEGRATOR_FOREST_RUTH:
+			return &forestRuth;
+		default:
+			return &euler;
+	}
+}
+
+
+double optimizeReturnTime(configuration_t configuration, double *optdvx, double *optdvy) {
+
+    /* Initialize values for the delta V, and the best return time */
 	*optdvx = 0;
 	*optdvy = 0;
-    double stopTime = configuration.endTime;
     double bestTime = configuration.endTime;
 
-    for (double dvx = -100; dvx < 100; dvx+=configuration.accuracy) {
-        for (double dvy = -100; dvy < 100; dvy+=configuration.accuracy) {
-            if (dvx == 0 || dvy == 0) continue;
-            printf("%.1f, %.1f\n", dvx, dvy);
-			initialConditions[2]+=dvx;
-			initialConditions[3]+=dvy;
-
-            uint8_t result = rk45(diffEquation, initialConditions, configuration, &stopTime);
-            //uint8_t result = euler(diffEquation, initialConditions, configuration, &stopTime);
-
-            if (RESULT_COLLISION_EARTH == result) {
-                if (stopTime < bestTime) {
-                    bestTime = stopTime;
-					*optdvx = dvx;
-					*optdvy = dvy;
-                }
-            }
-		    initialConditions[2]-=dvx;
-			initialConditions[3]-=dvy;
-        }
-    }
+    printf("\nPerforming grid search for minimal return time on %d threads...\n",
+            configuration.threads);
+
+	sweep_t sweep;
+	uint8_t inclusive = objectiveSweep(OBJECTIVE_2, configuration, &sweep);
+
+	/* Ring order and shooting rely on the cost being the impulse magnitude */
+	if (configuration.search == SEARCH_RING || configuration.search == SEARCH_SHOOTING) {
+		printf("Ring order and shooting only apply to minimal delta V, searching the full grid\n");
+		configuration.search = SEARCH_GRID;
+	}
+
+	candidate_t best;
+	double stopTime;
+	if (searchImpulse(&sweep, configuration, inclusive, &best, &stopTime) &&
+			stopTime < bestTime) {
+		bestTime = stopTime;
+		*optdvx = best.dvx;
+		*optdvy = best.dvy;
+	}
+	STATS(printSummary(&sweep.stats));
     return bestTime;
 }
 
 
+void optimizePareto(configuration_t configuration, double *optdvx, double *optdvy) {
+
+	*optdvx = 0;
+	*optdvy = 0;
+
+    printf("\nPerforming grid search for the delta V and return time front on %d threads...\n",
+            configuration.threads);
+
+	/* The front needs the outcome of every grid point */
+	if (configuration.search != SEARCH_GRID || configuration.screen != SCREEN_OFF) {
+		printf("The front needs every candidate integrated, searching the full grid\n");
+		configuration.search = SEARCH_GRID;
+		configuration.screen = SCREEN_OFF;
+	}
+
+	sweep_t sweep;
+	uint8_t inclusive = objectiveSweep(OBJECTIVE_PARETO, configuration, &sweep);
+
+	candidate_t best;
+	double dv;
+	searchImpulse(&sweep, configuration, inclusive, &best, &dv);
+
+	printf("\n%u points on the front\n", sweep.frontCount);
+	printf("%10s %10s %12s %16s\n", "dvx", "dvy", "delta V", "return time");
+	for (uint32_t k = 0; k < sweep.frontCount; k++) {
+		pareto_point_t *point = &sweep.front[k];
+		printf("%10.2f %10.2f %8.2f m/s %14.2f s\n", point->candidate.dvx,
+				point->candidate.dvy, point->deltaV, point->returnTime);
+	}
+	if (sweep.frontCount > 0) {
+		*optdvx = sweep.front[0].candidate.dvx;
+		*optdvy = sweep.front[0].candidate.dvy;
+	}
+	free(sweep.front);
+	STATS(printSummary(&sweep.stats));
+}
+
+
+uint8_t searchImpulse(sweep_t *sweep, configuration_t configuration, uint8_t inclusive,
+		candidate_t *best, double *bestCost) {
+
+	/* The general N-body equations have no batched, screened or restricted form */
+	if (configuration.bodies != NULL) {
+		printf("N-body equations: %s, %d bodies\n", configuration.bodies->name,
+				configuration.bodies->count);
+		if (sweep->batched || configuration.ephemeris || configuration.screen)
+			printf("Batches, screening and the Moon ephemeris only cover the three body "
+					"equations, integrating one trajectory at a time\n");
+		sweep->batched = FALSE;
+		configuration.ephemeris = 0;
+		configuration.screen = SCREEN_OFF;
+		if (configuration.search == SEARCH_SHOOTING) {
+			printf("Shooting has variational equations for three bodies only, searching "
+					"the full grid\n");
+			configuration.search = SEARCH_GRID;
+		}
+	}
+
+	/* Shooting differentiates the full three body equations, not the restricted ones */
+	if (configuration.search == SEARCH_SHOOTING && configuration.ephemeris) {
+		printf("Shooting has variational equations for the full three body problem only, "
+				"ignoring the Moon ephemeris\n");
+		configuration.ephemeris = 0;
+	}
+
+	/* Restricted problem: integrate the Moon once, every trajectory reads the table */
+	ephemeris_t *ephemeris = NULL;
+	if (configuration.ephemeris) {
+		double nominal[THREE_BODY_STATE_SIZE];
+		fillInitialConditions(nominal, THREE_BODY_STATE_SIZE);
+		ephemeris = createEphemeris(nominal, configuration.endTime);
+		if (ephemeris == NULL) {
+			printf("Could not build the Moon ephemeris, using the full equations\n");
+			configuration.ephemeris = 0;
+		} else {
+			setEphemeris(ephemeris);
+			printf("Moon ephemeris: %u samples, interpolation error below %.2g m\n",
+					ephemeris->count, ephemeris->maxError);
+			printf("Against the full equations: Moon within %.2g m, spacecraft within "
+					"%.2g m and %.2g m/s\n", ephemeris->moonError, ephemeris->positionError,
+					ephemeris->velocityError);
+		}
+	}
+
+	/* Regularization is part of rk45() on the full three body equations only */
+	if (configuration.regularizeEarth > 0 || configuration.regularizeMoon > 0) {
+		if (sweep->integrator != &rk45 || configuration.bodies != NULL ||
+				configuration.ephemeris) {
+			printf("Regularization only covers rk45 on the full three body equations, "
+					"integrating without it\n");
+		} else {
+			if (sweep->batched) {
+				printf("Batches are not regularized, integrating one trajectory at a "
+						"time\n");
+				sweep->batched = FALSE;
+			}
+			if (configuration.screen)
+				printf("Screening is not regularized, only the second tier is\n");
+		}
+	}
+
+	uint8_t found = runStrategy(sweep, configuration, inclusive, best, bestCost);
+
+	if (ephemeris != NULL) {
+		setEphemeris(NULL);
+		destroyEphemeris(ephemeris);
+	}
+	return found;
+}
+
+
+uint8_t runStrategy(sweep_t *sweep, configuration_t configuration, uint8_t inclusive,
+		candidate_t *best, double *bestCost) {
+
+	/* Coarse-to-fine: only cells on an outcome boundary are refined. On a coarse grid
+	 * the starting lattice is the grid itself, and the grid is cheaper */
+	if (configuration.search == SEARCH_ADAPTIVE && coarseSpacing(GRID_LIMIT,
+				configuration.accuracy, inclusive) < REFINE_MIN_SPACING) {
+		printf("Grid too coarse to refine, searching the full grid\n");
+		configuration.search = SEARCH_GRID;
+	}
+	if (configuration.search == SEARCH_ADAPTIVE) {
+		uint32_t evaluations;
+		uint8_t found = refineSearch(sweep, configuration, GRID_LIMIT, inclusive,
+				best, bestCost, &evaluations);
+		printf("Adaptive search integrated %u candidates\n", evaluations);
+		return found;
+	}
+
+	/* Increasing impulse magnitude, stopping once the best can no longer be beaten */
+	if (configuration.search == SEARCH_RING) {
+		uint32_t evaluations;
+		uint8_t found = ringSearch(sweep, configuration, GRID_LIMIT, inclusive, best, bestCost,
+				&evaluations);
+		printf("Ring search integrated %u candidates\n", evaluations);
+		return found;
+	}
+
+	/* Newton shooting on the gradient of the Earth perigee, off the grid */
+	if (configuration.search == SEARCH_SHOOTING) {
+		uint32_t evaluations;
+		uint8_t found = shootingSearch(sweep, configuration, GRID_LIMIT, best, bestCost,
+				&evaluations);
+		printf("Shooting search integrated %u candidates\n", evaluations);
+		return found;
+	}
+
+	/* Derivative-free population search, off the grid */
+	if (configuration.search == SEARCH_CMAES) {
+		uint32_t evaluations;
+		uint8_t found = populationSearch(sweep, configuration, GRID_LIMIT, best, bestCost,
+				&evaluations);
+		printf("Population search integrated %u candidates\n", evaluations);
+		return found;
+	}
+
+	/* Every point of the grid, or of its slice */
+	uint32_t bestIndex;
+	candidate_t *grid;
+	uint32_t count = buildGrid(GRID_LIMIT, configuration.accuracy, inclusive, &grid);
+	uint32_t first = 0, last = count;
+	if (configuration.shards > 1) {
+		first = (uint64_t)count*configuration.shard/configuration.shards;
+		last = (uint64_t)count*(configuration.shard + 1)/configuration.shards;
+	}
+	sweep->candidates = grid + first;
+	sweep->count = last - first;
+
+	/* Screened in single precision first, only the interesting candidates in double */
+	if (configuration.screen != SCREEN_OFF) {
+		uint32_t refined;
+		uint8_t found = screenedSweep(sweep, configuration, GRID_LIMIT, &bestIndex, bestCost,
+				&refined);
+		if (found)
+			*best = sweep->candidates[bestIndex];
+		free(grid);
+		return found;
+	}
+	uint8_t found = runSweep(sweep, configuration, &bestIndex, bestCost);
+	if (found)
+		*best = sweep->candidates[bestIndex];
+	printf("Grid search integrated %u candidates\n", sweep->count);
+	free(grid);
+	return found;
+}
+
+
+uint8_t deltaVCost(candidate_t candidate, outcome_t outcome, double *cost) {
+
+	if (RESULT_COLLISION_EARTH != outcome.result) return FALSE;
+	*cost = impulseMagnitude(candidate);
+	return TRUE;
+}
+
+
+uint8_t returnTimeCost(candidate_t candidate, outcome_t outcome, double *cost) {
+
+	if (RESULT_COLLISION_EARTH != outcome.result) return FALSE;
+	*cost = outcome.stopTime;
+	return TRUE;
+}
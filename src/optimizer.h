@@ -3,11 +3,42 @@
 
 #include "util.h"
 #include "integrator.h"
+#include "sweep.h"
+#include "refine.h"
+#include "population.h"
+#include "ring.h"
+#include "shooting.h"
+#include "screen.h"
 
+/* The impulse grid spans [-GRID_LIMIT, GRID_LIMIT] m/s on each axis */
+#define GRID_LIMIT 		(100)
 
 void optimizeDeltaV(configuration_t configuration, double *optdvx, double *optdvy);
 
 double optimizeReturnTime(configuration_t configuration, double *optdvx, double *optdvy);
 
+/**
+ * Both objectives from a single grid sweep: every candidate is integrated once with
+ * rk45, and the non-dominated (delta V, return time) front is printed. Fills the
+ * minimal delta V end of the front.
+ */
+void optimizePareto(configuration_t configuration, double *optdvx, double *optdvy);
+
+/**
+ * Search for the best impulse of configuration.objective, without the summary of the
+ * two functions above. cost is the impulse magnitude (objective 1) or the return time
+ * (objective 2). Returns FALSE if no candidate was feasible.
+ */
+uint8_t optimizeObjective(configuration_t configuration, candidate_t *best, double *cost);
+
+/**
+ * Grid search of configuration.objective answering count Moon clearances at once: every
+ * candidate is integrated a single time with a clearance of zero, and its closest
+ * approach to the Moon decides the others (see outcomeAtClearance()). Fills each answer
+ * from its clearance. Returns FALSE if no candidate was feasible at any of them.
+ */
+uint8_t optimizeClearances(configuration_t configuration, clearance_answer_t *answers,
+		uint8_t count);
+
 
 #endif /* _OPTIMIZER_H_ */
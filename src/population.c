@@ -0,0 +1,242 @@
+#include "population.h"
+
+/* Search space dimension, (dvx, dvy) */
+#define DIMENSION 	(2)
+
+/* A scored sample of one generation */
+typedef struct {
+	double x[DIMENSION];
+	uint8_t feasible;
+	double cost;
+	double violation;
+	uint32_t index;
+} sample_t;
+
+/**
+ * State of one CMA-ES run: mean, step size, covariance with its eigen decomposition
+ * C = B*diag(D^2)*B', and the evolution paths
+ */
+typedef struct {
+	double mean[DIMENSION];
+	double sigma;
+	double C[DIMENSION][DIMENSION];
+	double B[DIMENSION][DIMENSION];
+	double D[DIMENSION];
+	double pc[DIMENSION];
+	double ps[DIMENSION];
+} strategy_t;
+
+/**
+ * Eigen decomposition of the 2x2 covariance into strategy->B and strategy->D
+ */
+static void decompose(strategy_t *strategy);
+
+/**
+ * Ranking of samples: feasible ones by cost, then infeasible ones by violation, then
+ * by index so that the order is total
+ */
+static int compareSamples(const void *a, const void *b);
+
+
+uint8_t populationSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		candidate_t *best, double *bestCost, uint32_t *evaluations) {
+
+	uint64_t rng = POPULATION_SEED;
+	uint8_t found = FALSE;
+	*evaluations = 0;
+
+	uint32_t lambda = POPULATION_LAMBDA;
+	for (uint8_t run = 0; run <= POPULATION_RESTARTS; run++, lambda *= 2) {
+
+		if (*evaluations + lambda > POPULATION_MAX_EVALUATIONS) break;
+
+		/* Recombination weights and strategy parameters (Hansen's defaults) */
+		uint32_t mu = lambda/2;
+		double weights[mu], sum = 0, sumSquares = 0;
+		for (uint32_t i = 0; i < mu; i++) {
+			weights[i] = log(mu + 0.5) - log(i + 1.0);
+			sum += weights[i];
+		}
+		for (uint32_t i = 0; i < mu; i++) {
+			weights[i] /= sum;
+			sumSquares += weights[i]*weights[i];
+		}
+		double n = DIMENSION;
+		double mueff = 1.0/sumSquares;
+		double cc = (4 + mueff/n)/(n + 4 + 2*mueff/n);
+		double cs = (mueff + 2)/(n + mueff + 5);
+		double c1 = 2/((n + 1.3)*(n + 1.3) + mueff);
+		double cmu = fmin(1 - c1, 2*(mueff - 2 + 1/mueff)/((n + 2)*(n + 2) + mueff));
+		double damps = 1 + 2*fmax(0, sqrt((mueff - 1)/(n + 1)) - 1) + cs;
+		double chiN = sqrt(n)*(1 - 1/(4*n) + 1/(21*n*n));
+
+		/* Every run starts from a random point in the box with an isotropic distribution */
+		strategy_t strategy = { .sigma = POPULATION_SIGMA_FRACTION*2*limit };
+		for (uint8_t d = 0; d < DIMENSION; d++) {
+			strategy.mean[d] = limit*(2*uniform(&rng) - 1);
+			strategy.C[d][d] = 1;
+		}
+
+		sample_t samples[lambda];
+		sweep->count = lambda;
+		sweep->candidates = (candidate_t *)malloc((size_t)lambda*sizeof(candidate_t));
+		sweep->outcomes = (outcome_t *)malloc((size_t)lambda*sizeof(outcome_t));
+
+		for (uint32_t generation = 0; generation < POPULATION_MAX_GENERATIONS; generation++) {
+
+			if (*evaluations + lambda > POPULATION_MAX_EVALUATIONS) break;
+			decompose(&strategy);
+
+			/* Sample the generation, clamped to the box */
+			for (uint32_t k = 0; k < lambda; k++) {
+				double z[DIMENSION];
+				for (uint8_t d = 0; d < DIMENSION; d++)
+					z[d] = strategy.D[d]*gaussian(&rng);
+				for (uint8_t d = 0; d < DIMENSION; d++) {
+					double y = strategy.B[d][0]*z[0] + strategy.B[d][1]*z[1];
+					samples[k].x[d] = fmax(-limit, fmin(limit, strategy.mean[d] + strategy.sigma*y));
+				}
+				sweep->candidates[k].dvx = samples[k].x[0];
+				sweep->candidates[k].dvy = samples[k].x[1];
+			}
+
+			/* Integrate the whole generation as one parallel sweep */
+			uint32_t sweepIndex;
+			double sweepCost;
+			runSweep(sweep, configuration, &sweepIndex, &sweepCost);
+			*evaluations += lambda;
+
+			/* Score and rank the samples, keeping the best feasible one overall */
+			for (uint32_t k = 0; k < lambda; k++) {
+				samples[k].index = k;
+				samples[k].feasible = (sweep->cost)(sweep->candidates[k], sweep->outcomes[k],
+						&samples[k].cost);
+				samples[k].violation = sweep->outcomes[k].closestEarth;
+				if (samples[k].feasible && (!found || samples[k].cost < *bestCost)) {
+					*bestCost = samples[k].cost;
+					*best = sweep->candidates[k];
+					found = TRUE;
+				}
+			}
+			qsort(samples, lambda, sizeof(sample_t), compareSamples);
+
+			/* Move the mean to the weighted recombination of the mu best samples */
+			double step[DIMENSION] = { 0 };
+			for (uint8_t d = 0; d < DIMENSION; d++) {
+				double mean = 0;
+				for (uint32_t i = 0; i < mu; i++)
+					mean += weights[i]*samples[i].x[d];
+				step[d] = (mean - strategy.mean[d])/strategy.sigma;
+				strategy.mean[d] = mean;
+			}
+
+			/* Conjugate evolution path, with C^(-1/2) = B*diag(1/D)*B' */
+			double whitened[DIMENSION], psNorm = 0;
+			for (uint8_t d = 0; d < DIMENSION; d++) {
+				double projection = strategy.B[0][d]*step[0] + strategy.B[1][d]*step[1];
+				whitened[d] = projection/strategy.D[d];
+			}
+			for (uint8_t d = 0; d < DIMENSION; d++) {
+				double inverseRoot = strategy.B[d][0]*whitened[0] + strategy.B[d][1]*whitened[1];
+				strategy.ps[d] = (1 - cs)*strategy.ps[d] + sqrt(cs*(2 - cs)*mueff)*inverseRoot;
+				psNorm += strategy.ps[d]*strategy.ps[d];
+			}
+			psNorm = sqrt(psNorm);
+
+			/* Covariance evolution path, stalled while the step size is adapting */
+			double hsig = (psNorm/sqrt(1 - pow(1 - cs, 2*(generation + 1)))/chiN < 1.4 + 2/(n + 1));
+			for (uint8_t d = 0; d < DIMENSION; d++)
+				strategy.pc[d] = (1 - cc)*strategy.pc[d] + hsig*sqrt(cc*(2 - cc)*mueff)*step[d];
+
+			/* Rank-one and rank-mu covariance update */
+			for (uint8_t r = 0; r < DIMENSION; r++) {
+				for (uint8_t c = 0; c < DIMENSION; c++) {
+					double rankMu = 0;
+					for (uint32_t i = 0; i < mu; i++) {
+						double yr = (samples[i].x[r] - (strategy.mean[r] - strategy.sigma*step[r]))/strategy.sigma;
+						double yc = (samples[i].x[c] - (strategy.mean[c] - strategy.sigma*step[c]))/strategy.sigma;
+						rankMu += weights[i]*yr*yc;
+					}
+					strategy.C[r][c] = (1 - c1 - cmu)*strategy.C[r][c] +
+						c1*(strategy.pc[r]*strategy.pc[c] + (1 - hsig)*cc*(2 - cc)*strategy.C[r][c]) +
+						cmu*rankMu;
+				}
+			}
+
+			/* Step size adaptation */
+			strategy.sigma *= exp((cs/damps)*(psNorm/chiN - 1));
+
+			/* Converged once the distribution is narrower than the requested accuracy */
+			double spread = strategy.sigma*sqrt(fmax(strategy.C[0][0], strategy.C[1][1]));
+			if (spread < POPULATION_TOL_FRACTION*configuration.accuracy) break;
+		}
+
+		free(sweep->candidates);
+		free(sweep->outcomes);
+	}
+
+	sweep->candidates = NULL;
+	sweep->outcomes = NULL;
+	sweep->count = 0;
+	return found;
+}
+
+
+double uniform(uint64_t *rng) {
+
+	*rng ^= *rng >> 12;
+	*rng ^= *rng << 25;
+	*rng ^= *rng >> 27;
+	uint64_t bits = (*rng*0x2545F4914F6CDD1DULL) >> 11;
+	return (bits + 0.5)/9007199254740992.0;
+}
+
+
+double gaussian(uint64_t *rng) {
+	return sqrt(-2*log(uniform(rng)))*cos(2*M_PI*uniform(rng));
+}
+
+
+void decompose(strategy_t *strategy) {
+
+	/* Enforce symmetry, then solve the 2x2 eigenproblem in closed form */
+	double a = strategy->C[0][0], c = strategy->C[1][1];
+	double b = 0.5*(strategy->C[0][1] + strategy->C[1][0]);
+	strategy->C[0][1] = strategy->C[1][0] = b;
+
+	double mid = 0.5*(a + c);
+	double radius = sqrt(0.25*(a - c)*(a - c) + b*b);
+	double eigen[DIMENSION] = { mid + radius, mid - radius };
+
+	/* Eigenvector of the larger eigenvalue, the other one is orthogonal */
+	double vx = 1, vy = 0;
+	if (b != 0) {
+		vx = b;
+		vy = eigen[0] - a;
+	} else if (c > a) {
+		vx = 0;
+		vy = 1;
+	}
+	double length = sqrt(vx*vx + vy*vy);
+	strategy->B[0][0] = vx/length;
+	strategy->B[1][0] = vy/length;
+	strategy->B[0][1] = -vy/length;
+	strategy->B[1][1] = vx/length;
+
+	for (uint8_t d = 0; d < DIMENSION; d++)
+		strategy->D[d] = sqrt(fmax(eigen[d], 1E-20));
+}
+
+
+int compareSamples(const void *a, const void *b) {
+
+	const sample_t *first = (const sample_t *)a, *second = (const sample_t *)b;
+	if (first->feasible != second->feasible)
+		return first->feasible ? -1 : 1;
+
+	double key1 = first->feasible ? first->cost : first->violation;
+	double key2 = second->feasible ? second->cost : second->violation;
+	if (key1 != key2)
+		return key1 < key2 ? -1 : 1;
+	return (first->index > second->index) - (first->index < second->index);
+}
@@ -0,0 +1,45 @@
+#ifndef _POPULATION_H_
+#define _POPULATION_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "configuration.h"
+
+/* Population size of the first run, doubled on every restart (IPOP) */
+#define POPULATION_LAMBDA 		(16)
+#define POPULATION_RESTARTS 	(4)
+
+/* Budgets: generations per run, and integrations over all runs */
+#define POPULATION_MAX_GENERATIONS 	(60)
+#define POPULATION_MAX_EVALUATIONS 	(6000)
+
+/* A run has converged once its step size is this fraction of the grid accuracy */
+#define POPULATION_TOL_FRACTION 	(0.1)
+
+/* Initial step size, as a fraction of the box width */
+#define POPULATION_SIGMA_FRACTION 	(0.3)
+
+/* Seed of the sampler, fixed so that searches are reproducible */
+#define POPULATION_SEED 		(0x2545F4914F6CDD1DULL)
+
+/* Uniform deviate in (0, 1) from a xorshift64* generator with state *rng (non-zero) */
+double uniform(uint64_t *rng);
+
+/* Standard normal deviate (Box-Muller) */
+double gaussian(uint64_t *rng);
+
+/**
+ * CMA-ES with restarts over the box [-limit, limit]^2 of impulses. Every generation
+ * is integrated as one parallel sweep. Samples are ranked by the sweep's cost when
+ * feasible, and infeasible samples (Moon impact, escape) rank behind every feasible
+ * one by their closest approach to the Earth, a smooth measure of constraint
+ * violation. Returns FALSE if no feasible sample was found, otherwise fills best
+ * and bestCost. evaluations receives the number of integrations.
+ */
+uint8_t populationSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		candidate_t *best, double *bestCost, uint32_t *evaluations);
+
+#endif /* _POPULATION_H_ */
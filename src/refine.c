@@ -0,0 +1,275 @@
+#include "refine.h"
+
+/* Rectangle of the lattice between the corner indices (i0, j0) and (i1, j1) */
+typedef struct {
+	uint32_t i0, j0;
+	uint32_t i1, j1;
+} cell_t;
+
+/* Growable list of cells */
+typedef struct {
+	cell_t *cells;
+	uint32_t count;
+	uint32_t capacity;
+} cells_t;
+
+/**
+ * Lattice points seen so far, in an open addressing hash table keyed on the packed
+ * (i, j) index. Keys are stored plus one so that 0 marks an empty slot.
+ */
+typedef struct {
+	uint64_t *keys;
+	outcome_t *outcomes;
+	uint32_t capacity;
+	uint32_t count;
+} lattice_t;
+
+/**
+ * Find the outcome slot of lattice point (i, j), adding a REFINE_PENDING entry if
+ * the point is new. Pointers are invalidated by the next call.
+ */
+static outcome_t *findPoint(lattice_t *lattice, uint32_t i, uint32_t j, uint8_t *inserted);
+
+/**
+ * Slot holding key, or the empty slot where it belongs
+ */
+static uint32_t findSlot(uint64_t *keys, uint32_t capacity, uint64_t key);
+
+/**
+ * Double the capacity of the hash table (or create it)
+ */
+static void growLattice(lattice_t *lattice);
+
+/**
+ * Whether the four corners of a cell ended with different results
+ */
+static uint8_t mixedCorners(lattice_t *lattice, cell_t cell);
+
+/**
+ * Split a cell at its midpoints into up to four children, appended to list
+ */
+static void subdivide(cells_t *list, cell_t cell);
+
+/**
+ * Append a cell to a list
+ */
+static void pushCell(cells_t *list, uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1);
+
+
+uint8_t refineSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		uint8_t inclusive, candidate_t *best, double *bestCost, uint32_t *evaluations) {
+
+	*evaluations = 0;
+
+	double *axis;
+	uint32_t axisCount = buildAxis(limit, configuration.accuracy, inclusive, &axis);
+	if (axisCount < 2) {
+		free(axis);
+		return FALSE;
+	}
+
+	lattice_t lattice = { 0 };
+	growLattice(&lattice);
+	cells_t cells = { 0 }, next = { 0 };
+
+	/* Starting lattice, the last row and column of cells may be narrower */
+	uint32_t spacing = coarseSpacing(limit, configuration.accuracy, inclusive);
+	for (uint32_t i0 = 0; i0 + 1 < axisCount; i0 += spacing) {
+		uint32_t i1 = (i0 + spacing < axisCount) ? i0 + spacing : axisCount - 1;
+		for (uint32_t j0 = 0; j0 + 1 < axisCount; j0 += spacing) {
+			uint32_t j1 = (j0 + spacing < axisCount) ? j0 + spacing : axisCount - 1;
+			pushCell(&cells, i0, j0, i1, j1);
+		}
+	}
+
+	uint8_t found = FALSE;
+	uint32_t bestI = 0, bestJ = 0;
+	uint64_t bestRaster = 0;
+
+	while (cells.count > 0) {
+
+		/* Queue the corners that have not been integrated yet */
+		uint32_t (*pending)[2] = malloc((size_t)4*cells.count*sizeof(*pending));
+		uint32_t pendingCount = 0;
+		for (uint32_t c = 0; c < cells.count; c++) {
+			cell_t cell = cells.cells[c];
+			uint32_t corners[4][2] = {
+				{ cell.i0, cell.j0 }, { cell.i0, cell.j1 },
+				{ cell.i1, cell.j0 }, { cell.i1, cell.j1 }
+			};
+			for (uint8_t corner = 0; corner < 4; corner++) {
+				uint8_t inserted;
+				findPoint(&lattice, corners[corner][0], corners[corner][1], &inserted);
+				if (!inserted) continue;
+				pending[pendingCount][0] = corners[corner][0];
+				pending[pendingCount][1] = corners[corner][1];
+				pendingCount++;
+			}
+		}
+
+		/* Integrate the whole level as one parallel sweep */
+		sweep->count = pendingCount;
+		sweep->candidates = (candidate_t *)malloc((size_t)pendingCount*sizeof(candidate_t));
+		sweep->outcomes = (outcome_t *)malloc((size_t)pendingCount*sizeof(outcome_t));
+		for (uint32_t k = 0; k < pendingCount; k++) {
+			sweep->candidates[k].dvx = axis[pending[k][0]];
+			sweep->candidates[k].dvy = axis[pending[k][1]];
+		}
+		uint32_t sweepIndex;
+		double sweepCost;
+		if (pendingCount > 0)
+			runSweep(sweep, configuration, &sweepIndex, &sweepCost);
+		*evaluations += pendingCount;
+
+		/* Store the outcomes, and keep the best point in grid raster order */
+		for (uint32_t k = 0; k < pendingCount; k++) {
+			uint32_t i = pending[k][0], j = pending[k][1];
+			uint8_t inserted;
+			*findPoint(&lattice, i, j, &inserted) = sweep->outcomes[k];
+
+			/* Points on either axis are not part of the grid, but still classify cells */
+			double cost;
+			if (axis[i] == 0 || axis[j] == 0) continue;
+			if (!(sweep->cost)(sweep->candidates[k], sweep->outcomes[k], &cost)) continue;
+
+			uint64_t raster = (uint64_t)i*axisCount + j;
+			if (!found || cost < *bestCost || (cost == *bestCost && raster < bestRaster)) {
+				*bestCost = cost;
+				bestI = i;
+				bestJ = j;
+				bestRaster = raster;
+				found = TRUE;
+			}
+		}
+		free(sweep->candidates);
+		free(sweep->outcomes);
+		free(pending);
+
+		/* Refine cells that straddle an outcome boundary or touch the best point */
+		next.count = 0;
+		for (uint32_t c = 0; c < cells.count; c++) {
+			cell_t cell = cells.cells[c];
+			if (cell.i1 - cell.i0 <= 1 && cell.j1 - cell.j0 <= 1) continue;
+
+			uint8_t holdsBest = found && bestI >= cell.i0 && bestI <= cell.i1 &&
+				bestJ >= cell.j0 && bestJ <= cell.j1;
+			if (holdsBest || mixedCorners(&lattice, cell))
+				subdivide(&next, cell);
+		}
+		cells_t swap = cells;
+		cells = next;
+		next = swap;
+	}
+
+	if (found) {
+		best->dvx = axis[bestI];
+		best->dvy = axis[bestJ];
+	}
+
+	sweep->candidates = NULL;
+	sweep->outcomes = NULL;
+	sweep->count = 0;
+	free(cells.cells);
+	free(next.cells);
+	free(lattice.keys);
+	free(lattice.outcomes);
+	free(axis);
+	return found;
+}
+
+
+outcome_t *findPoint(lattice_t *lattice, uint32_t i, uint32_t j, uint8_t *inserted) {
+
+	/* Keep the load factor below one half */
+	if (2*(lattice->count + 1) > lattice->capacity)
+		growLattice(lattice);
+
+	uint64_t key = (((uint64_t)i << 32) | j) + 1;
+	uint32_t slot = findSlot(lattice->keys, lattice->capacity, key);
+
+	*inserted = (lattice->keys[slot] == 0);
+	if (*inserted) {
+		lattice->keys[slot] = key;
+		lattice->outcomes[slot].result = REFINE_PENDING;
+		lattice->count++;
+	}
+	return &lattice->outcomes[slot];
+}
+
+
+uint32_t findSlot(uint64_t *keys, uint32_t capacity, uint64_t key) {
+
+	/* Fibonacci hashing, then linear probing */
+	uint32_t mask = capacity - 1;
+	uint32_t slot = (uint32_t)((key*0x9E3779B97F4A7C15ULL) >> 32) & mask;
+	while (keys[slot] != 0 && keys[slot] != key)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+
+void growLattice(lattice_t *lattice) {
+
+	uint32_t capacity = lattice->capacity > 0 ? 2*lattice->capacity : 1024;
+	uint64_t *keys = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+	outcome_t *outcomes = (outcome_t *)malloc((size_t)capacity*sizeof(outcome_t));
+
+	for (uint32_t slot = 0; slot < lattice->capacity; slot++) {
+		if (lattice->keys[slot] == 0) continue;
+		uint32_t moved = findSlot(keys, capacity, lattice->keys[slot]);
+		keys[moved] = lattice->keys[slot];
+		outcomes[moved] = lattice->outcomes[slot];
+	}
+	free(lattice->keys);
+	free(lattice->outcomes);
+	lattice->keys = keys;
+	lattice->outcomes = outcomes;
+	lattice->capacity = capacity;
+}
+
+
+uint32_t coarseSpacing(double limit, double accuracy, uint8_t inclusive) {
+
+	double *axis;
+	uint32_t axisCount = buildAxis(limit, accuracy, inclusive, &axis);
+	free(axis);
+	uint32_t spacing = (axisCount > 1) ? (axisCount - 1)/REFINE_COARSE_CELLS : 0;
+	return (spacing < 1) ? 1 : spacing;
+}
+
+
+uint8_t mixedCorners(lattice_t *lattice, cell_t cell) {
+
+	uint8_t inserted;
+	uint8_t result = findPoint(lattice, cell.i0, cell.j0, &inserted)->result;
+	return findPoint(lattice, cell.i0, cell.j1, &inserted)->result != result ||
+		findPoint(lattice, cell.i1, cell.j0, &inserted)->result != result ||
+		findPoint(lattice, cell.i1, cell.j1, &inserted)->result != result;
+}
+
+
+void subdivide(cells_t *list, cell_t cell) {
+
+	/* Axes already one step wide are not split */
+	uint32_t is[3] = { cell.i0, (cell.i0 + cell.i1)/2, cell.i1 };
+	uint32_t js[3] = { cell.j0, (cell.j0 + cell.j1)/2, cell.j1 };
+	uint8_t iParts = (cell.i1 - cell.i0 > 1) ? 2 : 1;
+	uint8_t jParts = (cell.j1 - cell.j0 > 1) ? 2 : 1;
+	if (iParts == 1) is[1] = cell.i1;
+	if (jParts == 1) js[1] = cell.j1;
+
+	for (uint8_t a = 0; a < iParts; a++)
+		for (uint8_t b = 0; b < jParts; b++)
+			pushCell(list, is[a], js[b], is[a + 1], js[b + 1]);
+}
+
+
+void pushCell(cells_t *list, uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1) {
+
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity > 0 ? 2*list->capacity : 256;
+		list->cells = (cell_t *)realloc(list->cells, (size_t)list->capacity*sizeof(cell_t));
+	}
+	cell_t cell = { .i0 = i0, .j0 = j0, .i1 = i1, .j1 = j1 };
+	list->cells[list->count++] = cell;
+}
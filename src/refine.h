@@ -0,0 +1,39 @@
+#ifndef _REFINE_H_
+#define _REFINE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sweep.h"
+#include "configuration.h"
+
+/* Number of cells along each axis of the starting lattice */
+#define REFINE_COARSE_CELLS 	(16)
+
+/* Coarser spacing of the starting lattice, in grid steps, below which the grid is cheaper */
+#define REFINE_MIN_SPACING 		(2)
+
+/* Marks a lattice point that is queued but not integrated yet */
+#define REFINE_PENDING 			(0xFF)
+
+/**
+ * Coarse-to-fine search over the same lattice as buildGrid(). Starts on a lattice
+ * of about REFINE_COARSE_CELLS cells per axis, and only subdivides cells whose four
+ * corners end differently (Earth / Moon / escape) or that hold the best candidate
+ * found so far, until cells span a single grid step. Each level is integrated with
+ * runSweep() using the integrator, cost and batching of sweep. Ties are broken in
+ * grid raster order, like the full grid. Returns FALSE if no point was feasible,
+ * otherwise fills best and bestCost. evaluations receives the number of points
+ * that were integrated.
+ */
+uint8_t refineSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		uint8_t inclusive, candidate_t *best, double *bestCost, uint32_t *evaluations);
+
+/**
+ * Spacing, in grid steps, of the starting lattice of refineSearch() on the lattice of
+ * buildGrid(). Below REFINE_MIN_SPACING the starting lattice is the grid itself, and
+ * refining only adds the points on the axes.
+ */
+uint32_t coarseSpacing(double limit, double accuracy, uint8_t inclusive);
+
+#endif /* _REFINE_H_ */
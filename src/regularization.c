@@ -0,0 +1,126 @@
+#include "regularization.h"
+
+/**
+ * Three body state, physical time and spacecraft velocity relative to the primary of a
+ * regularized state. Inlined with a constant primary, like nbodyDerivative().
+ */
+static inline __attribute__((always_inline)) void physical(uint8_t primary,
+		const double *regularized, double *state, double *time, double relativeVelocity[2]);
+
+/**
+ * Derivative of a regularized state about primary, in place
+ */
+static inline __attribute__((always_inline)) uint8_t regularizedDerivative(uint8_t primary,
+		double *state);
+
+
+void regularize(uint8_t primary, const double *state, double time, double *regularized) {
+
+	const double *body = state + BODY_STATE_SIZE*primary;
+	double x = state[0] - body[0], y = state[1] - body[1];
+	double vx = state[2] - body[2], vy = state[3] - body[3];
+	double r = sqrt(x*x + y*y);
+
+	/* Square root of z = x + iy, on the side of the larger component for accuracy */
+	double u0, u1;
+	if (x >= 0) {
+		u0 = sqrt(0.5*(r + x));
+		u1 = (u0 > 0) ? 0.5*y/u0 : 0;
+	} else {
+		u1 = copysign(sqrt(0.5*(r - x)), y);
+		u0 = 0.5*y/u1;
+	}
+
+	/* u' = conj(u)*v/2, since dz/dt = 2u'/conj(u) */
+	regularized[0] = u0;
+	regularized[1] = u1;
+	regularized[2] = 0.5*(u0*vx + u1*vy);
+	regularized[3] = 0.5*(u0*vy - u1*vx);
+	memcpy(regularized + 4, state + 4, 2*BODY_STATE_SIZE*sizeof(double));
+	regularized[REGULARIZED_TIME] = time;
+	regularized[REGULARIZED_ENERGY] = 0.5*(vx*vx + vy*vy) - THREE_BODY_BODIES.mu[primary]/r;
+}
+
+
+void physicalEarth(const double *regularized, double *state, double *time) {
+
+	double velocity[2];
+	physical(BODY_EARTH, regularized, state, time, velocity);
+}
+
+void physicalMoon(const double *regularized, double *state, double *time) {
+
+	double velocity[2];
+	physical(BODY_MOON, regularized, state, time, velocity);
+}
+
+uint8_t regularizedEarth(double s, double *stateBuffer) {
+	return regularizedDerivative(BODY_EARTH, stateBuffer);
+}
+
+uint8_t regularizedMoon(double s, double *stateBuffer) {
+	return regularizedDerivative(BODY_MOON, stateBuffer);
+}
+
+
+void physical(uint8_t primary, const double *regularized, double *state, double *time,
+		double relativeVelocity[2]) {
+
+	double u0 = regularized[0], u1 = regularized[1];
+	double w0 = regularized[2], w1 = regularized[3];
+	double r = u0*u0 + u1*u1;
+
+	/* z = u^2 and dz/dt = 2u'u/r */
+	relativeVelocity[0] = 2*(w0*u0 - w1*u1)/r;
+	relativeVelocity[1] = 2*(w0*u1 + w1*u0)/r;
+	memcpy(state + 4, regularized + 4, 2*BODY_STATE_SIZE*sizeof(double));
+	const double *body = state + BODY_STATE_SIZE*primary;
+	state[0] = body[0] + u0*u0 - u1*u1;
+	state[1] = body[1] + 2*u0*u1;
+	state[2] = body[2] + relativeVelocity[0];
+	state[3] = body[3] + relativeVelocity[1];
+	*time = regularized[REGULARIZED_TIME];
+}
+
+
+uint8_t regularizedDerivative(uint8_t primary, double *stateBuffer) {
+
+	double state[THREE_BODY_STATE_SIZE], time, velocity[2];
+	physical(primary, stateBuffer, state, &time, velocity);
+	double u0 = stateBuffer[0], u1 = stateBuffer[1];
+	double r = u0*u0 + u1*u1;
+	double energy = stateBuffer[REGULARIZED_ENERGY];
+
+	/* Accelerations of equations(), the Earth held at the origin */
+	double accelSat[2], accelMoon[2];
+	distances_t distances;
+	gravity(state, accelSat, accelMoon, &distances);
+
+	/* Perturbation of the Kepler motion about the primary: the spacecraft's acceleration
+	 * less the primary's attraction, less the primary's own acceleration */
+	double mu = THREE_BODY_BODIES.mu[primary], inv3 = 1.0/(r*r*r);
+	double zx = state[0] - state[BODY_STATE_SIZE*primary];
+	double zy = state[1] - state[BODY_STATE_SIZE*primary + 1];
+	double px = accelSat[0] + mu*zx*inv3 - (primary == BODY_MOON ? accelMoon[0] : 0);
+	double py = accelSat[1] + mu*zy*inv3 - (primary == BODY_MOON ? accelMoon[1] : 0);
+
+	/* u'' = (E/2)u + (r/2)conj(u)P, E' = r v.P, t' = r */
+	stateBuffer[0] = stateBuffer[2];
+	stateBuffer[1] = stateBuffer[3];
+	stateBuffer[2] = 0.5*energy*u0 + 0.5*r*(u0*px + u1*py);
+	stateBuffer[3] = 0.5*energy*u1 + 0.5*r*(u0*py - u1*px);
+	stateBuffer[REGULARIZED_TIME] = r;
+	stateBuffer[REGULARIZED_ENERGY] = r*(velocity[0]*px + velocity[1]*py);
+
+	/* The Earth and the Moon move as in equations(), in the fictitious time */
+	stateBuffer[4]  = 0;
+	stateBuffer[5]  = 0;
+	stateBuffer[6]  = 0;
+	stateBuffer[7]  = 0;
+	stateBuffer[8]  = r*state[10];
+	stateBuffer[9]  = r*state[11];
+	stateBuffer[10] = r*accelMoon[0];
+	stateBuffer[11] = r*accelMoon[1];
+
+	return checkCollisionSquared(&distances);
+}
@@ -0,0 +1,46 @@
+#ifndef _REGULARIZATION_H_
+#define _REGULARIZATION_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "equations.h"
+#include "bodies.h"
+
+/**
+ * Regularized three body state about a primary (the Earth or the Moon): the Levi-Civita
+ * coordinates u of the spacecraft relative to the primary (z = u^2 in complex notation)
+ * and their derivative in the fictitious time s, the Earth and the Moon as in the three
+ * body state, then the physical time and the Kepler energy of the spacecraft about the
+ * primary. The Sundman transformation dt = r ds makes the relative motion a perturbed
+ * harmonic oscillator, without the 1/r^2 singularity at the primary.
+ */
+#define REGULARIZED_STATE_SIZE 	(14)
+#define REGULARIZED_TIME 		(12)
+#define REGULARIZED_ENERGY 		(13)
+
+/* A regularized segment ends once the spacecraft is this factor past the radius where it
+ * began, so a trajectory grazing the sphere does not switch at every step */
+#define REGULARIZATION_HYSTERESIS 	(1.1)
+
+/* Regularized state about primary (BODY_EARTH or BODY_MOON) of a three body state at time */
+void regularize(uint8_t primary, const double *state, double time, double *regularized);
+
+/**
+ * Three body state and physical time of a regularized state about the Earth or about
+ * the Moon. Both have the interface of an event_map_t (see events.h), so terminal
+ * events are located on the dense output of a regularized step.
+ */
+void physicalEarth(const double *regularized, double *state, double *time);
+void physicalMoon(const double *regularized, double *state, double *time);
+
+/**
+ * Derivative in the fictitious time of a regularized state about the Earth or about the
+ * Moon, in place, with the interface of equations(): the motion is that of equations(),
+ * and so is the return value. The fictitious time argument is unused.
+ */
+uint8_t regularizedEarth(double s, double *stateIn);
+uint8_t regularizedMoon(double s, double *stateIn);
+
+#endif /* _REGULARIZATION_H_ */
@@ -0,0 +1,77 @@
+#include "ring.h"
+
+/* A grid candidate tagged with its ring and its position in raster order */
+typedef struct {
+	candidate_t candidate;
+	uint32_t ring;
+	uint32_t raster;
+} ringed_t;
+
+/**
+ * Order by ring, then by raster position within a ring
+ */
+static int compareRinged(const void *a, const void *b);
+
+
+uint8_t ringSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		uint8_t inclusive, candidate_t *best, double *bestCost, uint32_t *evaluations) {
+
+	*evaluations = 0;
+
+	candidate_t *grid;
+	uint32_t count = buildGrid(limit, configuration.accuracy, inclusive, &grid);
+
+	/* Sort the grid into rings, keeping raster order inside each ring */
+	double width = RING_WIDTH_STEPS*configuration.accuracy;
+	ringed_t *ringed = (ringed_t *)malloc((size_t)count*sizeof(ringed_t));
+	for (uint32_t index = 0; index < count; index++) {
+		ringed[index].candidate = grid[index];
+		ringed[index].ring = (uint32_t)(impulseMagnitude(grid[index])/width);
+		ringed[index].raster = index;
+	}
+	qsort(ringed, count, sizeof(ringed_t), compareRinged);
+	for (uint32_t index = 0; index < count; index++)
+		grid[index] = ringed[index].candidate;
+
+	uint8_t found = FALSE;
+	uint32_t start = 0;
+	while (start < count) {
+
+		/* Rings past the one holding the best cost only hold larger magnitudes */
+		uint32_t ring = ringed[start].ring;
+		if (found && ring > (uint32_t)(*bestCost/width)) break;
+
+		uint32_t end = start;
+		while (end < count && ringed[end].ring == ring)
+			end++;
+
+		/* Integrate the ring as one parallel sweep */
+		sweep->candidates = grid + start;
+		sweep->count = end - start;
+		uint32_t ringIndex;
+		double ringCost;
+		if (runSweep(sweep, configuration, &ringIndex, &ringCost) &&
+				(!found || ringCost < *bestCost)) {
+			*bestCost = ringCost;
+			*best = sweep->candidates[ringIndex];
+			found = TRUE;
+		}
+		*evaluations += end - start;
+		start = end;
+	}
+
+	sweep->candidates = NULL;
+	sweep->count = 0;
+	free(ringed);
+	free(grid);
+	return found;
+}
+
+
+int compareRinged(const void *a, const void *b) {
+
+	const ringed_t *first = (const ringed_t *)a, *second = (const ringed_t *)b;
+	if (first->ring != second->ring)
+		return first->ring < second->ring ? -1 : 1;
+	return (first->raster > second->raster) - (first->raster < second->raster);
+}
@@ -0,0 +1,25 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sweep.h"
+#include "configuration.h"
+
+/* Width of each ring, in grid steps */
+#define RING_WIDTH_STEPS 	(1)
+
+/**
+ * Search the same grid as buildGrid() in concentric rings of increasing impulse
+ * magnitude, each ring integrated as one parallel sweep. Stops as soon as every
+ * point with a magnitude up to the best feasible cost has been integrated, so the
+ * sweep's cost must be impulseMagnitude() for feasible candidates. Gives the same
+ * result as the full grid, including the raster order tie break. Returns FALSE if
+ * no candidate was feasible, otherwise fills best and bestCost. evaluations
+ * receives the number of integrations.
+ */
+uint8_t ringSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		uint8_t inclusive, candidate_t *best, double *bestCost, uint32_t *evaluations);
+
+#endif /* _RING_H_ */
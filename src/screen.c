@@ -0,0 +1,571 @@
+#include "screen.h"
+
+/* Gravitational parameters in single precision */
+static const float muEarth = (float)((double)G*MASS_EARTH);
+static const float muMoon  = (float)((double)G*MASS_MOON);
+static const float muSat   = (float)((double)G*MASS_SAT);
+
+/* Outcome names of the disagreement report, indexed by RESULT_ code */
+static const char *RESULT_NAMES[] = { "none", "Earth", "Moon", "escape" };
+
+/* Why a candidate is integrated again in the second tier */
+#define SELECTED_OPTIMUM 	(1)
+#define SELECTED_BOUNDARY 	(2)
+
+/**
+ * Outcome a candidate would have if it returned to the Earth at once: its cost is a
+ * lower bound of the cost of any outcome, for both objectives
+ */
+static const outcome_t OPTIMISTIC_OUTCOME = { .result = RESULT_COLLISION_EARTH, .stopTime = 0 };
+
+/* Tableau coefficients converted to single precision */
+typedef struct {
+	uint8_t stages;
+	uint8_t fsal;
+	float a[TABLEAU_MAX_STAGES][TABLEAU_MAX_STAGES];
+	float b[TABLEAU_MAX_STAGES];
+	float e[TABLEAU_MAX_STAGES];
+} screen_tableau_t;
+
+/**
+ * Load the next candidate from the source into a lane, or mark the lane idle
+ */
+static void refill(batch_source_t source, void *context, configuration_t config,
+		screen_batch_t *batch, uint8_t lane);
+
+/**
+ * Acceptance (1 or 0) and step factor of every lane from the sums of its squared scaled
+ * errors, like controlSteps() of rk45Batch(). Idle lanes never accept, and keep their
+ * step.
+ */
+static __attribute__((noinline)) void controlSteps(screen_batch_t *restrict batch,
+		const step_control_t *control, const float *restrict sum, float *restrict accept,
+		float *restrict factor);
+
+/**
+ * Three body equations of motion on every lane, in single precision
+ */
+static void equationsScreen(float state[THREE_BODY_STATE_SIZE][SCREEN_LANES],
+		float derivative[THREE_BODY_STATE_SIZE][SCREEN_LANES]);
+
+/**
+ * Construct stages 2..n of one step on all lanes, the first stage must be in k[0]
+ */
+static void constructStages(screen_batch_t *batch, const screen_tableau_t *tableau);
+
+/**
+ * Sample the event functions on the dense output of the accepted lanes, and stop each
+ * one at its first sample past an event surface (Moon, then Earth, then escape)
+ */
+static void sampleEvents(screen_batch_t *batch,
+		float derivative[THREE_BODY_STATE_SIZE][SCREEN_LANES], const float *accept,
+		double clearance);
+
+/**
+ * Whether two screened outcomes would be told apart by the search
+ */
+static uint8_t differs(outcome_t first, outcome_t second);
+
+/**
+ * Integrate the candidates listed in selection (count of them) with the integrator of
+ * sweep, writing their outcomes to outcomes[selection[k]]. Returns whether one was
+ * feasible, with the best of them in bestIndex (an index of the full sweep).
+ */
+static uint8_t integrateSelection(sweep_t *sweep, configuration_t configuration,
+		const uint32_t *selection, uint32_t count, outcome_t *outcomes,
+		uint32_t *bestIndex, double *bestCost);
+
+/**
+ * Print the candidates of selection whose outcomes disagree between the tiers, returns
+ * how many do. Candidates that the second tier cut short at the time bound are skipped.
+ */
+static uint32_t reportDisagreements(const char *label, const sweep_t *sweep,
+		configuration_t configuration, const uint32_t *selection, uint32_t count,
+		const outcome_t *screened, const outcome_t *outcomes);
+
+
+void rk45Screen(batch_source_t source, batch_sink_t sink, void *context,
+		configuration_t config, screen_batch_t *batch) {
+
+	screen_tableau_t tableau = { .stages = config.tableau->stages, .fsal = config.tableau->fsal };
+	for (uint8_t i = 0; i < tableau.stages; i++) {
+		tableau.b[i] = (float)config.tableau->b[i];
+		tableau.e[i] = (float)config.tableau->e[i];
+		for (uint8_t j = 0; j < tableau.stages; j++)
+			tableau.a[i][j] = (float)config.tableau->a[i][j];
+	}
+	double clearance = getClearance();
+
+	/* Looser tolerances than the second tier, but the same error model and controller */
+	step_control_t *control = &config.control;
+	for (uint8_t c = 0; c < BODY_STATE_SIZE; c++) {
+		control->absolute[c] *= SCREEN_LOOSENESS;
+		control->relative[c] *= SCREEN_LOOSENESS;
+	}
+
+	/* Fill every lane */
+	uint8_t active = 0;
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+		refill(source, context, config, batch, lane);
+		active += batch->active[lane];
+	}
+
+	/* k1 = f(state) survives rejected steps, and is known after accepted ones */
+	uint8_t firstStageReady = FALSE;
+
+	while (active) {
+
+		if (!firstStageReady)
+			equationsScreen(batch->state, batch->k[0]);
+		constructStages(batch, &tableau);
+
+		/* Candidate solution, and the sum of the squared scaled errors of every lane */
+		float sum[SCREEN_LANES] = { 0 };
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			float absolute = (float)control->absolute[i % BODY_STATE_SIZE];
+			float relative = (float)control->relative[i % BODY_STATE_SIZE];
+			for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+				float increment = 0, error = 0;
+				for (uint8_t stage = 0; stage < tableau.stages; stage++) {
+					increment += tableau.b[stage]*batch->k[stage][i][lane];
+					error += tableau.e[stage]*batch->k[stage][i][lane];
+				}
+				float h = batch->timeStep[lane];
+				batch->next[i][lane] = batch->state[i][lane] + h*increment;
+				float a = fabsf(batch->state[i][lane]), b = fabsf(batch->next[i][lane]);
+				float scaled = h*error/(absolute + relative*(a > b ? a : b));
+				sum[lane] += scaled*scaled;
+			}
+		}
+
+		/* Step acceptance and step update of every lane */
+		float accept[SCREEN_LANES], factor[SCREEN_LANES];
+		controlSteps(batch, control, sum, accept, factor);
+
+		/* Derivative at the candidate: the last FSAL stage, otherwise evaluated here */
+		float (*derivative)[SCREEN_LANES] = batch->k[tableau.stages - 1];
+		if (!tableau.fsal) {
+			derivative = batch->k[1];
+			equationsScreen(batch->next, derivative);
+		}
+
+		/* Lanes whose step crossed an event surface stop at the crossing sample */
+		sampleEvents(batch, derivative, accept, clearance);
+
+		/* Accepted lanes advance to the new solution, rejected lanes are unchanged */
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+				batch->state[i][lane] = accept[lane] != 0 ? batch->next[i][lane] : batch->state[i][lane];
+				batch->k[0][i][lane]  = accept[lane] != 0 ? derivative[i][lane] : batch->k[0][i][lane];
+			}
+		}
+		for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+			float dx = batch->state[0][lane] - batch->state[4][lane];
+			float dy = batch->state[1][lane] - batch->state[5][lane];
+			batch->closestEarth[lane] = fminf(batch->closestEarth[lane], dx*dx + dy*dy);
+		}
+		for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+			batch->time[lane] += accept[lane]*batch->timeStep[lane];
+			float step = batch->timeStep[lane]*factor[lane];
+			batch->timeStep[lane] = step < (float)control->maxStep ? step : (float)control->maxStep;
+		}
+		firstStageReady = TRUE;
+
+		/* Hand finished lanes to the sink and refill them. Screened stop times are
+		 * approximate, so the time bound is loosened by the selection margin. */
+		double limit = fmin(config.endTime, timeLimit(config)*(1 + SCREEN_MARGIN));
+		active = 0;
+		for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+			if (!batch->active[lane]) continue;
+			if (accept[lane] != 0 && (batch->result[lane] != 0 || batch->time[lane] > limit)) {
+				double stopTime = batch->result[lane] != 0 ? batch->eventTime[lane] : batch->time[lane];
+				(sink)(context, batch->index[lane], batch->result[lane], stopTime,
+						sqrt(batch->closestEarth[lane]), batch->closestMoon[lane]);
+				refill(source, context, config, batch, lane);
+				firstStageReady = FALSE;
+			}
+			active += batch->active[lane];
+		}
+	}
+}
+
+
+void refill(batch_source_t source, void *context, configuration_t config,
+		screen_batch_t *batch, uint8_t lane) {
+
+	double initialConditions[THREE_BODY_STATE_SIZE];
+	if (!(source)(context, &batch->index[lane], initialConditions)) {
+		/* Idle lanes keep integrating their last state, results are ignored */
+		batch->active[lane] = FALSE;
+		return;
+	}
+	for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++)
+		batch->state[i][lane] = (float)initialConditions[i];
+
+	/* The integration will always start at time t = 0 */
+	batch->time[lane] = 0;
+	batch->result[lane] = 0;
+	batch->active[lane] = TRUE;
+
+	/* First step like rk45Batch(), with the screening tolerances of config */
+	batch->timeStep[lane] = (float)config.control.firstStep;
+	if (!(config.control.firstStep > 0)) {
+		double derivative[THREE_BODY_STATE_SIZE];
+		memcpy(derivative, initialConditions, sizeof(derivative));
+		equations(0, derivative);
+		batch->timeStep[lane] = (float)initialStep(&equations, 0, initialConditions,
+				derivative, THREE_BODY_STATE_SIZE, &config.control);
+	}
+	batch->previousError[lane] = RK45_MIN_ERROR;
+	batch->previousStep[lane] = 0;
+	batch->rejected[lane] = 0;
+
+	float dx = batch->state[0][lane] - batch->state[4][lane];
+	float dy = batch->state[1][lane] - batch->state[5][lane];
+	batch->closestEarth[lane] = dx*dx + dy*dy;
+	batch->closestMoon[lane] = (approach_t){ INFINITY, 0 };
+	observeApproach(&batch->closestMoon[lane], initialConditions, 0);
+}
+
+
+void controlSteps(screen_batch_t *restrict batch, const step_control_t *control,
+		const float *restrict sum, float *restrict accept, float *restrict factor) {
+
+	/* The controller runs in double precision like rk45Batch(): floats mixed into its
+	 * lane loop keep it from vectorizing */
+	double live[SCREEN_LANES], total[SCREEN_LANES], step[SCREEN_LANES];
+	double accepted[SCREEN_LANES], next[SCREEN_LANES];
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+		live[lane] = batch->active[lane];
+		total[lane] = sum[lane];
+		step[lane] = batch->timeStep[lane];
+	}
+
+	/* stepFactor() on every lane at once */
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+		double error = sqrt(total[lane]/THREE_BODY_STATE_SIZE);
+		double h = step[lane];
+		accepted[lane] = live[lane]*(error <= 1);
+		double proposed = controlFactor(control, error, h, batch->previousError[lane],
+				batch->previousStep[lane], batch->rejected[lane]);
+		next[lane] = live[lane] != 0 ? proposed : 1.0;
+		double kept = error > RK45_MIN_ERROR ? error : RK45_MIN_ERROR;
+		batch->previousError[lane] = accepted[lane] != 0 ? kept : batch->previousError[lane];
+		batch->previousStep[lane] = accepted[lane] != 0 ? h : batch->previousStep[lane];
+		batch->rejected[lane] = live[lane] != 0 ? 1 - accepted[lane] : batch->rejected[lane];
+	}
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+		accept[lane] = (float)accepted[lane];
+		factor[lane] = (float)next[lane];
+	}
+}
+
+
+void equationsScreen(float state[THREE_BODY_STATE_SIZE][SCREEN_LANES],
+		float derivative[THREE_BODY_STATE_SIZE][SCREEN_LANES]) {
+
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+
+		/* Relative positions of the spacecraft and moon */
+		float dxMoonSat   = state[8][lane] - state[0][lane];
+		float dyMoonSat   = state[9][lane] - state[1][lane];
+		float dxEarthSat  = state[4][lane] - state[0][lane];
+		float dyEarthSat  = state[5][lane] - state[1][lane];
+		float dxEarthMoon = state[4][lane] - state[8][lane];
+		float dyEarthMoon = state[5][lane] - state[9][lane];
+
+		/* Inverse cube distances */
+		float d2MoonSat   = dxMoonSat*dxMoonSat + dyMoonSat*dyMoonSat;
+		float d2EarthSat  = dxEarthSat*dxEarthSat + dyEarthSat*dyEarthSat;
+		float d2EarthMoon = dxEarthMoon*dxEarthMoon + dyEarthMoon*dyEarthMoon;
+		float inv3MoonSat   = 1.0f/(d2MoonSat*sqrtf(d2MoonSat));
+		float inv3EarthSat  = 1.0f/(d2EarthSat*sqrtf(d2EarthSat));
+		float inv3EarthMoon = 1.0f/(d2EarthMoon*sqrtf(d2EarthMoon));
+
+		/* Spacecraft */
+		derivative[0][lane] = state[2][lane];
+		derivative[1][lane] = state[3][lane];
+		derivative[2][lane] = muMoon*dxMoonSat*inv3MoonSat + muEarth*dxEarthSat*inv3EarthSat;
+		derivative[3][lane] = muMoon*dyMoonSat*inv3MoonSat + muEarth*dyEarthSat*inv3EarthSat;
+
+		/* Earth */
+		derivative[4][lane] = 0;
+		derivative[5][lane] = 0;
+		derivative[6][lane] = 0;
+		derivative[7][lane] = 0;
+
+		/* Moon */
+		derivative[8][lane]  = state[10][lane];
+		derivative[9][lane]  = state[11][lane];
+		derivative[10][lane] = muEarth*dxEarthMoon*inv3EarthMoon - muSat*dxMoonSat*inv3MoonSat;
+		derivative[11][lane] = muEarth*dyEarthMoon*inv3EarthMoon - muSat*dyMoonSat*inv3MoonSat;
+	}
+}
+
+
+void constructStages(screen_batch_t *batch, const screen_tableau_t *tableau) {
+
+	for (uint8_t stage = 1; stage < tableau->stages; stage++) {
+
+		/* Stage argument: state plus the weighted sum of previous stages */
+		for (uint8_t i = 0; i < THREE_BODY_STATE_SIZE; i++) {
+			for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+				float sum = 0;
+				for (uint8_t j = 0; j < stage; j++)
+					sum += tableau->a[stage][j]*batch->k[j][i][lane];
+				batch->stage[i][lane] = batch->state[i][lane] + batch->timeStep[lane]*sum;
+			}
+		}
+		equationsScreen(batch->stage, batch->k[stage]);
+	}
+}
+
+
+void sampleEvents(screen_batch_t *batch,
+		float derivative[THREE_BODY_STATE_SIZE][SCREEN_LANES], const float *accept,
+		double clearance) {
+
+	/* Only positions enter the event functions */
+	const uint8_t positions[6] = { 0, 1, 4, 5, 8, 9 };
+	const bodies_t *bodies = getBodies();
+	float moonLimit  = (float)(bodies->radius[BODY_MOON] + clearance);
+	float earthLimit = (float)bodies->radius[BODY_EARTH];
+
+	for (uint8_t lane = 0; lane < SCREEN_LANES; lane++)
+		batch->result[lane] = 0;
+
+	for (uint8_t sample = 1; sample <= EVENT_SAMPLES; sample++) {
+
+		/* Hermite basis functions at this sample */
+		float theta = (float)sample/EVENT_SAMPLES;
+		float theta2 = theta*theta, theta3 = theta2*theta;
+		float h00 = 2*theta3 - 3*theta2 + 1;
+		float h10 = theta3 - 2*theta2 + theta;
+		float h01 = -2*theta3 + 3*theta2;
+		float h11 = theta3 - theta2;
+
+		float p[6][SCREEN_LANES];
+		for (uint8_t c = 0; c < 6; c++) {
+			uint8_t i = positions[c];
+			for (uint8_t lane = 0; lane < SCREEN_LANES; lane++)
+				p[c][lane] = h00*batch->state[i][lane] + h01*batch->next[i][lane] +
+					batch->timeStep[lane]*(h10*batch->k[0][i][lane] + h11*derivative[i][lane]);
+		}
+
+		/* The first event of the step wins, in the order of checkCollision() */
+		for (uint8_t lane = 0; lane < SCREEN_LANES; lane++) {
+			float d2EarthMoon = (p[2][lane] - p[4][lane])*(p[2][lane] - p[4][lane]) +
+				(p[3][lane] - p[5][lane])*(p[3][lane] - p[5][lane]);
+			float d2EarthSat  = (p[2][lane] - p[0][lane])*(p[2][lane] - p[0][lane]) +
+				(p[3][lane] - p[1][lane])*(p[3][lane] - p[1][lane]);
+			float d2MoonSat   = (p[4][lane] - p[0][lane])*(p[4][lane] - p[0][lane]) +
+				(p[5][lane] - p[1][lane])*(p[5][lane] - p[1][lane]);
+
+			uint8_t result = (d2MoonSat < moonLimit*moonLimit) ? RESULT_COLLISION_MOON :
+				(d2EarthSat < earthLimit*earthLimit) ? RESULT_COLLISION_EARTH :
+				(d2EarthMoon*4 < d2EarthSat) ? RESULT_ESCAPE : 0;
+			if (batch->result[lane] == 0 && accept[lane] != 0 &&
+					d2MoonSat < batch->closestMoon[lane].distanceSquared) {
+				batch->closestMoon[lane].distanceSquared = d2MoonSat;
+				batch->closestMoon[lane].time = batch->time[lane] + theta*batch->timeStep[lane];
+			}
+			if (result != 0 && batch->result[lane] == 0 && accept[lane] != 0) {
+				batch->result[lane] = result;
+				batch->eventTime[lane] = batch->time[lane] + theta*batch->timeStep[lane];
+			}
+		}
+	}
+}
+
+
+uint8_t screenedSweep(sweep_t *sweep, configuration_t configuration, double limit,
+		uint32_t *bestIndex, double *bestCost, uint32_t *refined) {
+
+	uint32_t count = sweep->count;
+	*refined = 0;
+	if (count == 0) return FALSE;
+
+	/* First tier: every candidate in single precision */
+	outcome_t *screened = (outcome_t *)malloc((size_t)count*sizeof(outcome_t));
+	outcome_t *outcomes = (outcome_t *)malloc((size_t)count*sizeof(outcome_t));
+	uint32_t *selection = (uint32_t *)malloc((size_t)count*sizeof(uint32_t));
+	uint8_t *selected = (uint8_t *)calloc(count, sizeof(uint8_t));
+
+	sweep_t screen = { .candidates = sweep->candidates, .count = count,
+		.integrator = sweep->integrator, .cost = sweep->cost, .screening = TRUE,
+		.outcomes = screened, .bounded = sweep->bounded };
+	atomic_init(&screen.bound, configuration.endTime);
+	uint32_t screenIndex;
+	double screenCost;
+	uint8_t screenFound = runSweep(&screen, configuration, &screenIndex, &screenCost);
+
+	/* Lattice of the candidates: index + 1 of the candidate at each point, 0 if none */
+	double *axis;
+	uint32_t axisCount = buildAxis(limit, configuration.accuracy, TRUE, &axis);
+	free(axis);
+	uint32_t *lattice = (uint32_t *)calloc((size_t)axisCount*axisCount, sizeof(uint32_t));
+	for (uint32_t k = 0; k < count; k++) {
+		long i = lround((sweep->candidates[k].dvx + limit)/configuration.accuracy);
+		long j = lround((sweep->candidates[k].dvy + limit)/configuration.accuracy);
+		if (i >= 0 && j >= 0 && i < axisCount && j < axisCount)
+			lattice[i*axisCount + j] = k + 1;
+		else
+			selected[k] = SELECTED_OPTIMUM;
+	}
+
+	/* Second tier, first the candidates close to the screened optimum (and any off the
+	 * lattice), which give the incumbent */
+	for (uint32_t k = 0; k < count; k++) {
+		double cost;
+		if (screenFound && (sweep->cost)(sweep->candidates[k], screened[k], &cost) &&
+				cost <= screenCost*(1 + SCREEN_MARGIN))
+			selected[k] = SELECTED_OPTIMUM;
+	}
+	uint32_t selectionCount = 0;
+	for (uint32_t k = 0; k < count; k++)
+		if (selected[k])
+			selection[selectionCount++] = k;
+	uint8_t found = integrateSelection(sweep, configuration, selection, selectionCount,
+			outcomes, bestIndex, bestCost);
+
+	/* Then the candidates on an outcome boundary that could still beat the incumbent */
+	uint32_t boundaryCount = 0;
+	for (uint32_t i = 0; i < axisCount; i++) {
+		for (uint32_t j = 0; j < axisCount; j++) {
+			uint32_t k = lattice[i*axisCount + j];
+			if (k-- == 0 || selected[k]) continue;
+
+			double cost;
+			if (found && (sweep->cost)(sweep->candidates[k], OPTIMISTIC_OUTCOME, &cost) &&
+					cost > *bestCost)
+				continue;
+			for (int di = -1; di <= 1 && !selected[k]; di++) {
+				for (int dj = -1; dj <= 1; dj++) {
+					long ni = (long)i + di, nj = (long)j + dj;
+					if (ni < 0 || nj < 0 || ni >= axisCount || nj >= axisCount) continue;
+					uint32_t neighbour = lattice[ni*axisCount + nj];
+					if (neighbour != 0 && differs(screened[k], screened[neighbour - 1])) {
+						selected[k] = SELECTED_BOUNDARY;
+						break;
+					}
+				}
+			}
+		}
+	}
+	free(lattice);
+	uint32_t *boundary = selection + selectionCount;
+	for (uint32_t k = 0; k < count; k++)
+		if (selected[k] == SELECTED_BOUNDARY)
+			boundary[boundaryCount++] = k;
+
+	uint32_t boundaryIndex;
+	double boundaryCost;
+	if (integrateSelection(sweep, configuration, boundary, boundaryCount, outcomes,
+				&boundaryIndex, &boundaryCost) && (!found || boundaryCost < *bestCost ||
+				(boundaryCost == *bestCost && boundaryIndex < *bestIndex))) {
+		*bestIndex = boundaryIndex;
+		*bestCost = boundaryCost;
+		found = TRUE;
+	}
+	selectionCount += boundaryCount;
+	*refined = selectionCount;
+
+	/* Verification: where the tiers disagree */
+	uint32_t disagreements = reportDisagreements("refined", sweep, configuration, selection,
+			selectionCount, screened, outcomes);
+	printf("Screened %u candidates in single precision, refined %u (%.1f%%), "
+			"%u disagreement(s)\n", count, selectionCount, 100.0*selectionCount/count,
+			disagreements);
+
+	/* Full verification: the candidates that were not refined, in double precision too */
+	if (configuration.screen == SCREEN_VERIFY) {
+		uint32_t restCount = 0;
+		for (uint32_t k = 0; k < count; k++)
+			if (!selected[k])
+				selection[restCount++] = k;
+		uint32_t restIndex;
+		double restCost;
+		uint8_t restFound = integrateSelection(sweep, configuration, selection, restCount,
+				outcomes, &restIndex, &restCost);
+		uint32_t missed = reportDisagreements("unrefined", sweep, configuration, selection,
+				restCount, screened, outcomes);
+		printf("Verified the %u unrefined candidates: %u disagreement(s)", restCount, missed);
+		if (restFound && (!found || restCost < *bestCost ||
+					(restCost == *bestCost && restIndex < *bestIndex)))
+			printf(", the optimum was MISSED: (%.2f, %.2f)", sweep->candidates[restIndex].dvx,
+					sweep->candidates[restIndex].dvy);
+		printf("\n");
+	}
+
+	free(screened);
+	free(outcomes);
+	free(selection);
+	free(selected);
+	return found;
+}
+
+
+uint8_t differs(outcome_t first, outcome_t second) {
+	return first.result != second.result;
+}
+
+
+uint8_t integrateSelection(sweep_t *sweep, configuration_t configuration,
+		const uint32_t *selection, uint32_t count, outcome_t *outcomes,
+		uint32_t *bestIndex, double *bestCost) {
+
+	/* A sweep over the selection, in the original order so that ties resolve alike */
+	candidate_t *candidates = sweep->candidates;
+	uint32_t fullCount = sweep->count;
+	outcome_t *fullOutcomes = sweep->outcomes;
+
+	sweep->candidates = (candidate_t *)malloc((size_t)count*sizeof(candidate_t));
+	sweep->outcomes = (outcome_t *)malloc((size_t)count*sizeof(outcome_t));
+	sweep->count = count;
+	for (uint32_t k = 0; k < count; k++)
+		sweep->candidates[k] = candidates[selection[k]];
+
+	uint32_t index;
+	uint8_t found = count > 0 && runSweep(sweep, configuration, &index, bestCost);
+	if (found)
+		*bestIndex = selection[index];
+	for (uint32_t k = 0; k < count; k++) {
+		outcomes[selection[k]] = sweep->outcomes[k];
+		if (fullOutcomes != NULL)
+			fullOutcomes[selection[k]] = sweep->outcomes[k];
+	}
+
+	free(sweep->candidates);
+	free(sweep->outcomes);
+	sweep->candidates = candidates;
+	sweep->count = fullCount;
+	sweep->outcomes = fullOutcomes;
+	return found;
+}
+
+
+uint32_t reportDisagreements(const char *label, const sweep_t *sweep,
+		configuration_t configuration, const uint32_t *selection, uint32_t count,
+		const outcome_t *screened, const outcome_t *outcomes) {
+
+	uint32_t disagreements = 0;
+	for (uint32_t k = 0; k < count; k++) {
+		uint32_t index = selection[k];
+		outcome_t coarse = screened[index], fine = outcomes[index];
+
+		/* Stopped early by the branch and bound, the outcome is unknown */
+		if ((fine.result == 0 && fine.stopTime < configuration.endTime) ||
+				(coarse.result == 0 && coarse.stopTime < configuration.endTime))
+			continue;
+		if (!differs(coarse, fine)) continue;
+
+		if (disagreements++ < SCREEN_REPORT_LIMIT)
+			printf("\t%s (%.2f, %.2f): screened %s at %.0f s, integrated %s at %.0f s\n",
+					label, sweep->candidates[index].dvx, sweep->candidates[index].dvy,
+					RESULT_NAMES[coarse.result], coarse.stopTime,
+					RESULT_NAMES[fine.result], fine.stopTime);
+	}
+	if (disagreements > SCREEN_REPORT_LIMIT)
+		printf("\t... and %u more\n", disagreements - SCREEN_REPORT_LIMIT);
+	return disagreements;
+}
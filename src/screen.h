@@ -0,0 +1,90 @@
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rk45_constants.h"
+#include "tableau.h"
+#include "equations.h"
+#include "events.h"
+#include "batch.h"
+#include "sweep.h"
+#include "configuration.h"
+
+/* Trajectories screened in lockstep: 16 floats fill an AVX-512 register, twice BATCH_LANES */
+#define SCREEN_LANES 		(16)
+
+/* The screening integration runs with the tolerances of config.control times this */
+#define SCREEN_LOOSENESS 	(1E1)
+
+/* Candidates screened within this fraction of the best screened cost are refined */
+#define SCREEN_MARGIN 		(0.01)
+
+/* Disagreements between the tiers printed in full, the others are only counted */
+#define SCREEN_REPORT_LIMIT (10)
+
+/**
+ * Single precision structure-of-arrays state for SCREEN_LANES three body trajectories,
+ * the layout of batch_t. Times stay in double precision, so stop times do not drift.
+ */
+typedef struct {
+
+	/* Current state, stage derivatives, stage argument and candidate solution */
+	float state[THREE_BODY_STATE_SIZE][SCREEN_LANES];
+	float k[TABLEAU_MAX_STAGES][THREE_BODY_STATE_SIZE][SCREEN_LANES];
+	float stage[THREE_BODY_STATE_SIZE][SCREEN_LANES];
+	float next[THREE_BODY_STATE_SIZE][SCREEN_LANES];
+
+	/* Per lane integration progress */
+	double time[SCREEN_LANES];
+	float timeStep[SCREEN_LANES];
+
+	/* Per lane step controller state (see step_state_t), rejected is 1 or 0. Double
+	 * precision, like the controller. */
+	double previousError[SCREEN_LANES];
+	double previousStep[SCREEN_LANES];
+	double rejected[SCREEN_LANES];
+	double eventTime[SCREEN_LANES];
+	uint8_t result[SCREEN_LANES];
+
+	/* Smallest squared spacecraft to Earth distance seen so far */
+	float closestEarth[SCREEN_LANES];
+
+	/* Closest approach to the Moon among the event samples so far */
+	approach_t closestMoon[SCREEN_LANES];
+
+	/* Candidate currently held by each lane, and whether the lane holds one */
+	uint32_t index[SCREEN_LANES];
+	uint8_t active[SCREEN_LANES];
+
+} screen_batch_t;
+
+/**
+ * Coarse integration of many three body trajectories in single precision, with the
+ * tableau of config and the step control of rk45Batch(), its tolerances loosened by
+ * SCREEN_LOOSENESS, for the first tier of screenedSweep(). Lanes are filled from source
+ * and refilled like rk45Batch(). Events are sampled on the dense
+ * output but not located: a lane stops at the first sample past an event surface.
+ */
+void rk45Screen(batch_source_t source, batch_sink_t sink, void *context,
+		configuration_t config, screen_batch_t *batch);
+
+/**
+ * Two tier sweep over candidates that lie on the lattice of buildGrid() (limit and
+ * configuration.accuracy). Every candidate is first screened with rk45Screen(). The
+ * second tier integrates again, with the integrator of sweep, the candidates whose
+ * screened cost is within SCREEN_MARGIN of the best screened cost, then those with a
+ * lattice neighbour that screened to a different result, unless even an immediate
+ * Earth return would cost more than the best of the first ones. The best candidate is
+ * taken from the second tier, ties broken by index like runSweep(). Candidates where
+ * the two tiers disagree are reported; with SCREEN_VERIFY every candidate is integrated
+ * again, and the disagreements outside the refined set are reported separately.
+ * refined receives the size of the second tier.
+ */
+uint8_t screenedSweep(sweep_t *sweep, configuration_t configuration, double limit,
+		uint32_t *bestIndex, double *bestCost, uint32_t *refined);
+
+#endif /* _SCREEN_H_ */
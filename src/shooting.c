@@ -0,0 +1,227 @@
+#include "shooting.h"
+
+/* Linearized constraint a.x <= b on the impulse x */
+typedef struct {
+	double a[2];
+	double b;
+} constraint_t;
+
+/**
+ * Integrate a candidate with its state transition matrix, and linearize in the impulse
+ * the constraints that hold its solution: the perigee inside the Earth, when it comes
+ * back to the Earth without striking the Moon, and the perilune outside the Moon's
+ * limit (radius and clearance). Both sit SHOOTING_MARGIN from their surface. Returns
+ * the number of constraints, 0 if the trajectory says nothing about either.
+ */
+static uint8_t propagate(candidate_t candidate, configuration_t configuration,
+		workspace_t *workspace, constraint_t constraints[2]);
+
+/**
+ * Constraint on the conic through relative (x, y, vx, vy) about a body of gravitational
+ * parameter mu, carried to the impulse by the velocity columns of the state transition
+ * matrix phi: periapsis inside radius (inside TRUE) or outside it, on the current side
+ */
+static constraint_t linearize(const double *relative, const double *phi, double mu,
+		double radius, uint8_t inside, candidate_t candidate);
+
+/**
+ * Square root of the periapsis distance of the two body conic about a body through a
+ * relative state (x, y, vx, vy), with the sign of its angular momentum. Unlike the
+ * periapsis itself it is close to linear in the impulse through a head-on impact, and
+ * the impacts are the interval between the roots of the body's radius on either side.
+ */
+static double periapsisRoot(const double *relative, double mu);
+
+/**
+ * Smallest x satisfying count linearized constraints (a 2D quadratic program: the
+ * origin, the projections on each constraint and their intersection are the only
+ * candidates). Returns FALSE if they cannot all hold.
+ */
+static uint8_t smallestImpulse(const constraint_t *constraints, uint8_t count, double x[2]);
+
+
+uint8_t shootingSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		candidate_t *best, double *bestCost, uint32_t *evaluations) {
+
+	*evaluations = 0;
+	workspace_t *workspace = createWorkspace(VARIATIONAL_STATE_SIZE);
+	double closestEarth[VARIATIONAL_STATE_SIZE], closestMoon[VARIATIONAL_STATE_SIZE];
+	workspace->closestEarthState = closestEarth;
+	workspace->closestMoonState = closestMoon;
+
+	candidate_t solutions[SHOOTING_SEEDS];
+	uint32_t count = 0;
+	for (uint8_t seed = 0; seed < SHOOTING_SEEDS; seed++) {
+		double angle = 2*M_PI*seed/SHOOTING_SEEDS;
+		candidate_t x = { 0.5*limit*cos(angle), 0.5*limit*sin(angle) };
+
+		uint8_t converged = FALSE;
+		for (uint8_t iteration = 0; iteration < SHOOTING_ITERATIONS && !converged; iteration++) {
+			constraint_t constraints[2];
+			uint8_t linearized = propagate(x, configuration, workspace, constraints);
+			(*evaluations)++;
+
+			double target[2] = { 0, 0 };
+			if (linearized == 0 || !smallestImpulse(constraints, linearized, target)) break;
+
+			/* Far from the solution the linearization does not hold, limit the step */
+			double step[2] = { target[0] - x.dvx, target[1] - x.dvy };
+			double length = sqrt(step[0]*step[0] + step[1]*step[1]);
+			if (length > SHOOTING_MAX_STEP) {
+				step[0] *= SHOOTING_MAX_STEP/length;
+				step[1] *= SHOOTING_MAX_STEP/length;
+			}
+			x.dvx += step[0];
+			x.dvy += step[1];
+			converged = (length < SHOOTING_TOL);
+		}
+		if (converged && fabs(x.dvx) <= limit && fabs(x.dvy) <= limit)
+			solutions[count++] = x;
+	}
+	destroyWorkspace(workspace);
+	printf("Shooting converged from %u of %d seeds\n", count, SHOOTING_SEEDS);
+	if (count == 0) return FALSE;
+
+	/* Check the solutions with the plain equations and the sweep's integrator, in seed
+	 * order */
+	sweep_t check = { .candidates = solutions, .count = count, .integrator = sweep->integrator,
+		.cost = sweep->cost };
+	uint32_t bestIndex;
+	uint8_t found = runSweep(&check, configuration, &bestIndex, bestCost);
+	*evaluations += count;
+	if (found)
+		*best = solutions[bestIndex];
+	return found;
+}
+
+
+uint8_t propagate(candidate_t candidate, configuration_t configuration,
+		workspace_t *workspace, constraint_t constraints[2]) {
+
+	/* Three body state with the impulse, and the identity matrix */
+	double state[VARIATIONAL_STATE_SIZE] = { 0 };
+	fillInitialConditions(state, THREE_BODY_STATE_SIZE);
+	state[2] += candidate.dvx;
+	state[3] += candidate.dvy;
+	for (uint8_t i = 0; i < BODY_STATE_SIZE; i++)
+		state[THREE_BODY_STATE_SIZE + i*BODY_STATE_SIZE + i] = 1;
+	double start = hypot(state[0] - state[4], state[1] - state[5]);
+
+	configuration.stateSize = VARIATIONAL_STATE_SIZE;
+	configuration.timeBound = NULL;
+	configuration.loggingEnabled = 0;
+	double stopTime;
+	uint8_t result = rk45(variationalEquations, state, configuration, workspace, &stopTime);
+
+	const bodies_t *bodies = getBodies();
+	double relative[BODY_STATE_SIZE];
+	uint8_t count = 0;
+
+	/* A trajectory that never gets closer to the Earth than it started did not return */
+	const double *earth = workspace->closestEarthState;
+	for (uint8_t i = 0; i < BODY_STATE_SIZE; i++)
+		relative[i] = earth[i] - earth[BODY_EARTH*BODY_STATE_SIZE + i];
+	uint8_t returned = (hypot(relative[0], relative[1]) < start);
+	if (result != RESULT_COLLISION_MOON && !returned)
+		return 0;
+	if (result != RESULT_COLLISION_MOON)
+		constraints[count++] = linearize(relative, earth + THREE_BODY_STATE_SIZE,
+				bodies->mu[BODY_EARTH], bodies->radius[BODY_EARTH] - SHOOTING_MARGIN, TRUE,
+				candidate);
+
+	const double *moon = workspace->closestMoonState;
+	for (uint8_t i = 0; i < BODY_STATE_SIZE; i++)
+		relative[i] = moon[i] - moon[BODY_MOON*BODY_STATE_SIZE + i];
+	constraints[count++] = linearize(relative, moon + THREE_BODY_STATE_SIZE,
+			bodies->mu[BODY_MOON], bodies->radius[BODY_MOON] + getClearance() + SHOOTING_MARGIN,
+			FALSE, candidate);
+	return count;
+}
+
+
+constraint_t linearize(const double *relative, const double *phi, double mu,
+		double radius, uint8_t inside, candidate_t candidate) {
+
+	/* Gradient of the root in the relative state (central differences, the conic is
+	 * cheap), then in the impulse through the velocity columns of the matrix */
+	double work[BODY_STATE_SIZE], partial[BODY_STATE_SIZE];
+	memcpy(work, relative, sizeof(work));
+	for (uint8_t i = 0; i < BODY_STATE_SIZE; i++) {
+		double scale = i < 2 ? hypot(relative[0], relative[1]) : hypot(relative[2], relative[3]);
+		double h = 1E-6*scale;
+		work[i] = relative[i] + h;
+		double above = periapsisRoot(work, mu);
+		work[i] = relative[i] - h;
+		double below = periapsisRoot(work, mu);
+		work[i] = relative[i];
+		partial[i] = (above - below)/(2*h);
+	}
+	double gradient[2] = { 0, 0 };
+	for (uint8_t j = 0; j < 2; j++)
+		for (uint8_t i = 0; i < BODY_STATE_SIZE; i++)
+			gradient[j] += partial[i]*phi[i*BODY_STATE_SIZE + 2 + j];
+
+	/* side*root <= sqrt(radius) inside, side*root >= sqrt(radius) outside, with root
+	 * linear in the impulse around the candidate */
+	double root = periapsisRoot(relative, mu);
+	double side = (root < 0) ? -1 : 1, sign = inside ? side : -side;
+	constraint_t constraint;
+	constraint.a[0] = sign*gradient[0];
+	constraint.a[1] = sign*gradient[1];
+	constraint.b = (inside ? sqrt(radius) : -sqrt(radius)) - sign*root +
+		constraint.a[0]*candidate.dvx + constraint.a[1]*candidate.dvy;
+	return constraint;
+}
+
+
+double periapsisRoot(const double *relative, double mu) {
+
+	double r = hypot(relative[0], relative[1]);
+	double v2 = relative[2]*relative[2] + relative[3]*relative[3];
+	double h = relative[0]*relative[3] - relative[1]*relative[2];
+	double energy = 0.5*v2 - mu/r;
+	double e = sqrt(fmax(0, 1 + 2*energy*h*h/(mu*mu)));
+	return h/sqrt(mu*(1 + e));
+}
+
+
+uint8_t smallestImpulse(const constraint_t *constraints, uint8_t count, double x[2]) {
+
+	/* Candidates: the origin, each projection, and the intersection of two */
+	double candidates[4][2] = { { 0, 0 } };
+	uint8_t candidateCount = 1;
+	for (uint8_t k = 0; k < count; k++) {
+		const constraint_t *c = &constraints[k];
+		double norm2 = c->a[0]*c->a[0] + c->a[1]*c->a[1];
+		if (norm2 == 0) continue;
+		candidates[candidateCount][0] = c->a[0]*c->b/norm2;
+		candidates[candidateCount++][1] = c->a[1]*c->b/norm2;
+	}
+	if (count == 2) {
+		const constraint_t *c = constraints, *d = constraints + 1;
+		double det = c->a[0]*d->a[1] - c->a[1]*d->a[0];
+		if (det != 0) {
+			candidates[candidateCount][0] = (c->b*d->a[1] - c->a[1]*d->b)/det;
+			candidates[candidateCount++][1] = (c->a[0]*d->b - c->b*d->a[0])/det;
+		}
+	}
+
+	uint8_t found = FALSE;
+	double smallest = INFINITY;
+	for (uint8_t k = 0; k < candidateCount; k++) {
+		uint8_t feasible = TRUE;
+		for (uint8_t j = 0; j < count; j++) {
+			const constraint_t *c = &constraints[j];
+			double value = c->a[0]*candidates[k][0] + c->a[1]*candidates[k][1];
+			feasible &= (value <= c->b + 1E-9*(fabs(c->b) + 1));
+		}
+		double norm = hypot(candidates[k][0], candidates[k][1]);
+		if (feasible && norm < smallest) {
+			smallest = norm;
+			x[0] = candidates[k][0];
+			x[1] = candidates[k][1];
+			found = TRUE;
+		}
+	}
+	return found;
+}
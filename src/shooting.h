@@ -0,0 +1,42 @@
+#ifndef _SHOOTING_H_
+#define _SHOOTING_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "integrator.h"
+#include "configuration.h"
+
+/* Seed impulses, evenly spaced on the circle of half the box width */
+#define SHOOTING_SEEDS 			(8)
+
+/* Newton iterations of one seed */
+#define SHOOTING_ITERATIONS 	(20)
+
+/* Margin kept inside the Earth and outside the Moon (m), so solutions strictly hold */
+#define SHOOTING_MARGIN 		(1E4)
+
+/* A seed has converged once its correction is below this (m/s) */
+#define SHOOTING_TOL 			(1E-2)
+
+/* Largest correction of a single iteration (m/s) */
+#define SHOOTING_MAX_STEP 		(10)
+
+/**
+ * Minimal impulse to an Earth impact by differential correction, from SHOOTING_SEEDS
+ * seeds in the box [-limit, limit]^2. Each iteration integrates the state transition
+ * matrix with the state (variationalEquations()), linearizes in (dvx, dvy) the
+ * osculating perigee of the closest Earth approach (inside the Earth) and perilune of
+ * the closest Moon approach (outside the Moon and its clearance), then moves to the
+ * smallest impulse that satisfies both. The iterations always integrate the full
+ * three body equations with rk45(). The converged impulses are checked with the
+ * integrator of sweep, like the grid they stand in for, and scored with the sweep's
+ * cost, ties going to the earlier seed. Returns FALSE if none impacts the Earth,
+ * otherwise fills best and bestCost. evaluations receives the number of integrations.
+ */
+uint8_t shootingSearch(sweep_t *sweep, configuration_t configuration, double limit,
+		candidate_t *best, double *bestCost, uint32_t *evaluations);
+
+#endif /* _SHOOTING_H_ */
@@ -0,0 +1,152 @@
+#include "stats.h"
+
+#ifdef INTEGRATOR_STATS
+
+/**
+ * Keep an entry among the STATS_WORST longest trajectories of a summary
+ */
+static void keepWorst(stats_summary_t *summary, const stats_entry_t *entry);
+
+
+void statsBegin(integrator_stats_t *stats) {
+
+	stats->evaluations = 0;
+	stats->accepted = 0;
+	stats->rejected = 0;
+	stats->minStep = INFINITY;
+	stats->maxStep = 0;
+	for (uint8_t bucket = 0; bucket < STATS_BUCKETS; bucket++)
+		stats->histogram[bucket] = 0;
+	stats->result = 0;
+	stats->wallTime = 0;
+	clock_gettime(CLOCK_MONOTONIC, &stats->start);
+}
+
+
+void statsStep(integrator_stats_t *stats, double timeStep, uint8_t accepted) {
+
+	if (accepted) stats->accepted++;
+	else stats->rejected++;
+	stats->minStep = fmin(stats->minStep, timeStep);
+	stats->maxStep = fmax(stats->maxStep, timeStep);
+
+	int bucket = (int)floor(log10(timeStep)) - STATS_FIRST_DECADE;
+	if (bucket < 0) bucket = 0;
+	if (bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+	stats->histogram[bucket]++;
+}
+
+
+void statsEnd(integrator_stats_t *stats, uint8_t result) {
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats->wallTime = (end.tv_sec - stats->start.tv_sec) +
+		1E-9*(end.tv_nsec - stats->start.tv_nsec);
+	stats->result = result;
+}
+
+
+void summaryAdd(stats_summary_t *summary, double dvx, double dvy,
+		const integrator_stats_t *stats) {
+
+	if (summary->trajectories == 0) {
+		summary->minStep = stats->minStep;
+		summary->maxStep = stats->maxStep;
+	}
+	summary->trajectories++;
+	summary->evaluations += stats->evaluations;
+	summary->accepted += stats->accepted;
+	summary->rejected += stats->rejected;
+	summary->minStep = fmin(summary->minStep, stats->minStep);
+	summary->maxStep = fmax(summary->maxStep, stats->maxStep);
+	for (uint8_t bucket = 0; bucket < STATS_BUCKETS; bucket++)
+		summary->histogram[bucket] += stats->histogram[bucket];
+	if (stats->result < STATS_RESULTS)
+		summary->results[stats->result]++;
+	summary->wallTime += stats->wallTime;
+
+	stats_entry_t entry = { .dvx = dvx, .dvy = dvy, .stats = *stats };
+	keepWorst(summary, &entry);
+}
+
+
+void summaryMerge(stats_summary_t *into, const stats_summary_t *from) {
+
+	if (from->trajectories == 0) return;
+	if (into->trajectories == 0) {
+		into->minStep = from->minStep;
+		into->maxStep = from->maxStep;
+	}
+	into->trajectories += from->trajectories;
+	into->evaluations += from->evaluations;
+	into->accepted += from->accepted;
+	into->rejected += from->rejected;
+	into->minStep = fmin(into->minStep, from->minStep);
+	into->maxStep = fmax(into->maxStep, from->maxStep);
+	for (uint8_t bucket = 0; bucket < STATS_BUCKETS; bucket++)
+		into->histogram[bucket] += from->histogram[bucket];
+	for (uint8_t result = 0; result < STATS_RESULTS; result++)
+		into->results[result] += from->results[result];
+	into->wallTime += from->wallTime;
+
+	for (uint8_t index = 0; index < from->worstCount; index++)
+		keepWorst(into, &from->worst[index]);
+}
+
+
+void printSummary(const stats_summary_t *summary) {
+
+	printf("\nIntegrator statistics (%llu trajectories)\n",
+			(unsigned long long)summary->trajectories);
+	if (summary->trajectories == 0) return;
+
+	double n = (double)summary->trajectories;
+	printf("\tRHS evaluations:   %llu (%.1f per trajectory)\n",
+			(unsigned long long)summary->evaluations, summary->evaluations/n);
+	printf("\tSteps:             %llu accepted, %llu rejected\n",
+			(unsigned long long)summary->accepted, (unsigned long long)summary->rejected);
+	printf("\tStep size:         %.3g s to %.3g s\n", summary->minStep, summary->maxStep);
+	printf("\tWall time:         %.3f s (%.3g s per trajectory)\n", summary->wallTime,
+			summary->wallTime/n);
+	printf("\tTermination:       %llu none, %llu Earth, %llu Moon, %llu escape\n",
+			(unsigned long long)summary->results[0], (unsigned long long)summary->results[1],
+			(unsigned long long)summary->results[2], (unsigned long long)summary->results[3]);
+
+	printf("\tStep size histogram (attempted steps per decade):\n");
+	for (uint8_t bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+		if (summary->histogram[bucket] == 0) continue;
+		printf("\t\t[1e%+d, 1e%+d) s: %llu\n", bucket + STATS_FIRST_DECADE,
+				bucket + STATS_FIRST_DECADE + 1, (unsigned long long)summary->histogram[bucket]);
+	}
+
+	printf("\tMost expensive trajectories:\n");
+	for (uint8_t index = 0; index < summary->worstCount; index++) {
+		const stats_entry_t *entry = &summary->worst[index];
+		printf("\t\t(%8.2f, %8.2f): %.3g s, %llu evaluations, %llu rejected, "
+				"min step %.3g s, result %d\n", entry->dvx, entry->dvy, entry->stats.wallTime,
+				(unsigned long long)entry->stats.evaluations,
+				(unsigned long long)entry->stats.rejected, entry->stats.minStep,
+				entry->stats.result);
+	}
+}
+
+
+void keepWorst(stats_summary_t *summary, const stats_entry_t *entry) {
+
+	/* Sorted by decreasing wall time, insertion from the back */
+	uint8_t position = summary->worstCount;
+	if (position == STATS_WORST) {
+		if (entry->stats.wallTime <= summary->worst[STATS_WORST - 1].stats.wallTime) return;
+		position = STATS_WORST - 1;
+	} else {
+		summary->worstCount++;
+	}
+	while (position > 0 && summary->worst[position - 1].stats.wallTime < entry->stats.wallTime) {
+		summary->worst[position] = summary->worst[position - 1];
+		position--;
+	}
+	summary->worst[position] = *entry;
+}
+
+#endif /* INTEGRATOR_STATS */
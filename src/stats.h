@@ -0,0 +1,91 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/**
+ * Integrator statistics, compiled in with -DINTEGRATOR_STATS (make STATS_FLAGS=
+ * -DINTEGRATOR_STATS). Without it the STATS() statements, the statistics fields and
+ * this module's functions all disappear, so the hot paths are unchanged.
+ */
+#ifdef INTEGRATOR_STATS
+#define STATS(statement) 	statement
+#else
+#define STATS(statement)
+#endif
+
+#ifdef INTEGRATOR_STATS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+/* Step size histogram: decades from 10^STATS_FIRST_DECADE s up */
+#define STATS_BUCKETS 			(12)
+#define STATS_FIRST_DECADE 		(-3)
+
+/* Most expensive trajectories kept for the summary */
+#define STATS_WORST 			(8)
+
+/* Termination codes counted in the summary (none, Earth, Moon, escape) */
+#define STATS_RESULTS 			(4)
+
+/* Counters of a single trajectory */
+typedef struct {
+	uint64_t evaluations;
+	uint64_t accepted;
+	uint64_t rejected;
+	double minStep;
+	double maxStep;
+	uint32_t histogram[STATS_BUCKETS];
+	uint8_t result;
+
+	/* Wall time: start of the integration, then its duration (s) */
+	struct timespec start;
+	double wallTime;
+} integrator_stats_t;
+
+/* A trajectory of the summary, with its impulse */
+typedef struct {
+	double dvx;
+	double dvy;
+	integrator_stats_t stats;
+} stats_entry_t;
+
+/* Totals over many trajectories, and the ones that took the longest */
+typedef struct {
+	uint64_t trajectories;
+	uint64_t evaluations;
+	uint64_t accepted;
+	uint64_t rejected;
+	double minStep;
+	double maxStep;
+	uint64_t histogram[STATS_BUCKETS];
+	uint64_t results[STATS_RESULTS];
+	double wallTime;
+
+	uint8_t worstCount;
+	stats_entry_t worst[STATS_WORST];
+} stats_summary_t;
+
+/* Reset the counters and start the clock of a trajectory */
+void statsBegin(integrator_stats_t *stats);
+
+/* Count an attempted step of size timeStep */
+void statsStep(integrator_stats_t *stats, double timeStep, uint8_t accepted);
+
+/* Stop the clock of a trajectory and keep its termination code */
+void statsEnd(integrator_stats_t *stats, uint8_t result);
+
+/* Add a finished trajectory to a summary */
+void summaryAdd(stats_summary_t *summary, double dvx, double dvy,
+		const integrator_stats_t *stats);
+
+/* Merge the summary from into the summary into */
+void summaryMerge(stats_summary_t *into, const stats_summary_t *from);
+
+/* Print a summary */
+void printSummary(const stats_summary_t *summary);
+
+#endif /* INTEGRATOR_STATS */
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,419 @@
+#include "swarm.h"
+#include "util.h"
+#include "events.h"
+#include "integrator.h"
+
+/* Gravitational parameters in double precision */
+static const double muEarth = (double)G*MASS_EARTH;
+static const double muMoon  = (double)G*MASS_MOON;
+
+/**
+ * First shared step: the configured one, or the shortest initialStep() of the active
+ * particles, each taken as a restricted three body state
+ */
+static double firstStep(const swarm_t *swarm, const ephemeris_t *ephemeris,
+		configuration_t config);
+
+/**
+ * Derivative of the particles in the first n slots of the arrays in, written to out.
+ * The Moon is the same for every particle, so the loop vectorizes across particles.
+ */
+static void evaluateField(const swarm_t *swarm, const double moon[EPHEMERIS_COLUMNS],
+		double *const in[SWARM_COMPONENTS], double *const out[SWARM_COMPONENTS], uint32_t n);
+
+/**
+ * Sample the event functions of every active particle on the dense output of the
+ * accepted step [time, time + h], and locate the first event of the particles that
+ * crossed one, like locateEvent() in rk45(). derivative is f at the candidate
+ * solution. Results go in stage[2] and event times in stage[3], per slot.
+ */
+static void sampleEvents(swarm_t *swarm, const ephemeris_t *ephemeris, double time, double h,
+		double *const derivative[SWARM_COMPONENTS]);
+
+/**
+ * Locate the first event of the particle in a slot, with the Moon of the ephemeris in a
+ * three body state. Returns the RESULT_ code, 0 if the samples were a false alarm.
+ */
+static uint8_t locateParticle(const swarm_t *swarm, const ephemeris_t *ephemeris,
+		uint32_t slot, double time, double h, double *const derivative[SWARM_COMPONENTS],
+		double *eventTime);
+
+/**
+ * Record the particles whose step ended on an event, and move the last active ones
+ * into their slots
+ */
+static void retire(swarm_t *swarm);
+
+swarm_t *createSwarm(uint32_t count, const double *nominal) {
+
+	swarm_t *swarm = (swarm_t *)calloc(1, sizeof(swarm_t));
+	if (swarm == NULL) return NULL;
+
+	/* One block holds every per slot array, then the stop times */
+	uint32_t arrays = SWARM_COMPONENTS*(3 + TABLEAU_MAX_STAGES);
+	double *buffer = (double *)calloc((size_t)(arrays + 1)*count, sizeof(double));
+	swarm->slot = (uint32_t *)malloc(count*sizeof(uint32_t));
+	swarm->result = (uint8_t *)calloc(count, sizeof(uint8_t));
+	swarm->block = buffer;
+	if (buffer == NULL || swarm->slot == NULL || swarm->result == NULL) {
+		free(buffer);
+		free(swarm->slot);
+		free(swarm->result);
+		free(swarm);
+		return NULL;
+	}
+
+	for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+		swarm->state[c] = buffer + (size_t)c*count;
+		swarm->next[c]  = buffer + (size_t)(SWARM_COMPONENTS + c)*count;
+		swarm->stage[c] = buffer + (size_t)(2*SWARM_COMPONENTS + c)*count;
+		for (uint8_t s = 0; s < TABLEAU_MAX_STAGES; s++)
+			swarm->k[s][c] = buffer + (size_t)((3 + s)*SWARM_COMPONENTS + c)*count;
+	}
+	swarm->stopTime = buffer + (size_t)arrays*count;
+
+	swarm->count = count;
+	swarm->active = count;
+	swarm->earth[0] = nominal[4];
+	swarm->earth[1] = nominal[5];
+	for (uint32_t p = 0; p < count; p++) {
+		swarm->slot[p] = p;
+		for (uint8_t c = 0; c < SWARM_COMPONENTS; c++)
+			swarm->state[c][p] = nominal[c];
+	}
+	return swarm;
+}
+
+
+void destroySwarm(swarm_t *swarm) {
+
+	if (swarm == NULL) return;
+	free(swarm->block);
+	free(swarm->slot);
+	free(swarm->result);
+	free(swarm);
+}
+
+
+uint32_t propagateSwarm(swarm_t *swarm, const ephemeris_t *ephemeris, configuration_t config) {
+
+	const tableau_t *tableau = config.tableau;
+	const step_control_t *control = &config.control;
+	step_state_t controller = STEP_STATE_INIT;
+	double time = 0, h = firstStep(swarm, ephemeris, config);
+	double moon[EPHEMERIS_COLUMNS];
+	uint32_t steps = 0;
+
+	/* k1 = f(state) survives a rejected step, and is known after an accepted one */
+	uint8_t firstStageReady = FALSE;
+
+	while (swarm->active > 0 && time <= config.endTime) {
+		uint32_t n = swarm->active;
+
+		/* Stages, with one Moon lookup each for the whole swarm */
+		if (!firstStageReady) {
+			moonState(ephemeris, time, moon);
+			evaluateField(swarm, moon, swarm->state, swarm->k[0], n);
+			firstStageReady = TRUE;
+		}
+		for (uint8_t s = 1; s < tableau->stages; s++) {
+			for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+				double *restrict argument = swarm->stage[c];
+				const double *restrict state = swarm->state[c];
+				for (uint32_t p = 0; p < n; p++)
+					argument[p] = state[p];
+				for (uint8_t j = 0; j < s; j++) {
+					const double *restrict k = swarm->k[j][c];
+					double weight = h*tableau->a[s][j];
+					for (uint32_t p = 0; p < n; p++)
+						argument[p] += weight*k[p];
+				}
+			}
+			moonState(ephemeris, time + h*tableau->c[s], moon);
+			evaluateField(swarm, moon, swarm->stage, swarm->k[s], n);
+		}
+
+		/* Candidate solution, and the sum of the squared scaled errors (see step_control_t)
+		 * of every particle (in stage[0]) */
+		double *restrict error = swarm->stage[0];
+		for (uint32_t p = 0; p < n; p++)
+			error[p] = 0;
+		for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+			double absolute = control->absolute[c], relative = control->relative[c];
+			double *restrict next = swarm->next[c];
+			double *restrict difference = swarm->stage[1];
+			const double *restrict state = swarm->state[c];
+			for (uint32_t p = 0; p < n; p++) {
+				next[p] = state[p];
+				difference[p] = 0;
+			}
+			for (uint8_t j = 0; j < tableau->stages; j++) {
+				const double *restrict k = swarm->k[j][c];
+				double b = h*tableau->b[j], e = tableau->e[j];
+				for (uint32_t p = 0; p < n; p++) {
+					next[p] += b*k[p];
+					difference[p] += e*k[p];
+				}
+			}
+			for (uint32_t p = 0; p < n; p++) {
+				double a = fabs(state[p]), b = fabs(next[p]);
+				double scaled = h*difference[p]/(absolute + relative*(a > b ? a : b));
+				error[p] += scaled*scaled;
+			}
+		}
+
+		/* The particle with the largest error decides, with the controller of rk45() */
+		double worst = 0;
+		for (uint32_t p = 0; p < n; p++)
+			worst = error[p] > worst ? error[p] : worst;
+		double scaled = sqrt(worst/SWARM_COMPONENTS);
+		double factor = stepFactor(control, scaled, h, &controller);
+
+		if (scaled <= 1) {
+
+			/* Derivative at the candidate: the last FSAL stage, otherwise evaluated here
+			 * and reused as the next step's first stage */
+			uint8_t last = tableau->fsal ? tableau->stages - 1 : 1;
+			if (!tableau->fsal) {
+				moonState(ephemeris, time + h, moon);
+				evaluateField(swarm, moon, swarm->next, swarm->k[last], n);
+			}
+			sampleEvents(swarm, ephemeris, time, h, swarm->k[last]);
+
+			for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+				double *swap = swarm->state[c];
+				swarm->state[c] = swarm->next[c];
+				swarm->next[c] = swap;
+				swap = swarm->k[0][c];
+				swarm->k[0][c] = swarm->k[last][c];
+				swarm->k[last][c] = swap;
+			}
+			time += h;
+			steps++;
+			retire(swarm);
+		}
+		h = fmin(h*factor, control->maxStep);
+	}
+
+	/* Particles still in flight */
+	for (uint32_t p = 0; p < swarm->active; p++)
+		swarm->stopTime[swarm->slot[p]] = time;
+	return steps;
+}
+
+
+double firstStep(const swarm_t *swarm, const ephemeris_t *ephemeris,
+		configuration_t config) {
+
+	if (config.control.firstStep > 0) return config.control.firstStep;
+
+	/* equationsRestricted() takes the Moon from the ephemeris set with setEphemeris() */
+	const ephemeris_t *previous = getEphemeris();
+	setEphemeris(ephemeris);
+	double moon[EPHEMERIS_COLUMNS];
+	moonState(ephemeris, 0, moon);
+
+	double h = config.control.maxStep;
+	for (uint32_t p = 0; p < swarm->active; p++) {
+		double state[THREE_BODY_STATE_SIZE] = { 0 }, derivative[THREE_BODY_STATE_SIZE];
+		for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+			state[c] = swarm->state[c][p];
+			state[8 + c] = moon[c];
+		}
+		state[4] = swarm->earth[0];
+		state[5] = swarm->earth[1];
+		memcpy(derivative, state, sizeof(state));
+		equationsRestricted(0, derivative);
+		h = fmin(h, initialStep(&equationsRestricted, 0, state, derivative,
+				THREE_BODY_STATE_SIZE, &config.control));
+	}
+	setEphemeris(previous);
+	return h;
+}
+
+
+void evaluateField(const swarm_t *swarm, const double moon[EPHEMERIS_COLUMNS],
+		double *const in[SWARM_COMPONENTS], double *const out[SWARM_COMPONENTS], uint32_t n) {
+
+	/* Positions take the velocities; copied apart, the loop below vectorizes */
+	memcpy(out[0], in[2], n*sizeof(double));
+	memcpy(out[1], in[3], n*sizeof(double));
+
+	const double *restrict x = in[0], *restrict y = in[1];
+	double *restrict ax = out[2], *restrict ay = out[3];
+	double xe = swarm->earth[0], ye = swarm->earth[1], xm = moon[0], ym = moon[1];
+
+	for (uint32_t p = 0; p < n; p++) {
+		double dxEarth = xe - x[p], dyEarth = ye - y[p];
+		double dxMoon  = xm - x[p], dyMoon  = ym - y[p];
+		double d2Earth = dxEarth*dxEarth + dyEarth*dyEarth;
+		double d2Moon  = dxMoon*dxMoon + dyMoon*dyMoon;
+		double earthTerm = muEarth/(d2Earth*sqrt(d2Earth));
+		double moonTerm  = muMoon/(d2Moon*sqrt(d2Moon));
+
+		ax[p] = earthTerm*dxEarth + moonTerm*dxMoon;
+		ay[p] = earthTerm*dyEarth + moonTerm*dyMoon;
+	}
+}
+
+
+void sampleEvents(swarm_t *swarm, const ephemeris_t *ephemeris, double time, double h,
+		double *const derivative[SWARM_COMPONENTS]) {
+
+	uint32_t n = swarm->active;
+	const double *restrict x0 = swarm->state[0], *restrict y0 = swarm->state[1];
+	const double *restrict x1 = swarm->next[0], *restrict y1 = swarm->next[1];
+	const double *restrict vx0 = swarm->k[0][0], *restrict vy0 = swarm->k[0][1];
+	const double *restrict vx1 = derivative[0], *restrict vy1 = derivative[1];
+	double *restrict fired = swarm->stage[2];
+	double xe = swarm->earth[0], ye = swarm->earth[1];
+
+	const bodies_t *bodies = getBodies();
+	double moonLimit  = bodies->radius[BODY_MOON] + getClearance();
+	double earthLimit = bodies->radius[BODY_EARTH];
+
+	for (uint32_t p = 0; p < n; p++)
+		fired[p] = 0;
+	for (uint8_t sample = 1; sample <= EVENT_SAMPLES; sample++) {
+
+		/* Hermite basis functions and the Moon at this sample */
+		double theta = (double)sample/EVENT_SAMPLES;
+		double theta2 = theta*theta, theta3 = theta2*theta;
+		double h00 = 2*theta3 - 3*theta2 + 1;
+		double h10 = h*(theta3 - 2*theta2 + theta);
+		double h01 = -2*theta3 + 3*theta2;
+		double h11 = h*(theta3 - theta2);
+		double moon[EPHEMERIS_COLUMNS];
+		moonState(ephemeris, time + theta*h, moon);
+		double xm = moon[0], ym = moon[1];
+		double d2EarthMoon = (xm - xe)*(xm - xe) + (ym - ye)*(ym - ye);
+
+		/* Squared distances, compared against squared limits */
+		for (uint32_t p = 0; p < n; p++) {
+			double x = h00*x0[p] + h10*vx0[p] + h01*x1[p] + h11*vx1[p];
+			double y = h00*y0[p] + h10*vy0[p] + h01*y1[p] + h11*vy1[p];
+			double d2EarthSat = (x - xe)*(x - xe) + (y - ye)*(y - ye);
+			double d2MoonSat  = (x - xm)*(x - xm) + (y - ym)*(y - ym);
+			fired[p] += (d2EarthMoon*4 < d2EarthSat) + (d2EarthSat < earthLimit*earthLimit) +
+				(d2MoonSat < moonLimit*moonLimit);
+		}
+	}
+
+	/* Exact crossings, only for the particles that fired */
+	double *eventTime = swarm->stage[3];
+	for (uint32_t p = 0; p < n; p++)
+		if (fired[p] != 0)
+			fired[p] = locateParticle(swarm, ephemeris, p, time, h, derivative, &eventTime[p]);
+}
+
+
+uint8_t locateParticle(const swarm_t *swarm, const ephemeris_t *ephemeris,
+		uint32_t slot, double time, double h, double *const derivative[SWARM_COMPONENTS],
+		double *eventTime) {
+
+	/* Three body states at both ends of the step: the particle, the fixed Earth, and the
+	 * Moon with its tabulated velocity and acceleration */
+	double y0[THREE_BODY_STATE_SIZE] = { 0 }, f0[THREE_BODY_STATE_SIZE] = { 0 };
+	double y1[THREE_BODY_STATE_SIZE] = { 0 }, f1[THREE_BODY_STATE_SIZE] = { 0 };
+	double moon0[EPHEMERIS_COLUMNS], moon1[EPHEMERIS_COLUMNS];
+	moonState(ephemeris, time, moon0);
+	moonState(ephemeris, time + h, moon1);
+	for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+		y0[c] = swarm->state[c][slot];
+		f0[c] = swarm->k[0][c][slot];
+		y1[c] = swarm->next[c][slot];
+		f1[c] = derivative[c][slot];
+		y0[8 + c] = moon0[c];
+		f0[8 + c] = moon0[2 + c];
+		y1[8 + c] = moon1[c];
+		f1[8 + c] = moon1[2 + c];
+	}
+	y0[4] = y1[4] = swarm->earth[0];
+	y0[5] = y1[5] = swarm->earth[1];
+
+	double eventState[THREE_BODY_STATE_SIZE];
+	return locateEvent(y0, f0, y1, f1, time, h, THREE_BODY_STATE_SIZE, eventTime, eventState,
+			NULL);
+}
+
+
+void retire(swarm_t *swarm) {
+
+	double *fired = swarm->stage[2], *eventTime = swarm->stage[3];
+	uint32_t p = 0;
+	while (p < swarm->active) {
+		if (fired[p] == 0) {
+			p++;
+			continue;
+		}
+		uint32_t particle = swarm->slot[p];
+		swarm->result[particle] = (uint8_t)fired[p];
+		swarm->stopTime[particle] = eventTime[p];
+
+		/* The last active particle takes this slot, and is checked next */
+		uint32_t last = --swarm->active;
+		for (uint8_t c = 0; c < SWARM_COMPONENTS; c++) {
+			swarm->state[c][p] = swarm->state[c][last];
+			swarm->k[0][c][p] = swarm->k[0][c][last];
+		}
+		swarm->slot[p] = swarm->slot[last];
+		swarm->slot[last] = particle;
+		fired[p] = fired[last];
+		eventTime[p] = eventTime[last];
+	}
+}
+
+
+void reportDispersion(configuration_t config, uint32_t count, double dvx, double dvy) {
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* The Earth and Moon are integrated once, into the ephemeris */
+	double nominal[THREE_BODY_STATE_SIZE];
+	fillInitialConditions(nominal, THREE_BODY_STATE_SIZE);
+	ephemeris_t *ephemeris = createEphemeris(nominal, config.endTime);
+	swarm_t *swarm = createSwarm(count, nominal);
+	if (ephemeris == NULL || swarm == NULL) {
+		printf("Could not allocate a swarm of %u particles\n", count);
+		destroyEphemeris(ephemeris);
+		destroySwarm(swarm);
+		return;
+	}
+
+	uint64_t rng = SWARM_SEED;
+	for (uint32_t p = 0; p < count; p++) {
+		swarm->state[2][p] += dvx + SWARM_DISPERSION*gaussian(&rng);
+		swarm->state[3][p] += dvy + SWARM_DISPERSION*gaussian(&rng);
+	}
+	uint32_t steps = propagateSwarm(swarm, ephemeris, config);
+
+	/* Outcomes, and the spread of the Earth returns */
+	uint32_t outcomes[RESULT_ESCAPE + 1] = { 0 };
+	double first = INFINITY, last = 0, sum = 0;
+	for (uint32_t p = 0; p < count; p++) {
+		outcomes[swarm->result[p]]++;
+		if (swarm->result[p] != RESULT_COLLISION_EARTH) continue;
+		first = fmin(first, swarm->stopTime[p]);
+		last = fmax(last, swarm->stopTime[p]);
+		sum += swarm->stopTime[p];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + 1E-9*(end.tv_nsec - start.tv_nsec);
+
+	printf("\nDispersion of %u particles around (%.2f, %.2f), sigma %.2f m/s:\n", count,
+			dvx, dvy, SWARM_DISPERSION);
+	if (outcomes[RESULT_COLLISION_EARTH] > 0)
+		printf("\t%u Earth returns, from %.0f s to %.0f s (mean %.0f s)\n",
+				outcomes[RESULT_COLLISION_EARTH], first, last,
+				sum/outcomes[RESULT_COLLISION_EARTH]);
+	else
+		printf("\tNo Earth returns\n");
+	printf("\t%u Moon impacts, %u escapes, %u still in flight\n",
+			outcomes[RESULT_COLLISION_MOON], outcomes[RESULT_ESCAPE], outcomes[0]);
+	printf("\t%u shared steps in %.3f s (%.3g s per particle)\n", steps, seconds,
+			seconds/count);
+
+	destroySwarm(swarm);
+	destroyEphemeris(ephemeris);
+}
@@ -0,0 +1,81 @@
+#ifndef _SWARM_H_
+#define _SWARM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "configuration.h"
+#include "equations.h"
+#include "ephemeris.h"
+#include "population.h"
+
+/* Components of a particle (x, y, vx, vy) */
+#define SWARM_COMPONENTS 	(4)
+
+/* Standard deviation of the impulse dispersion around the optimum (m/s), and its seed */
+#define SWARM_DISPERSION 	(0.5)
+#define SWARM_SEED 			(0x9E3779B97F4A7C15ULL)
+
+/**
+ * Massless particles (dispersed spacecraft, debris) in the field of the fixed Earth
+ * and the tabulated Moon of the three body problem, as a structure of arrays. The
+ * massive bodies are integrated once into the ephemeris; every particle shares its
+ * lookups and the step size, so each stage evaluates the field over contiguous arrays.
+ *
+ * Active particles are kept in the first 'active' slots: a particle that terminates is
+ * swapped with the last active one, and slot[] tells which particle a slot holds.
+ */
+typedef struct {
+	uint32_t count;
+	uint32_t active;
+	uint32_t *slot;
+
+	/* Allocation holding every double array below */
+	double *block;
+
+	/* Earth position, fixed */
+	double earth[2];
+
+	/* Per slot: state, candidate solution, stage argument and stage derivatives */
+	double *state[SWARM_COMPONENTS];
+	double *next[SWARM_COMPONENTS];
+	double *stage[SWARM_COMPONENTS];
+	double *k[TABLEAU_MAX_STAGES][SWARM_COMPONENTS];
+
+	/* Per particle: RESULT_ code (0 while in flight) and the time it terminated */
+	uint8_t *result;
+	double *stopTime;
+} swarm_t;
+
+/**
+ * Allocate a swarm of count particles, all at the spacecraft state of a three body
+ * state array; the Earth is taken from it too. Particles are then set through
+ * state[][slot]. NULL on failure.
+ */
+swarm_t *createSwarm(uint32_t count, const double *nominal);
+
+/* Release a swarm */
+void destroySwarm(swarm_t *swarm);
+
+/**
+ * Propagate the swarm with the tableau of config, from t = 0 until every particle has
+ * terminated (Earth or Moon impact, escape) or config.endTime. Steps are shared, and
+ * sized by the controller of rk45() (see stepFactor()) from the largest scaled error
+ * among the active particles: one is accepted when it is at most 1. Events
+ * are sampled on the dense output of every particle at once, and located exactly with
+ * locateEvent() for the particles that crossed one. Returns the number of accepted
+ * steps.
+ */
+uint32_t propagateSwarm(swarm_t *swarm, const ephemeris_t *ephemeris, configuration_t config);
+
+/**
+ * Propagate count particles whose impulses are dispersed around (dvx, dvy) with a
+ * standard deviation of SWARM_DISPERSION, and print how they end
+ */
+void reportDispersion(configuration_t config, uint32_t count, double dvx, double dvy);
+
+#endif /* _SWARM_H_ */
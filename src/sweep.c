@@ -0,0 +1,466 @@
+#include "sweep.h"
+#include "screen.h"
+
+/**
+ * A range of candidate indices owned by one worker. The owner pops from the head,
+ * thieves take the back half of the range.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	uint32_t head;
+	uint32_t tail;
+} queue_t;
+
+/**
+ * State private to each worker thread
+ */
+typedef struct {
+	uint16_t id;
+	uint16_t threads;
+	queue_t *queues;
+	sweep_t *sweep;
+	configuration_t configuration;
+
+	/* Initial conditions before the impulse is applied */
+	double nominal[MAX_STATE_SIZE];
+
+	/* Best feasible candidate seen by this worker */
+	uint8_t found;
+	uint32_t bestIndex;
+	double bestCost;
+
+#ifdef INTEGRATOR_STATS
+	/* Batch of the worker in batched mode, and its statistics */
+	batch_t *batch;
+	stats_summary_t stats;
+#endif
+} worker_t;
+
+/* An Earth-impacting candidate of the Pareto front, tagged with its sweep index */
+typedef struct {
+	pareto_point_t point;
+	uint32_t index;
+} ranked_t;
+
+/**
+ * Take the next candidate from the worker's own queue
+ */
+static uint8_t popLocal(queue_t *queue, uint32_t *index);
+
+/**
+ * Steal half of the remaining work of another worker into this worker's queue
+ */
+static uint8_t steal(worker_t *worker);
+
+/**
+ * Integrate candidates until no work is left anywhere
+ */
+static void *work(void *argument);
+
+/**
+ * Integrate candidates in SIMD batches until no work is left anywhere
+ */
+static void workBatched(worker_t *worker);
+
+/**
+ * Screen candidates in single precision SIMD batches until no work is left anywhere
+ */
+static void workScreened(worker_t *worker);
+
+/**
+ * Batch source: next candidate of this worker, stealing when the own queue is empty
+ */
+static uint8_t nextCandidate(void *context, uint32_t *index, double *initialConditions);
+
+/**
+ * Batch sink: score a finished candidate
+ */
+static void finishCandidate(void *context, uint32_t index, uint8_t result, double stopTime,
+		double closestEarth, approach_t closestMoon);
+
+/**
+ * Keep the candidate if it is the best feasible one seen by this worker
+ */
+static void record(worker_t *worker, uint32_t index, outcome_t outcome);
+
+/**
+ * Fill every answer of the sweep from the outcomes, with the same ordering as the best
+ * candidate
+ */
+static void answerClearances(sweep_t *sweep);
+
+/**
+ * Fill the Pareto front of the sweep from the outcomes
+ */
+static void buildFront(sweep_t *sweep);
+
+/**
+ * Order ranked candidates by magnitude, then return time, then index
+ */
+static int comparePoints(const void *a, const void *b);
+
+/**
+ * Atomically lower a shared bound to value, if value is smaller
+ */
+static void lowerBound(_Atomic double *bound, double value);
+
+/**
+ * Deterministic ordering of results: lower cost wins, ties go to the lower index
+ */
+static uint8_t isBetter(double cost, uint32_t index, double bestCost, uint32_t bestIndex);
+
+
+uint8_t runSweep(sweep_t *sweep, configuration_t configuration,
+		uint32_t *bestIndex, double *bestCost) {
+
+	uint16_t threads = configuration.threads > 0 ? configuration.threads : 1;
+	if (threads > sweep->count && sweep->count > 0) threads = sweep->count;
+
+	/* Answering several clearances, or the front, needs every outcome */
+	outcome_t *outcomes = NULL;
+	if ((sweep->answers != NULL || sweep->pareto) && sweep->outcomes == NULL) {
+		outcomes = (outcome_t *)malloc((size_t)sweep->count*sizeof(outcome_t));
+		sweep->outcomes = outcomes;
+	}
+
+	queue_t queues[threads];
+	worker_t workers[threads];
+	pthread_t handles[threads];
+
+	/* Give each worker a contiguous block of the grid to start with */
+	for (uint16_t id = 0; id < threads; id++) {
+		pthread_mutex_init(&queues[id].lock, NULL);
+		queues[id].head = (uint32_t)(((uint64_t)sweep->count*id)/threads);
+		queues[id].tail = (uint32_t)(((uint64_t)sweep->count*(id + 1))/threads);
+
+		workers[id].id = id;
+		workers[id].threads = threads;
+		workers[id].queues = queues;
+		workers[id].sweep = sweep;
+		workers[id].configuration = configuration;
+		workers[id].configuration.timeBound = sweep->bounded ? &sweep->bound : NULL;
+		workers[id].found = FALSE;
+		STATS(memset(&workers[id].stats, 0, sizeof(stats_summary_t)));
+	}
+
+	/* The calling thread acts as worker 0 */
+	for (uint16_t id = 1; id < threads; id++)
+		pthread_create(&handles[id], NULL, work, &workers[id]);
+	work(&workers[0]);
+	for (uint16_t id = 1; id < threads; id++)
+		pthread_join(handles[id], NULL);
+
+	/* Reduce the per-worker results */
+	uint8_t found = FALSE;
+	for (uint16_t id = 0; id < threads; id++) {
+		pthread_mutex_destroy(&queues[id].lock);
+		STATS(summaryMerge(&sweep->stats, &workers[id].stats));
+		if (!workers[id].found) continue;
+		if (!found || isBetter(workers[id].bestCost, workers[id].bestIndex, *bestCost, *bestIndex)) {
+			*bestCost = workers[id].bestCost;
+			*bestIndex = workers[id].bestIndex;
+			found = TRUE;
+		}
+	}
+
+	if (sweep->answers != NULL)
+		answerClearances(sweep);
+	if (sweep->pareto)
+		buildFront(sweep);
+	if (outcomes != NULL) {
+		sweep->outcomes = NULL;
+		free(outcomes);
+	}
+	return found;
+}
+
+
+outcome_t outcomeAtClearance(outcome_t outcome, double clearance) {
+
+	if (outcome.result != RESULT_COLLISION_MOON &&
+			outcome.closestMoon < getBodies()->radius[BODY_MOON] + clearance) {
+		outcome.result = RESULT_COLLISION_MOON;
+		outcome.stopTime = outcome.closestMoonTime;
+	}
+	return outcome;
+}
+
+
+double impulseMagnitude(candidate_t candidate) {
+	return sqrt( powf(candidate.dvx, 2) + powf(candidate.dvy, 2) );
+}
+
+
+uint32_t buildAxis(double limit, double accuracy, uint8_t inclusive, double **axis) {
+
+	/* Walk the axis exactly like the serial loops did, so the grid points match */
+	uint32_t axisCount = 0;
+	for (double dv = -limit; inclusive ? dv <= limit : dv < limit; dv += accuracy)
+		axisCount++;
+
+	(*axis) = (double *)malloc((size_t)axisCount*sizeof(double));
+	uint32_t index = 0;
+	for (double dv = -limit; inclusive ? dv <= limit : dv < limit; dv += accuracy)
+		(*axis)[index++] = dv;
+	return axisCount;
+}
+
+
+uint32_t buildGrid(double limit, double accuracy, uint8_t inclusive, candidate_t **grid) {
+
+	double *axis;
+	uint32_t axisCount = buildAxis(limit, accuracy, inclusive, &axis);
+
+	(*grid) = (candidate_t *)malloc((size_t)axisCount*axisCount*sizeof(candidate_t));
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < axisCount; i++) {
+		for (uint32_t j = 0; j < axisCount; j++) {
+			if (axis[i] == 0 || axis[j] == 0) continue;
+			(*grid)[count].dvx = axis[i];
+			(*grid)[count].dvy = axis[j];
+			count++;
+		}
+	}
+	free(axis);
+	return count;
+}
+
+
+void *work(void *argument) {
+
+	worker_t *worker = (worker_t *)argument;
+	sweep_t *sweep = worker->sweep;
+	configuration_t configuration = worker->configuration;
+	uint8_t (*diffEquation)(double time, double *stateVector) =
+		selectEquations(configuration);
+
+	double initialConditions[configuration.stateSize];
+	fillInitialConditions(worker->nominal, configuration.stateSize);
+
+	if (sweep->screening) {
+		workScreened(worker);
+		return NULL;
+	}
+	if (sweep->batched) {
+		workBatched(worker);
+		return NULL;
+	}
+
+	/* Integration buffers are allocated once per worker, not per candidate */
+	workspace_t *workspace = createWorkspace(configuration.stateSize);
+
+	uint32_t index;
+	while (popLocal(&worker->queues[worker->id], &index) || (steal(worker) &&
+				popLocal(&worker->queues[worker->id], &index))) {
+
+		candidate_t candidate = sweep->candidates[index];
+		memcpy(initialConditions, worker->nominal, configuration.stateSize*sizeof(double));
+		initialConditions[2] += candidate.dvx;
+		initialConditions[3] += candidate.dvy;
+
+		outcome_t outcome;
+		outcome.result = (sweep->integrator)(diffEquation, initialConditions,
+				configuration, workspace, &outcome.stopTime);
+		outcome.closestEarth = workspace->closestEarth;
+		outcome.closestMoon = sqrt(workspace->closestMoon.distanceSquared);
+		outcome.closestMoonTime = workspace->closestMoon.time;
+		STATS(summaryAdd(&worker->stats, candidate.dvx, candidate.dvy, &workspace->stats));
+		record(worker, index, outcome);
+	}
+	destroyWorkspace(workspace);
+	return NULL;
+}
+
+
+void workBatched(worker_t *worker) {
+
+	batch_t batch;
+	STATS(worker->batch = &batch);
+	rk45Batch(nextCandidate, finishCandidate, worker, worker->configuration, &batch);
+}
+
+
+void workScreened(worker_t *worker) {
+
+	screen_batch_t batch;
+	rk45Screen(nextCandidate, finishCandidate, worker, worker->configuration, &batch);
+}
+
+
+uint8_t nextCandidate(void *context, uint32_t *index, double *initialConditions) {
+
+	worker_t *worker = (worker_t *)context;
+	if (!popLocal(&worker->queues[worker->id], index) &&
+			!(steal(worker) && popLocal(&worker->queues[worker->id], index)))
+		return FALSE;
+
+	candidate_t candidate = worker->sweep->candidates[*index];
+	memcpy(initialConditions, worker->nominal, THREE_BODY_STATE_SIZE*sizeof(double));
+	initialConditions[2] += candidate.dvx;
+	initialConditions[3] += candidate.dvy;
+	return TRUE;
+}
+
+
+void finishCandidate(void *context, uint32_t index, uint8_t result, double stopTime,
+		double closestEarth, approach_t closestMoon) {
+
+	outcome_t outcome = { .result = result, .stopTime = stopTime, .closestEarth = closestEarth,
+		.closestMoon = sqrt(closestMoon.distanceSquared), .closestMoonTime = closestMoon.time };
+	record((worker_t *)context, index, outcome);
+
+#ifdef INTEGRATOR_STATS
+	/* The finished lane still holds the candidate, screening keeps no statistics */
+	worker_t *worker = (worker_t *)context;
+	if (worker->sweep->screening) return;
+	candidate_t candidate = worker->sweep->candidates[index];
+	for (uint8_t lane = 0; lane < BATCH_LANES; lane++)
+		if (worker->batch->active[lane] && worker->batch->index[lane] == index)
+			summaryAdd(&worker->stats, candidate.dvx, candidate.dvy, &worker->batch->stats[lane]);
+#endif
+}
+
+
+void record(worker_t *worker, uint32_t index, outcome_t outcome) {
+
+	if (worker->sweep->outcomes != NULL)
+		worker->sweep->outcomes[index] = outcome;
+
+	/* Scored at the largest clearance: what is feasible there is feasible at every
+	 * smaller one, so the bound holds for all of them */
+	if (worker->sweep->answers != NULL) {
+		double clearance = 0;
+		for (uint8_t k = 0; k < worker->sweep->answerCount; k++)
+			clearance = fmax(clearance, worker->sweep->answers[k].clearance);
+		outcome = outcomeAtClearance(outcome, clearance);
+	}
+
+	double cost;
+	if (!(worker->sweep->cost)(worker->sweep->candidates[index], outcome, &cost)) return;
+	if (worker->sweep->bounded)
+		lowerBound(&worker->sweep->bound, cost);
+	if (!worker->found || isBetter(cost, index, worker->bestCost, worker->bestIndex)) {
+		worker->bestCost = cost;
+		worker->bestIndex = index;
+		worker->found = TRUE;
+	}
+}
+
+
+void answerClearances(sweep_t *sweep) {
+
+	for (uint8_t k = 0; k < sweep->answerCount; k++) {
+		clearance_answer_t *answer = &sweep->answers[k];
+		uint32_t bestIndex = 0;
+		answer->found = FALSE;
+		for (uint32_t index = 0; index < sweep->count; index++) {
+			double cost;
+			outcome_t outcome = outcomeAtClearance(sweep->outcomes[index], answer->clearance);
+			if (!(sweep->cost)(sweep->candidates[index], outcome, &cost)) continue;
+			if (!answer->found || isBetter(cost, index, answer->cost, bestIndex)) {
+				answer->cost = cost;
+				bestIndex = index;
+				answer->found = TRUE;
+			}
+		}
+		if (answer->found)
+			answer->best = sweep->candidates[bestIndex];
+	}
+}
+
+
+void buildFront(sweep_t *sweep) {
+
+	/* Earth-impacting candidates, by magnitude; the index breaks ties like runSweep() */
+	ranked_t *ranked = (ranked_t *)malloc((size_t)sweep->count*sizeof(ranked_t));
+	uint32_t count = 0;
+	for (uint32_t index = 0; index < sweep->count; index++) {
+		if (sweep->outcomes[index].result != RESULT_COLLISION_EARTH) continue;
+		ranked[count].point.candidate = sweep->candidates[index];
+		ranked[count].point.deltaV = impulseMagnitude(sweep->candidates[index]);
+		ranked[count].point.returnTime = sweep->outcomes[index].stopTime;
+		ranked[count++].index = index;
+	}
+	qsort(ranked, count, sizeof(ranked_t), comparePoints);
+
+	/* A point is on the front if it returns sooner than every cheaper one */
+	sweep->front = (pareto_point_t *)malloc((size_t)(count > 0 ? count : 1)*sizeof(pareto_point_t));
+	sweep->frontCount = 0;
+	for (uint32_t k = 0; k < count; k++) {
+		if (sweep->frontCount > 0 &&
+				ranked[k].point.returnTime >= sweep->front[sweep->frontCount - 1].returnTime)
+			continue;
+		sweep->front[sweep->frontCount++] = ranked[k].point;
+	}
+	free(ranked);
+}
+
+
+int comparePoints(const void *a, const void *b) {
+
+	const ranked_t *first = (const ranked_t *)a, *second = (const ranked_t *)b;
+	if (first->point.deltaV != second->point.deltaV)
+		return first->point.deltaV < second->point.deltaV ? -1 : 1;
+	if (first->point.returnTime != second->point.returnTime)
+		return first->point.returnTime < second->point.returnTime ? -1 : 1;
+	return (first->index > second->index) - (first->index < second->index);
+}
+
+
+uint8_t popLocal(queue_t *queue, uint32_t *index) {
+
+	uint8_t popped = FALSE;
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		*index = queue->head++;
+		popped = TRUE;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return popped;
+}
+
+
+uint8_t steal(worker_t *worker) {
+
+	/* Visit the other workers in order, starting with the next one */
+	for (uint16_t offset = 1; offset < worker->threads; offset++) {
+		queue_t *victim = &worker->queues[(worker->id + offset) % worker->threads];
+
+		pthread_mutex_lock(&victim->lock);
+		uint32_t remaining = victim->tail - victim->head;
+		if (remaining == 0) {
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		/* Take the back half, rounding up so a single item can be stolen */
+		uint32_t tail = victim->tail;
+		victim->tail -= (remaining + 1)/2;
+		uint32_t head = victim->tail;
+		pthread_mutex_unlock(&victim->lock);
+
+		queue_t *own = &worker->queues[worker->id];
+		pthread_mutex_lock(&own->lock);
+		own->head = head;
+		own->tail = tail;
+		pthread_mutex_unlock(&own->lock);
+		return TRUE;
+	}
+	/* Work is never added after the sweep starts, so empty queues mean we are done */
+	return FALSE;
+}
+
+
+void lowerBound(_Atomic double *bound, double value) {
+
+	double current = atomic_load(bound);
+	while (value < current && !atomic_compare_exchange_weak(bound, &current, value))
+		;
+}
+
+
+uint8_t isBetter(double cost, uint32_t index, double bestCost, uint32_t bestIndex) {
+	if (cost < bestCost) return TRUE;
+	if (cost == bestCost && index < bestIndex) return TRUE;
+	return FALSE;
+}
@@ -0,0 +1,140 @@
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "integrator.h"
+#include "batch.h"
+#include "configuration.h"
+#include "util.h"
+
+/* A single (dvx, dvy) impulse to be tested */
+typedef struct {
+	double dvx;
+	double dvy;
+} candidate_t;
+
+/* Outcome of integrating a single candidate */
+typedef struct {
+	uint8_t result;
+	double stopTime;
+
+	/* Closest approach of the spacecraft to the Earth's centre (m) */
+	double closestEarth;
+
+	/* Closest approach to the Moon's centre (m) before the trajectory stopped, and when */
+	double closestMoon;
+	double closestMoonTime;
+} outcome_t;
+
+/* Best candidate of a sweep at one Moon clearance */
+typedef struct {
+	double clearance;
+	uint8_t found;
+	candidate_t best;
+	double cost;
+} clearance_answer_t;
+
+/* An Earth-impacting candidate that no other one beats in both delta V and return time */
+typedef struct {
+	candidate_t candidate;
+	double deltaV;
+	double returnTime;
+} pareto_point_t;
+
+/* Integrator used to propagate each candidate (euler or rk45) */
+typedef uint8_t (*integrator_t)(uint8_t (*function)(double time, double *stateVector),
+		double *initialConditions, configuration_t config, workspace_t *workspace,
+		double *stopTime);
+
+/**
+ * Score a candidate from its outcome. Returns TRUE and fills cost if the candidate
+ * is feasible, FALSE otherwise. Lower cost is better.
+ */
+typedef uint8_t (*cost_t)(candidate_t candidate, outcome_t outcome, double *cost);
+
+/* Description of a sweep over a list of candidates */
+typedef struct {
+	candidate_t *candidates;
+	uint32_t count;
+	integrator_t integrator;
+	cost_t cost;
+
+	/* Integrate BATCH_LANES candidates at once with rk45Batch() instead of integrator */
+	uint8_t batched;
+
+	/* Screen the candidates in single precision with rk45Screen() instead (first tier
+	 * of screenedSweep()) */
+	uint8_t screening;
+
+	/* Optional, count entries: receives the outcome of every candidate */
+	outcome_t *outcomes;
+
+	/**
+	 * Optional, answerCount entries: answered for every clearance at once from the
+	 * outcomes of a sweep integrated with a Moon clearance of zero, through
+	 * outcomeAtClearance(). Candidates are scored (and bounded) at the largest clearance.
+	 */
+	clearance_answer_t *answers;
+	uint8_t answerCount;
+
+	/**
+	 * Keep the non-dominated (impulse magnitude, return time) set of the Earth-impacting
+	 * candidates in front (frontCount points, caller frees), by increasing magnitude.
+	 * Only meaningful unbounded, and with an integrator accurate enough for return times.
+	 */
+	uint8_t pareto;
+	pareto_point_t *front;
+	uint32_t frontCount;
+
+	/**
+	 * Branch and bound, for costs that equal the stop time: candidates stop integrating
+	 * once they pass bound, the best cost found so far. Shared by all workers, and kept
+	 * across runSweep() calls; initialize it to the end time.
+	 */
+	uint8_t bounded;
+	_Atomic double bound;
+
+#ifdef INTEGRATOR_STATS
+	/* Integrator statistics of every candidate, accumulated across runSweep() calls */
+	stats_summary_t stats;
+#endif
+} sweep_t;
+
+/**
+ * Integrate every candidate in the sweep on configuration.threads worker threads.
+ * Work is handed out through per-thread work-stealing queues. The best feasible
+ * candidate is reduced deterministically (lowest cost, then lowest index), so the
+ * result does not depend on thread count or timing. Returns FALSE if no candidate
+ * was feasible.
+ */
+uint8_t runSweep(sweep_t *sweep, configuration_t configuration,
+		uint32_t *bestIndex, double *bestCost);
+
+/**
+ * Outcome of a trajectory integrated with a Moon clearance of zero, had it been
+ * integrated with clearance instead: it strikes the Moon if it came within the larger
+ * radius before it stopped. The stop time is then that of the closest sampled approach,
+ * not the located crossing.
+ */
+outcome_t outcomeAtClearance(outcome_t outcome, double clearance);
+
+/* Magnitude of a candidate's impulse (m/s) */
+double impulseMagnitude(candidate_t candidate);
+
+/**
+ * Fill a buffer with the impulse values along one grid axis, walking from -limit by
+ * accuracy like the serial loops did. Returns the number of values, caller frees.
+ */
+uint32_t buildAxis(double limit, double accuracy, uint8_t inclusive, double **axis);
+
+/**
+ * Fill a buffer with the grid of candidates stepping from -limit by accuracy, in the
+ * same raster order (dvx outer, dvy inner) as the serial search. Points on either
+ * axis are skipped. Returns the number of candidates, caller frees the buffer.
+ */
+uint32_t buildGrid(double limit, double accuracy, uint8_t inclusive, candidate_t **grid);
+
+#endif /* _SWEEP_H_ */
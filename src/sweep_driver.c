@@ -0,0 +1,455 @@
+/* Sharded sweep over objectives, clearances and the impulse grid, in worker processes */
+
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "util.h"
+#include "optimizer.h"
+#include "integrator.h"
+
+#define DRIVER_ARGS 		(3)
+#define OPTION_WORKERS 		"--workers"
+#define OPTION_SHARDS 		"--shards"
+#define OPTION_CLEARANCES 	"--clearances"
+#define OPTION_AGNOSTIC 	"--agnostic"
+
+/* Slices of the grid of every (objective, clearance) combination */
+#define DEFAULT_SHARDS 		(8)
+
+#define OBJECTIVES 			(2)
+#define MAX_CLEARANCES 		(16)
+#define MAX_OPTIONS 		(32)
+#define MAX_LINE_SIZE 		(256)
+#define MAX_KEY_SIZE 		(1024)
+
+/* Clearances of batch_three_body.sh */
+static const double DEFAULT_CLEARANCES[] = { 0, 10, 100, 1000, 5000, 10000, 50000, 100000 };
+
+/**
+ * A slice of the grid of one (objective, clearance) combination, and its result once
+ * it is in the results file
+ */
+typedef struct {
+	uint8_t objective;
+	double clearance;
+	uint32_t shard;
+
+	uint8_t done;
+	uint8_t found;
+	double dvx;
+	double dvy;
+	double cost;
+} shard_t;
+
+/**
+ * Read the results file, marking the shards it holds as done. Only complete lines of the
+ * same accuracy, shard count and configuration fingerprint match; a missing file holds
+ * no shard.
+ */
+static void readResults(const char *fileName, configuration_t configuration,
+		shard_t *shards, uint32_t count);
+
+/**
+ * Shards run by the same worker as shards[first], first included: the pending shards of
+ * every clearance with the same objective and grid slice when agnostic, else shards[first]
+ * alone. Fills group with their indices, returns how many there are.
+ */
+static uint8_t groupShards(const shard_t *shards, uint32_t count, uint32_t first,
+		uint8_t agnostic, uint32_t group[MAX_CLEARANCES]);
+
+/**
+ * Search a group of shards (one grid slice, integrated once for all of their clearances
+ * when there are several) and append their results to the results file, a line each, in
+ * a single write. Runs in a worker process, returns its exit status.
+ */
+static int runShard(const char *fileName, configuration_t configuration,
+		const shard_t *shards, const uint32_t *group, uint8_t size);
+
+/**
+ * Run every shard that is not done, on up to workers processes at once. Returns the
+ * number of shards that failed.
+ */
+static uint32_t runShards(const char *fileName, configuration_t configuration,
+		shard_t *shards, uint32_t count, uint32_t workers, uint8_t agnostic);
+
+/**
+ * Print the optimum of every (objective, clearance) combination whose shards are all
+ * done: the lowest cost, ties broken by the earliest shard like runSweep() does. Each
+ * optimum is then integrated again with logging, into the file the main program writes.
+ */
+static void mergeResults(configuration_t configuration, const shard_t *shards,
+		uint32_t count);
+
+/**
+ * Integrate the optimum of a shard with rk45() and log it, like the main program does
+ * with the optimum it finds
+ */
+static void writeOptimum(configuration_t configuration, const shard_t *best);
+
+/**
+ * Hash (64 bit FNV-1a) of every setting besides the objective, clearance, accuracy and
+ * shards that changes the result of a shard: the integrators and their step, tolerances
+ * and controller, the regularization radii, the Moon ephemeris, the bodies, screening
+ * and the end time. Results of another configuration in the same file are not reused.
+ */
+static uint64_t fingerprint(configuration_t configuration);
+
+/**
+ * Parse a comma separated list of clearances, returns how many there are (0 on error)
+ */
+static uint8_t parseClearances(char *list, double clearances[MAX_CLEARANCES]);
+
+
+int main(int argc, char *argv[]) {
+
+	/* exe_sweep_driver <results file> <accuracy> [--option value]... */
+	if (argc < DRIVER_ARGS || (argc - DRIVER_ARGS) % 2 != 0) {
+		printf("Usage: %s <results file> <accuracy> [%s N] [%s N] [%s c1,c2,...] "
+				"[%s 0|1] [--option value]...\n", argv[0], OPTION_WORKERS, OPTION_SHARDS,
+				OPTION_CLEARANCES, OPTION_AGNOSTIC);
+		return EXIT_FAILURE;
+	}
+	const char *fileName = argv[1];
+
+	/* Driver options; the others are passed to parseArguments() like the main program's */
+	uint32_t workers = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN), shardCount = DEFAULT_SHARDS;
+	double clearances[MAX_CLEARANCES];
+	uint8_t clearanceCount = sizeof(DEFAULT_CLEARANCES)/sizeof(DEFAULT_CLEARANCES[0]);
+	memcpy(clearances, DEFAULT_CLEARANCES, sizeof(DEFAULT_CLEARANCES));
+	char *arguments[EXPECTED_ARGS + MAX_OPTIONS] = { argv[0], "1", "0", argv[2] };
+	int argumentCount = EXPECTED_ARGS;
+	uint8_t threadsGiven = FALSE, agnostic = TRUE;
+	for (int index = DRIVER_ARGS; index < argc; index += 2) {
+		if (strcmp(argv[index], OPTION_WORKERS) == 0)
+			workers = (uint32_t)strtol(argv[index + 1], (char **)NULL, 10);
+		else if (strcmp(argv[index], OPTION_SHARDS) == 0)
+			shardCount = (uint32_t)strtol(argv[index + 1], (char **)NULL, 10);
+		else if (strcmp(argv[index], OPTION_CLEARANCES) == 0)
+			clearanceCount = parseClearances(argv[index + 1], clearances);
+		else if (strcmp(argv[index], OPTION_AGNOSTIC) == 0)
+			agnostic = (strtol(argv[index + 1], (char **)NULL, 10) != 0);
+		else if (argumentCount + 2 <= EXPECTED_ARGS + MAX_OPTIONS) {
+			threadsGiven |= (strcmp(argv[index], OPTION_THREADS) == 0);
+			arguments[argumentCount++] = argv[index];
+			arguments[argumentCount++] = argv[index + 1];
+		}
+	}
+	configuration_t configuration;
+	if (workers < 1 || shardCount < 1 || clearanceCount == 0 ||
+			!parseArguments(argumentCount, arguments, &configuration)) {
+		printf("Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The processes are the parallelism: one thread each unless asked otherwise */
+	if (!threadsGiven) configuration.threads = 1;
+	if (configuration.search != SEARCH_GRID) {
+		printf("Only the grid search can be sharded, searching the full grid\n");
+		configuration.search = SEARCH_GRID;
+	}
+	configuration.shards = shardCount;
+	if (agnostic && configuration.screen != SCREEN_OFF) {
+		printf("Screening keeps no closest approaches, clearances are answered without it\n");
+		configuration.screen = SCREEN_OFF;
+	}
+	if (configuration.bodies != NULL) setBodies(configuration.bodies);
+
+	/* Clearance outer and objective inner, like batch_three_body.sh */
+	uint32_t count = (uint32_t)clearanceCount*OBJECTIVES*shardCount;
+	shard_t *shards = calloc(count, sizeof(shard_t));
+	if (shards == NULL) return EXIT_FAILURE;
+	uint32_t index = 0;
+	for (uint8_t clearance = 0; clearance < clearanceCount; clearance++)
+		for (uint8_t objective = OBJECTIVE_1; objective <= OBJECTIVES; objective++)
+			for (uint32_t shard = 0; shard < shardCount; shard++)
+				shards[index++] = (shard_t){ .objective = objective,
+					.clearance = clearances[clearance], .shard = shard };
+
+	/* Resume: shards already in the results file are skipped */
+	readResults(fileName, configuration, shards, count);
+	uint32_t done = 0;
+	for (index = 0; index < count; index++)
+		done += shards[index].done;
+	printf("\n%u shards, %u already in %s, on %u worker processes%s\n", count, done,
+			fileName, workers, agnostic ? ", every clearance in one pass" : "");
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint32_t failed = runShards(fileName, configuration, shards, count, workers, agnostic);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* Merge what the workers appended */
+	readResults(fileName, configuration, shards, count);
+	mergeResults(configuration, shards, count);
+	free(shards);
+
+	double runTime = (end.tv_sec - start.tv_sec) + 1E-9*(end.tv_nsec - start.tv_nsec);
+	printf("\nRun time: %.3f seconds\n\n", runTime);
+	if (failed > 0) {
+		printf("%u shard(s) failed, run again to resume\n\n", failed);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+void readResults(const char *fileName, configuration_t configuration,
+		shard_t *shards, uint32_t count) {
+
+	FILE *file = fopen(fileName, "r");
+	if (file == NULL) return;
+
+	/* objective clearance accuracy shard shards found dvx dvy cost fingerprint */
+	uint64_t expected = fingerprint(configuration);
+	char line[MAX_LINE_SIZE];
+	while (fgets(line, MAX_LINE_SIZE, file) != NULL) {
+		unsigned int objective, found, shard, shardCount;
+		double clearance, accuracy, dvx, dvy, cost;
+		unsigned long long key;
+
+		/* A line cut short by a crash is not a result */
+		if (strchr(line, '\n') == NULL) continue;
+		if (sscanf(line, "%u %lf %lf %u %u %u %lf %lf %lf %llx", &objective, &clearance,
+				&accuracy, &shard, &shardCount, &found, &dvx, &dvy, &cost, &key) != 10)
+			continue;
+		if (accuracy != configuration.accuracy || shardCount != configuration.shards ||
+				key != expected)
+			continue;
+
+		for (uint32_t index = 0; index < count; index++) {
+			shard_t *entry = &shards[index];
+			if (entry->done || entry->objective != objective ||
+					entry->clearance != clearance || entry->shard != shard)
+				continue;
+			entry->done = TRUE;
+			entry->found = (found != 0);
+			entry->dvx = dvx;
+			entry->dvy = dvy;
+			entry->cost = cost;
+		}
+	}
+	fclose(file);
+}
+
+
+uint8_t groupShards(const shard_t *shards, uint32_t count, uint32_t first,
+		uint8_t agnostic, uint32_t group[MAX_CLEARANCES]) {
+
+	uint8_t size = 0;
+	group[size++] = first;
+	for (uint32_t index = first + 1; agnostic && index < count; index++) {
+		if (shards[index].done || shards[index].objective != shards[first].objective ||
+				shards[index].shard != shards[first].shard)
+			continue;
+		group[size++] = index;
+	}
+	return size;
+}
+
+
+int runShard(const char *fileName, configuration_t configuration,
+		const shard_t *shards, const uint32_t *group, uint8_t size) {
+
+	/* The driver reports progress, the search summaries would interleave */
+	if (freopen("/dev/null", "w", stdout) == NULL) return EXIT_FAILURE;
+
+	configuration.objective = shards[group[0]].objective;
+	configuration.shard = shards[group[0]].shard;
+	if (configuration.bodies != NULL) setBodies(configuration.bodies);
+
+	clearance_answer_t answers[MAX_CLEARANCES];
+	for (uint8_t member = 0; member < size; member++)
+		answers[member] = (clearance_answer_t){ .clearance = shards[group[member]].clearance };
+	if (size > 1) {
+		optimizeClearances(configuration, answers, size);
+	} else {
+		configuration.clearance = answers[0].clearance;
+		setClearance(configuration.clearance);
+		answers[0].found = optimizeObjective(configuration, &answers[0].best, &answers[0].cost);
+	}
+
+	/* One write() of every line to an O_APPEND file: concurrent workers never
+	 * interleave, and a result is either complete or cut short */
+	char line[MAX_CLEARANCES*MAX_LINE_SIZE];
+	int length = 0;
+	unsigned long long key = fingerprint(configuration);
+	for (uint8_t member = 0; member < size; member++) {
+		clearance_answer_t *answer = &answers[member];
+		if (!answer->found) {
+			answer->best = (candidate_t){ 0, 0 };
+			answer->cost = 0;
+		}
+		length += snprintf(line + length, MAX_LINE_SIZE,
+				"%u %.17g %.17g %u %u %u %.17g %.17g %.17g %016llx\n",
+				configuration.objective, answer->clearance, configuration.accuracy,
+				configuration.shard, configuration.shards, answer->found, answer->best.dvx,
+				answer->best.dvy, answer->cost, key);
+	}
+	int file = open(fileName, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (file < 0) return EXIT_FAILURE;
+	uint8_t written = (write(file, line, length) == length);
+	if (fsync(file) != 0) written = FALSE;
+	close(file);
+	return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+uint32_t runShards(const char *fileName, configuration_t configuration,
+		shard_t *shards, uint32_t count, uint32_t workers, uint8_t agnostic) {
+
+	/* Worker processes in flight, the group of shards each one runs, and the shards
+	 * already handed to a worker */
+	pid_t pids[workers];
+	uint32_t groups[workers][MAX_CLEARANCES];
+	uint8_t sizes[workers];
+	uint8_t *started = calloc(count, sizeof(uint8_t));
+	if (started == NULL) return count;
+	uint32_t active = 0, next = 0, failed = 0, finished = 0, pending = 0;
+	for (uint32_t index = 0; index < count; index++)
+		pending += !shards[index].done;
+
+	fflush(stdout);
+	while (active > 0 || next < count) {
+
+		/* Start workers on the next pending shards */
+		for (; next < count && active < workers; next++) {
+			if (shards[next].done || started[next]) continue;
+			uint8_t size = groupShards(shards, count, next, agnostic, groups[active]);
+			for (uint8_t member = 0; member < size; member++)
+				started[groups[active][member]] = TRUE;
+			pid_t pid = fork();
+			if (pid == 0)
+				_exit(runShard(fileName, configuration, shards, groups[active], size));
+			if (pid < 0) {
+				printf("Could not start a worker process\n");
+				failed += size;
+				continue;
+			}
+			pids[active] = pid;
+			sizes[active++] = size;
+		}
+		if (active == 0) break;
+
+		/* Wait for any of them */
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0) break;
+		for (uint32_t slot = 0; slot < active; slot++) {
+			if (pids[slot] != pid) continue;
+			shard_t *shard = &shards[groups[slot][0]];
+			uint8_t success = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+			failed += success ? 0 : sizes[slot];
+			finished += sizes[slot];
+			if (sizes[slot] > 1)
+				printf("Objective %d, %u clearances, shard %u/%u %s (%u of %u)\n",
+						shard->objective, sizes[slot], shard->shard + 1,
+						configuration.shards, success ? "done" : "FAILED", finished, pending);
+			else
+				printf("Objective %d, clearance %g, shard %u/%u %s (%u of %u)\n",
+						shard->objective, shard->clearance, shard->shard + 1,
+						configuration.shards, success ? "done" : "FAILED", finished, pending);
+			fflush(stdout);
+			pids[slot] = pids[active - 1];
+			sizes[slot] = sizes[active - 1];
+			memcpy(groups[slot], groups[active - 1], sizeof(groups[slot]));
+			active--;
+			break;
+		}
+	}
+	free(started);
+	return failed;
+}
+
+
+void mergeResults(configuration_t configuration, const shard_t *shards, uint32_t count) {
+
+	printf("\n%-10s %10s %10s %10s %16s\n", "objective", "clearance", "dvx", "dvy", "cost");
+	uint32_t written = 0;
+	for (uint32_t first = 0; first < count; first += configuration.shards) {
+		const shard_t *best = NULL;
+		uint8_t complete = TRUE;
+		for (uint32_t index = first; index < first + configuration.shards; index++) {
+			complete &= shards[index].done;
+			if (!shards[index].done || !shards[index].found) continue;
+			if (best == NULL || shards[index].cost < best->cost)
+				best = &shards[index];
+		}
+
+		const char *unit = shards[first].objective == OBJECTIVE_1 ? "m/s" : "s";
+		printf("%-10d %10g ", shards[first].objective, shards[first].clearance);
+		if (!complete)
+			printf("%10s\n", "pending");
+		else if (best == NULL)
+			printf("%10s\n", "none");
+		else
+			printf("%10.2f %10.2f %12.2f %s\n", best->dvx, best->dvy, best->cost, unit);
+		if (complete && best != NULL) {
+			writeOptimum(configuration, best);
+			written++;
+		}
+	}
+	if (written > 0)
+		printf("\nTrajectories of %u optima written to output/Optimum_*%s\n", written,
+				TRAJECTORY_EXTENSION);
+}
+
+
+void writeOptimum(configuration_t configuration, const shard_t *best) {
+
+	configuration.objective = best->objective;
+	configuration.clearance = best->clearance;
+	setClearance(configuration.clearance);
+	trajectoryFileName(&configuration);
+
+	/* The Moon ephemeris only lives during the search, the logged run integrates the
+	 * full equations */
+	configuration.ephemeris = 0;
+	configuration.loggingEnabled = 1;
+	double initialConditions[configuration.stateSize];
+	fillInitialConditions(initialConditions, configuration.stateSize);
+	initialConditions[2] += best->dvx;
+	initialConditions[3] += best->dvy;
+
+	double time;
+	workspace_t *workspace = createWorkspace(configuration.stateSize);
+	rk45(selectEquations(configuration), initialConditions, configuration, workspace, &time);
+	destroyWorkspace(workspace);
+}
+
+
+uint64_t fingerprint(configuration_t configuration) {
+
+	const step_control_t *control = &configuration.control;
+	char key[MAX_KEY_SIZE];
+	int length = snprintf(key, MAX_KEY_SIZE,
+			"%s %u %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g "
+			"%.17g %.17g %u %s %u %.17g", configuration.tableau->name,
+			configuration.integrator, configuration.timeStep, control->absolute[0],
+			control->absolute[2], control->relative[0], control->relative[2],
+			control->safety, control->alpha, control->beta, control->shrink,
+			control->growth, control->maxStep, control->firstStep,
+			configuration.regularizeEarth, configuration.regularizeMoon,
+			configuration.ephemeris,
+			configuration.bodies != NULL ? configuration.bodies->name : "-",
+			configuration.screen, configuration.endTime);
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (int index = 0; index < length && index < MAX_KEY_SIZE; index++) {
+		hash ^= (unsigned char)key[index];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+uint8_t parseClearances(char *list, double clearances[MAX_CLEARANCES]) {
+
+	uint8_t count = 0;
+	for (char *token = strtok(list, ","); token != NULL; token = strtok(NULL, ",")) {
+		if (count == MAX_CLEARANCES) return 0;
+		clearances[count++] = strtod(token, (char **)NULL);
+	}
+	return count;
+}
@@ -0,0 +1,19 @@
+#include <string.h>
+
+#include "tableau.h"
+
+const tableau_t RKF45_TABLEAU = RKF45_COEFFICIENTS;
+
+const tableau_t CASH_KARP_TABLEAU = CASH_KARP_COEFFICIENTS;
+
+const tableau_t DORMAND_PRINCE_TABLEAU = DORMAND_PRINCE_COEFFICIENTS;
+
+
+const tableau_t *findTableau(const char *name) {
+
+	const tableau_t *tableaus[] = { &RKF45_TABLEAU, &CASH_KARP_TABLEAU, &DORMAND_PRINCE_TABLEAU };
+	for (uint8_t index = 0; index < sizeof(tableaus)/sizeof(tableaus[0]); index++)
+		if (strcmp(tableaus[index]->name, name) == 0)
+			return tableaus[index];
+	return NULL;
+}
@@ -0,0 +1,123 @@
+#ifndef _TABLEAU_H_
+#define _TABLEAU_H_
+
+#include <stdint.h>
+
+#include "rk45_constants.h"
+
+#define TABLEAU_MAX_STAGES 	(7)
+
+/**
+ * Butcher tableau of an embedded explicit Runge Kutta pair. The propagated solution
+ * uses weights b (the higher order one, i.e. local extrapolation), and the local error
+ * estimate is h*sum(e[j]*k[j]) with e = b - bhat.
+ */
+typedef struct {
+	const char *name;
+	uint8_t stages;
+
+	/* Last stage is evaluated at the new solution, and is the next step's first stage */
+	uint8_t fsal;
+
+	double c[TABLEAU_MAX_STAGES];
+	double a[TABLEAU_MAX_STAGES][TABLEAU_MAX_STAGES];
+	double b[TABLEAU_MAX_STAGES];
+	double e[TABLEAU_MAX_STAGES];
+} tableau_t;
+
+/**
+ * Initializers of the built-in tableaus. They live here so the fixed-size step kernels
+ * (kernels.h) can see the coefficients as compile-time constants.
+ */
+
+/* Runge Kutta Fehlberg 4(5), coefficients from rk45_constants.h */
+#define RKF45_COEFFICIENTS { \
+	.name = "rkf45", \
+	.stages = 6, \
+	.fsal = 0, \
+	.c = { 0, K2_H_COEF, K3_H_COEF, K4_H_COEF, K5_H_COEF, K6_H_COEF }, \
+	.a = { \
+		{ 0 }, \
+		{ K2_K1_COEF }, \
+		{ K3_K1_COEF, K3_K2_COEF }, \
+		{ K4_K1_COEF, K4_K2_COEF, K4_K3_COEF }, \
+		{ K5_K1_COEF, K5_K2_COEF, K5_K3_COEF, K5_K4_COEF }, \
+		{ K6_K1_COEF, K6_K2_COEF, K6_K3_COEF, K6_K4_COEF, K6_K5_COEF } \
+	}, \
+	.b = { STATE_B_K1_COEF, 0, STATE_B_K3_COEF, STATE_B_K4_COEF, STATE_B_K5_COEF, \
+		   STATE_B_K6_COEF }, \
+	.e = { \
+		STATE_B_K1_COEF - STATE_A_K1_COEF, \
+		0, \
+		STATE_B_K3_COEF - STATE_A_K3_COEF, \
+		STATE_B_K4_COEF - STATE_A_K4_COEF, \
+		STATE_B_K5_COEF - STATE_A_K5_COEF, \
+		STATE_B_K6_COEF \
+	} \
+}
+
+/* Cash Karp 5(4) */
+#define CASH_KARP_COEFFICIENTS { \
+	.name = "cashkarp", \
+	.stages = 6, \
+	.fsal = 0, \
+	.c = { 0, 1.0/5.0, 3.0/10.0, 3.0/5.0, 1.0, 7.0/8.0 }, \
+	.a = { \
+		{ 0 }, \
+		{ 1.0/5.0 }, \
+		{ 3.0/40.0, 9.0/40.0 }, \
+		{ 3.0/10.0, -9.0/10.0, 6.0/5.0 }, \
+		{ -11.0/54.0, 5.0/2.0, -70.0/27.0, 35.0/27.0 }, \
+		{ 1631.0/55296.0, 175.0/512.0, 575.0/13824.0, 44275.0/110592.0, 253.0/4096.0 } \
+	}, \
+	.b = { 37.0/378.0, 0, 250.0/621.0, 125.0/594.0, 0, 512.0/1771.0 }, \
+	.e = { \
+		37.0/378.0 - 2825.0/27648.0, \
+		0, \
+		250.0/621.0 - 18575.0/48384.0, \
+		125.0/594.0 - 13525.0/55296.0, \
+		-277.0/14336.0, \
+		512.0/1771.0 - 1.0/4.0 \
+	} \
+}
+
+/* Dormand Prince 5(4), first same as last */
+#define DORMAND_PRINCE_COEFFICIENTS { \
+	.name = "dopri5", \
+	.stages = 7, \
+	.fsal = 1, \
+	.c = { 0, 1.0/5.0, 3.0/10.0, 4.0/5.0, 8.0/9.0, 1.0, 1.0 }, \
+	.a = { \
+		{ 0 }, \
+		{ 1.0/5.0 }, \
+		{ 3.0/40.0, 9.0/40.0 }, \
+		{ 44.0/45.0, -56.0/15.0, 32.0/9.0 }, \
+		{ 19372.0/6561.0, -25360.0/2187.0, 64448.0/6561.0, -212.0/729.0 }, \
+		{ 9017.0/3168.0, -355.0/33.0, 46732.0/5247.0, 49.0/176.0, -5103.0/18656.0 }, \
+		{ 35.0/384.0, 0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0 } \
+	}, \
+	.b = { 35.0/384.0, 0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0, 0 }, \
+	.e = { \
+		35.0/384.0 - 5179.0/57600.0, \
+		0, \
+		500.0/1113.0 - 7571.0/16695.0, \
+		125.0/192.0 - 393.0/640.0, \
+		-2187.0/6784.0 + 92097.0/339200.0, \
+		11.0/84.0 - 187.0/2100.0, \
+		-1.0/40.0 \
+	} \
+}
+
+/* Runge Kutta Fehlberg 4(5), coefficients from rk45_constants.h */
+extern const tableau_t RKF45_TABLEAU;
+
+/* Cash Karp 5(4) */
+extern const tableau_t CASH_KARP_TABLEAU;
+
+/* Dormand Prince 5(4), first same as last */
+extern const tableau_t DORMAND_PRINCE_TABLEAU;
+
+/* Look up a tableau by name ("rkf45", "cashkarp", "dopri5"), NULL if unknown */
+const tableau_t *findTableau(const char *name);
+
+#endif /* _TABLEAU_H_ */
@@ -0,0 +1,152 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trajectory.h"
+
+/**
+ * Writer thread: drain full blocks from the ring to disk until the writer is closed
+ */
+static void *drain(void *argument);
+
+/**
+ * Hand the block being filled to the writer thread, waiting only if the ring is full
+ */
+static void publish(trajectory_writer_t *writer);
+
+
+trajectory_writer_t *openTrajectory(const char *fileName, uint8_t stateSize) {
+
+	if (stateSize + 1 > TRAJECTORY_MAX_COLUMNS) return NULL;
+
+	trajectory_writer_t *writer = (trajectory_writer_t *)calloc(1, sizeof(trajectory_writer_t));
+	if (writer == NULL) return NULL;
+	writer->file = fopen(fileName, "wb");
+	if (writer->file == NULL) {
+		free(writer);
+		return NULL;
+	}
+
+	/* Header is rewritten with the row count on close */
+	memcpy(writer->header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	writer->header.version = TRAJECTORY_VERSION;
+	writer->header.columns = stateSize + 1;
+	fwrite(&writer->header, sizeof(trajectory_header_t), 1, writer->file);
+
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->notEmpty, NULL);
+	pthread_cond_init(&writer->notFull, NULL);
+	pthread_create(&writer->thread, NULL, drain, writer);
+	return writer;
+}
+
+
+void writeTrajectory(trajectory_writer_t *writer, double time, const double *state) {
+
+	/* The block at head is owned by the integrating thread until it is published */
+	trajectory_block_t *block = &writer->ring[writer->head % TRAJECTORY_RING_BLOCKS];
+	double *row = &block->data[block->rows*writer->header.columns];
+	row[0] = time;
+	memcpy(row + 1, state, (writer->header.columns - 1)*sizeof(double));
+
+	if (++block->rows == TRAJECTORY_BLOCK_ROWS)
+		publish(writer);
+}
+
+
+void closeTrajectory(trajectory_writer_t *writer) {
+
+	if (writer->ring[writer->head % TRAJECTORY_RING_BLOCKS].rows > 0)
+		publish(writer);
+
+	pthread_mutex_lock(&writer->lock);
+	writer->closing = 1;
+	pthread_cond_signal(&writer->notEmpty);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+
+	/* Finalize the header with the number of rows */
+	fseek(writer->file, 0, SEEK_SET);
+	fwrite(&writer->header, sizeof(trajectory_header_t), 1, writer->file);
+	fclose(writer->file);
+
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->notEmpty);
+	pthread_cond_destroy(&writer->notFull);
+	free(writer);
+}
+
+
+void publish(trajectory_writer_t *writer) {
+
+	pthread_mutex_lock(&writer->lock);
+	writer->header.rows += writer->ring[writer->head % TRAJECTORY_RING_BLOCKS].rows;
+	writer->head++;
+	pthread_cond_signal(&writer->notEmpty);
+
+	/* The next block is free once the writer is less than a full ring behind */
+	while (writer->head - writer->tail >= TRAJECTORY_RING_BLOCKS)
+		pthread_cond_wait(&writer->notFull, &writer->lock);
+	writer->ring[writer->head % TRAJECTORY_RING_BLOCKS].rows = 0;
+	pthread_mutex_unlock(&writer->lock);
+}
+
+
+void *drain(void *argument) {
+
+	trajectory_writer_t *writer = (trajectory_writer_t *)argument;
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		while (writer->tail == writer->head && !writer->closing)
+			pthread_cond_wait(&writer->notEmpty, &writer->lock);
+		if (writer->tail == writer->head) break;
+
+		/* Write without holding the lock, the block is not touched until tail moves */
+		trajectory_block_t *block = &writer->ring[writer->tail % TRAJECTORY_RING_BLOCKS];
+		pthread_mutex_unlock(&writer->lock);
+		fwrite(block->data, sizeof(double), (size_t)block->rows*writer->header.columns,
+				writer->file);
+		pthread_mutex_lock(&writer->lock);
+
+		writer->tail++;
+		pthread_cond_signal(&writer->notFull);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
+}
+
+
+uint8_t mapTrajectory(const char *fileName, trajectory_map_t *map) {
+
+	int descriptor = open(fileName, O_RDONLY);
+	if (descriptor < 0) return 0;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(trajectory_header_t)) {
+		close(descriptor);
+		return 0;
+	}
+	map->size = (size_t)status.st_size;
+	map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if (map->base == MAP_FAILED) return 0;
+
+	/* Check the header against the file size */
+	map->header = (const trajectory_header_t *)map->base;
+	map->data = (const double *)(map->header + 1);
+	size_t expected = sizeof(trajectory_header_t) +
+		(size_t)map->header->rows*map->header->columns*sizeof(double);
+	if (memcmp(map->header->magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 ||
+			map->header->version != TRAJECTORY_VERSION || expected > map->size) {
+		unmapTrajectory(map);
+		return 0;
+	}
+	return 1;
+}
+
+
+void unmapTrajectory(trajectory_map_t *map) {
+	munmap(map->base, map->size);
+}
@@ -0,0 +1,80 @@
+#ifndef _TRAJECTORY_H_
+#define _TRAJECTORY_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#define TRAJECTORY_MAGIC 		"RK45TRJ"
+#define TRAJECTORY_VERSION 		(1)
+#define TRAJECTORY_EXTENSION 	".trj"
+
+/* Rows per block handed to the writer thread, and blocks in the ring */
+#define TRAJECTORY_BLOCK_ROWS 	(1024)
+#define TRAJECTORY_RING_BLOCKS 	(16)
+
+/* Widest row: time plus the largest N-body state (MAX_STATE_SIZE in bodies.h) */
+#define TRAJECTORY_MAX_COLUMNS 	(33)
+
+/**
+ * File header. It is followed by 'rows' records of 'columns' float64 values:
+ * time, state[0], state[1], ...state[n]. The row count is filled in on close.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t columns;
+	uint64_t rows;
+} trajectory_header_t;
+
+/* A block of rows in the ring buffer */
+typedef struct {
+	uint32_t rows;
+	double data[TRAJECTORY_BLOCK_ROWS*TRAJECTORY_MAX_COLUMNS];
+} trajectory_block_t;
+
+/**
+ * Binary trajectory output. The integrating thread fills blocks, and a dedicated writer
+ * thread drains them from a ring buffer to disk.
+ */
+typedef struct {
+	FILE *file;
+	trajectory_header_t header;
+	pthread_t thread;
+
+	/* Ring of blocks: [tail, head) are full and waiting for the writer */
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	trajectory_block_t ring[TRAJECTORY_RING_BLOCKS];
+	uint32_t head;
+	uint32_t tail;
+	uint8_t closing;
+} trajectory_writer_t;
+
+/* A trajectory file mapped read-only into memory */
+typedef struct {
+	void *base;
+	size_t size;
+	const trajectory_header_t *header;
+	const double *data;
+} trajectory_map_t;
+
+/* Create a trajectory file for states of the given size, NULL on failure */
+trajectory_writer_t *openTrajectory(const char *fileName, uint8_t stateSize);
+
+/* Append one row: time followed by the state */
+void writeTrajectory(trajectory_writer_t *writer, double time, const double *state);
+
+/* Flush all rows, stop the writer thread and finalize the header */
+void closeTrajectory(trajectory_writer_t *writer);
+
+/* Map a trajectory file, returns FALSE if it is missing or malformed */
+uint8_t mapTrajectory(const char *fileName, trajectory_map_t *map);
+
+/* Release a mapped trajectory */
+void unmapTrajectory(trajectory_map_t *map);
+
+#endif /* _TRAJECTORY_H_ */
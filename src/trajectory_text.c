@@ -0,0 +1,49 @@
+/* Convert a binary trajectory (.trj) to the text format read by output/trajectory_plot.m */
+
+#include <stdlib.h>
+
+#include "trajectory.h"
+
+#define EXPECTED_ARGS 	(2)
+
+int main(int argc, char *argv[]) {
+
+	if (argc < EXPECTED_ARGS || argc > EXPECTED_ARGS + 1) {
+		printf("Usage: %s <trajectory%s> [text file]\n", argv[0], TRAJECTORY_EXTENSION);
+		return EXIT_FAILURE;
+	}
+
+	trajectory_map_t map;
+	if (!mapTrajectory(argv[1], &map)) {
+		printf("Could not read trajectory: %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	/* Default output name drops the extension */
+	char fileName[strlen(argv[1]) + 1];
+	strcpy(fileName, argv[1]);
+	char *extension = strstr(fileName, TRAJECTORY_EXTENSION);
+	if (extension == NULL && argc == EXPECTED_ARGS) {
+		printf("No output file given for: %s\n", argv[1]);
+		unmapTrajectory(&map);
+		return EXIT_FAILURE;
+	}
+	if (extension != NULL) *extension = '\0';
+	FILE *file = fopen(argc > EXPECTED_ARGS ? argv[2] : fileName, "w");
+	if (file == NULL) {
+		unmapTrajectory(&map);
+		return EXIT_FAILURE;
+	}
+
+	/* Same layout as the text logger: "time state[0] state[1] ...state[n] \n" */
+	uint32_t columns = map.header->columns;
+	for (uint64_t row = 0; row < map.header->rows; row++) {
+		for (uint32_t column = 0; column < columns; column++)
+			fprintf(file, "%f ", map.data[row*columns + column]);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+	unmapTrajectory(&map);
+	return EXIT_SUCCESS;
+}
@@ -1,10 +1,22 @@
 #include "util.h"
 
+/**
+ * Parse up to count comma separated numbers into values. Returns how many were read, 0
+ * if the list is malformed or longer than count.
+ */
+static uint8_t parseList(const char *value, double *values, uint8_t count);
+
+/**
+ * Parse a whole decimal integer within [minimum, maximum] into result. Returns 0 if the
+ * value is empty, has trailing characters or is out of range.
+ */
+static uint8_t parseInteger(const char *value, long minimum, long maximum, long *result);
+
 
 uint8_t parseArguments(int argc, char *argv[], configuration_t *configuration) {
 
-	/* If we don't get the correct number of arguments */
-	if (EXPECTED_ARGS != argc)
+	/* If we don't get the positional arguments, or an option is missing its value */
+	if (argc < EXPECTED_ARGS || (argc - EXPECTED_ARGS) % 2 != 0)
 		return 0;
 
 	/* Retrieve arguments */
@@ -14,16 +26,198 @@ uint8_t parseArguments(int argc, char *argv[], configuration_t *configuration) {
 	configuration->startTime = START_TIME;
 	configuration->endTime   = END_TIME;
 	configuration->timeStep  = TIME_STEP;
+	configuration->timeBound = NULL;
+	configuration->integrator = INTEGRATOR_EULER;
+	configuration->tableau   = &RKF45_TABLEAU;
+	configuration->control   = (step_control_t)RK45_CONTROL_DEFAULTS;
+	configuration->regularizeEarth = 0;
+	configuration->regularizeMoon  = 0;
 	configuration->stateSize = THREE_BODY_STATE_SIZE;
     configuration->loggingEnabled = 0;
-	
+	configuration->threads   = (uint16_t)sysconf(_SC_NPROCESSORS_ONLN);
+	configuration->batched   = 0;
+	configuration->search    = SEARCH_GRID;
+	configuration->screen    = SCREEN_OFF;
+	configuration->shard     = 0;
+	configuration->shards    = 1;
+	configuration->ephemeris = 0;
+	configuration->bodies    = NULL;
+	configuration->swarm     = 0;
+
+	/* Optional "--option value" pairs */
+	for (int index = EXPECTED_ARGS; index < argc; index += 2)
+		if (!parseOption(argv[index], argv[index + 1], configuration))
+			return 0;
+	if (configuration->bodies != NULL)
+		configuration->stateSize = configuration->bodies->count*BODY_STATE_SIZE;
+
+	trajectoryFileName(configuration);
+	return 1;
+}
+
+
+void trajectoryFileName(configuration_t *configuration) {
+
 	sprintf(configuration->fileName, "output/Optimum_%d_%.3f_%.3f", 
 					configuration->objective,
 					configuration->clearance,
 					configuration->accuracy);
 
 	removeDots(configuration->fileName);
-	return 1;
+	strcat(configuration->fileName, TRAJECTORY_EXTENSION);
+}
+
+
+uint8_t parseOption(const char *option, const char *value, configuration_t *configuration) {
+
+	if (strcmp(option, OPTION_THREADS) == 0) {
+		long threads;
+		if (!parseInteger(value, 1, UINT16_MAX, &threads)) return 0;
+		configuration->threads = (uint16_t)threads;
+		return 1;
+	}
+	if (strcmp(option, OPTION_TABLEAU) == 0) {
+		configuration->tableau = findTableau(value);
+		return configuration->tableau != NULL;
+	}
+	if (strcmp(option, OPTION_BATCH) == 0) {
+		long batched;
+		if (!parseInteger(value, 0, 1, &batched)) return 0;
+		configuration->batched = (batched != 0);
+		return 1;
+	}
+	if (strcmp(option, OPTION_SEARCH) == 0) {
+		if (strcmp(value, "grid") == 0)
+			configuration->search = SEARCH_GRID;
+		else if (strcmp(value, "adaptive") == 0)
+			configuration->search = SEARCH_ADAPTIVE;
+		else if (strcmp(value, "cmaes") == 0)
+			configuration->search = SEARCH_CMAES;
+		else if (strcmp(value, "ring") == 0)
+			configuration->search = SEARCH_RING;
+		else if (strcmp(value, "shooting") == 0)
+			configuration->search = SEARCH_SHOOTING;
+		else
+			return 0;
+		return 1;
+	}
+	if (strcmp(option, OPTION_EPHEMERIS) == 0) {
+		long ephemeris;
+		if (!parseInteger(value, 0, 1, &ephemeris)) return 0;
+		configuration->ephemeris = (ephemeris != 0);
+		return 1;
+	}
+	if (strcmp(option, OPTION_BODIES) == 0) {
+		configuration->bodies = findBodies(value);
+		return configuration->bodies != NULL;
+	}
+	if (strcmp(option, OPTION_SWARM) == 0) {
+		long particles;
+		if (!parseInteger(value, 0, UINT32_MAX, &particles)) return 0;
+		configuration->swarm = (uint32_t)particles;
+		return 1;
+	}
+	if (strcmp(option, OPTION_INTEGRATOR) == 0) {
+		if (strcmp(value, "euler") == 0)
+			configuration->integrator = INTEGRATOR_EULER;
+		else if (strcmp(value, "leapfrog") == 0)
+			configuration->integrator = INTEGRATOR_LEAPFROG;
+		else if (strcmp(value, "forestruth") == 0)
+			configuration->integrator = INTEGRATOR_FOREST_RUTH;
+		else
+			return 0;
+		return 1;
+	}
+	if (strcmp(option, OPTION_STEP) == 0) {
+		double step = strtod(value, (char **)NULL);
+		if (!(step > 0)) return 0;
+		configuration->timeStep = step;
+		return 1;
+	}
+	if (strcmp(option, OPTION_SCREEN) == 0) {
+		if (strcmp(value, "off") == 0)
+			configuration->screen = SCREEN_OFF;
+		else if (strcmp(value, "on") == 0)
+			configuration->screen = SCREEN_ON;
+		else if (strcmp(value, "verify") == 0)
+			configuration->screen = SCREEN_VERIFY;
+		else
+			return 0;
+		return 1;
+	}
+	if (strcmp(option, OPTION_REGULARIZE) == 0) {
+		/* "earth,moon" radii in metres, or one radius for both */
+		double radii[2];
+		uint8_t count = parseList(value, radii, 2);
+		if (count == 0 || !(radii[0] >= 0) || !(radii[count - 1] >= 0)) return 0;
+		configuration->regularizeEarth = radii[0];
+		configuration->regularizeMoon  = radii[count - 1];
+		return 1;
+	}
+	if (strcmp(option, OPTION_ATOL) == 0 || strcmp(option, OPTION_RTOL) == 0) {
+		/* "position,velocity" tolerances, or one tolerance for both */
+		double tolerances[2];
+		uint8_t count = parseList(value, tolerances, 2);
+		if (count == 0 || !(tolerances[0] > 0) || !(tolerances[count - 1] > 0)) return 0;
+		double *target = (strcmp(option, OPTION_ATOL) == 0) ?
+			configuration->control.absolute : configuration->control.relative;
+		for (uint8_t i = 0; i < BODY_STATE_SIZE; i++)
+			target[i] = (i < 2) ? tolerances[0] : tolerances[count - 1];
+		return 1;
+	}
+	if (strcmp(option, OPTION_MAX_STEP) == 0) {
+		double step = strtod(value, (char **)NULL);
+		if (!(step > 0)) return 0;
+		configuration->control.maxStep = step;
+		return 1;
+	}
+	if (strcmp(option, OPTION_FIRST_STEP) == 0) {
+		double step = strtod(value, (char **)NULL);
+		if (!(step >= 0)) return 0;
+		configuration->control.firstStep = step;
+		return 1;
+	}
+	if (strcmp(option, OPTION_CONTROLLER) == 0) {
+		/* "safety,alpha,beta,shrink,growth" */
+		double values[5];
+		if (parseList(value, values, 5) != 5) return 0;
+		if (!(values[0] > 0 && values[0] <= 1) || !(values[3] > 0 && values[3] < 1) ||
+				!(values[4] > 1))
+			return 0;
+		configuration->control.safety = values[0];
+		configuration->control.alpha  = values[1];
+		configuration->control.beta   = values[2];
+		configuration->control.shrink = values[3];
+		configuration->control.growth = values[4];
+		return 1;
+	}
+	/* Unknown option */
+	return 0;
+}
+
+
+uint8_t parseList(const char *value, double *values, uint8_t count) {
+
+	uint8_t read = 0;
+	char *end;
+	for (;;) {
+		if (read == count) return 0;
+		values[read++] = strtod(value, &end);
+		if (end == value) return 0;
+		if (*end == '\0') return read;
+		if (*end != ',') return 0;
+		value = end + 1;
+	}
+}
+
+
+uint8_t parseInteger(const char *value, long minimum, long maximum, long *result) {
+
+	char *end;
+	errno = 0;
+	*result = strtol(value, &end, 10);
+	return end != value && *end == '\0' && errno == 0 && *result >= minimum &&
+		*result <= maximum;
 }
 
 
@@ -45,7 +239,14 @@ configuration_t getConfiguration() {
 		.startTime = 0.0,
 		.endTime = 10.0,
 		.timeStep = 0.01,
-		.stateSize = 12
+		.timeBound = NULL,
+		.integrator = INTEGRATOR_EULER,
+		.tableau = &RKF45_TABLEAU,
+		.control = RK45_CONTROL_DEFAULTS,
+		.stateSize = 12,
+		.threads = 1,
+		.search = SEARCH_GRID,
+		.shards = 1
 	};
 	return config;
 }
@@ -75,6 +276,19 @@ void fillInitialConditions(double *stateBuffer, uint8_t size) {
 	state.vxm = -velocityMoon*sinf(THETA_M0_RAD);
 	state.vym = velocityMoon*cosf(THETA_M0_RAD);
 
-	memcpy(stateBuffer, &state, size*sizeof(double));
+	memcpy(stateBuffer, &state, (size < THREE_BODY_STATE_SIZE ? size :
+				THREE_BODY_STATE_SIZE)*sizeof(double));
+
+	/* Perturbers of a general N-body state follow the three bodies */
+	for (uint8_t body = BODY_FIRST_PERTURBER; BODY_STATE_SIZE*(body + 1) <= size; body++)
+		placePerturber(getBodies(), body, stateBuffer + BODY_STATE_SIZE*body);
+}
+
+
+uint8_t (*selectEquations(configuration_t configuration))(double time, double *stateVector) {
+
+	if (configuration.bodies != NULL) return &nbodyEquations;
+	if (configuration.ephemeris) return &equationsRestricted;
+	return &equations;
 }
 
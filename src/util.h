@@ -1,13 +1,33 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "configuration.h"
 #include "equations.h"
+#include "trajectory.h"
 
 #define EXPECTED_ARGS 	(4)
+#define OPTION_THREADS 	"--threads"
+#define OPTION_BATCH 	"--batch"
+#define OPTION_TABLEAU 	"--tableau"
+#define OPTION_SEARCH 	"--search"
+#define OPTION_EPHEMERIS 	"--ephemeris"
+#define OPTION_BODIES 	"--bodies"
+#define OPTION_SWARM 	"--swarm"
+#define OPTION_INTEGRATOR 	"--integrator"
+#define OPTION_STEP 	"--step"
+#define OPTION_SCREEN 	"--screen"
+#define OPTION_REGULARIZE 	"--regularize"
+#define OPTION_ATOL 	"--atol"
+#define OPTION_RTOL 	"--rtol"
+#define OPTION_MAX_STEP 	"--max-step"
+#define OPTION_FIRST_STEP 	"--first-step"
+#define OPTION_CONTROLLER 	"--controller"
 
 /* Represents all the arguments to the program */
 typedef struct {
@@ -19,10 +39,19 @@ typedef struct {
 /* Parse command line arguments */
 uint8_t parseArguments(int argc, char *argv[], configuration_t *configuration);
 
+/* Name the trajectory file of the optimum after the objective, clearance and accuracy */
+void trajectoryFileName(configuration_t *configuration);
+
+/* Parse a single "--option value" pair following the positional arguments */
+uint8_t parseOption(const char *option, const char *value, configuration_t *configuration);
+
 /* Retrieve an integration configuration */
 configuration_t getConfiguration();
 
-/* Fill the initial conditions for our specific scenario */
+/* Right hand side of a configuration: restricted, general N-body or three body equations */
+uint8_t (*selectEquations(configuration_t configuration))(double time, double *stateVector);
+
+/* Fill the initial conditions for our specific scenario, perturbers from getBodies() */
 void fillInitialConditions(double *state, uint8_t size);
 
 void removeDots(char string[MAX_FILE_NAME_SIZE]);